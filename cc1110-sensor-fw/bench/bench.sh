@@ -0,0 +1,117 @@
+#!/bin/sh
+#
+# CYCLE BENCHMARK - run by 'make bench'
+#
+# Runs a BENCH build of the firmware (see sensor_bench.h) in SDCC's 8051
+# simulator and prints the CPU cycles of each phase of a wake cycle.
+#
+#   bench.sh s51 image.ihx image.map [wakes]
+#
+# A breakpoint on bench_mark() stops the simulator at every phase marker; the
+# marker id is read from DPL and the clock count from 'state'. The s51 core
+# counts 12 clocks per machine cycle, the CC1110 core one clock per machine
+# cycle, so CC1110 cycles = clocks / 12 (an upper bound: the CC1110 also drops
+# some bus states). Microseconds are given at 26 MHz; the phases before
+# halClockSwitchToXosc() and after halClockSwitchToRcosc() run from the 13 MHz
+# HS RCOSC and take twice that.
+#
+# Hardware waits take no time in a BENCH build: these are the cycles the CPU
+# spends on its own work. 'make sim' gives the time spent waiting.
+#
+
+S51=${1:?usage: bench.sh s51 image.ihx image.map [wakes]}
+IHX=${2:?usage: bench.sh s51 image.ihx image.map [wakes]}
+MAP=${3:?usage: bench.sh s51 image.ihx image.map [wakes]}
+WAKES=${4:-8}
+
+# Seconds before a run that never reaches its markers is given up
+TIMEOUT=60
+
+# Address of bench_mark() from the linker map
+MARK=$(awk '{ for (i = 2; i <= NF; i++) if ($i == "_bench_mark") { print $(i - 1); exit } }' "$MAP")
+if [ -z "$MARK" ]; then
+    echo "bench: _bench_mark not found in $MAP (not a BENCH build?)" >&2
+    exit 1
+fi
+
+# At most 2 markers per phase and wake, plus the two overhead markers
+STOPS=$((WAKES * 28 + 2))
+
+{
+    echo "break 0x$MARK"
+    i=0
+    while [ $i -lt $STOPS ]; do
+        echo "run"
+        echo "dr"
+        echo "state"
+        i=$((i + 1))
+    done
+    echo "quit"
+} | timeout $TIMEOUT "$S51" -t 8052 "$IHX" 2>&1 | awk -v wakes="$WAKES" '
+BEGIN {
+    # Phase names by id, in step with sensor_bench.h
+    split("marker wake adc_sensors adc_battery adc_pir adc_thermopile " \
+          "adc_thermistor encode xosc radio_start send_packet rcosc sleep pir_dsp", name, " ")
+    END_BIT = 128
+    SLEEP = 12
+    PHASES = 13
+    done = 0
+}
+
+# Marker id: the argument of bench_mark() in DPL
+/DPTR= *0x/ {
+    match($0, /DPTR= *0x[0-9a-fA-F]+/)
+    dptr = substr($0, RSTART, RLENGTH)
+    sub(/.*0x/, "", dptr)
+    id = hex(substr(dptr, length(dptr) - 1))
+    have_id = 1
+}
+
+# Clock count at the stop, closes the stop
+/Total time since last reset/ && have_id && done < wakes {
+    match($0, /\([0-9]+ clks\)/)
+    clks = substr($0, RSTART + 1, RLENGTH - 7) + 0
+    have_id = 0
+
+    phase = id % END_BIT
+    if (id < END_BIT) {
+        start[phase] = clks
+    } else if (phase in start) {
+        cycles = (clks - start[phase]) / 12
+        delete start[phase]
+        if (phase == 0) {
+            overhead = cycles
+        } else {
+            cycles -= overhead
+            if (!(phase in count) || cycles < min[phase]) min[phase] = cycles
+            if (!(phase in count) || cycles > max[phase]) max[phase] = cycles
+            sum[phase] += cycles
+            count[phase]++
+        }
+        if (phase == SLEEP)
+            done++
+    }
+}
+
+function hex(s,    i, v) {
+    v = 0
+    s = tolower(s)
+    for (i = 1; i <= length(s); i++)
+        v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+    return v
+}
+
+END {
+    if (done == 0) {
+        print "bench: no complete wake cycle, did s51 run the image?" > "/dev/stderr"
+        exit 1
+    }
+    printf "%d wake cycles, marker overhead %d cycles taken off\n\n", done, overhead
+    printf "%-16s %5s %9s %9s %9s %11s\n", "phase", "runs", "min", "avg", "max", "avg us@26M"
+    for (p = 1; p <= PHASES; p++) {
+        if (!(p in count))
+            continue
+        avg = sum[p] / count[p]
+        printf "%-16s %5d %9d %9d %9d %11.1f\n", name[p + 1], count[p], min[p], avg, max[p], avg / 26
+    }
+}'
@@ -4,6 +4,12 @@
 #include "cc1110.h"
 #include "ioCCxx10_bitdef.h"
 #include "types.h"
+#include "sensor_config.h"
+#include "hal_dma.h"
+#include "hal_power.h"
+#include "hal_timer.h"
+#include "device_identity.h"
+#include "sensor_crypt.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -11,10 +17,149 @@
 * RADIO CONSTANTS
 */
 
-#define DEVICE_NUMBER			1
-#define DESTINATION_ADDR	0x00 	// What device do we send this too, or is it broadcast?
 #define MAX_PACKET_SIZE		61	
-#define MAX_PAYLOAD_SIZE 	MAX_PACKET_SIZE-4	
+#define PACKET_HEADER_SIZE	4
+#define PACKET_SOURCE_INDEX	2	// Header byte holding the device address
+#define PACKET_SEQ_INDEX	3	// Header byte holding the frame sequence number
+#define MAX_PAYLOAD_SIZE 	(MAX_PACKET_SIZE-PACKET_HEADER_SIZE)
+
+// Where the encoded report goes, and how long it may be. With RADIO_AES the
+// payload is the secured report (sensor_crypt.h): marker, session and frame
+// counter ahead of it, the MIC after it.
+#ifdef RADIO_AES
+#define PACKET_PAYLOAD_INDEX	CRYPT_PAYLOAD_INDEX
+#define MAX_REPORT_SIZE		(MAX_PAYLOAD_SIZE-CRYPT_OVERHEAD)
+#else
+#define PACKET_PAYLOAD_INDEX	PACKET_HEADER_SIZE
+#define MAX_REPORT_SIZE		MAX_PAYLOAD_SIZE
+#endif
+
+// Acknowledgement (RADIO_ACK): a bare header from the gateway, {length 3,
+// destination = our device address, source = the address the packet was sent
+// to, the frame sequence number of the packet}, plus the two status bytes
+// the radio appends (RSSI, LQI with CRC_OK in bit 7).
+#define ACK_FRAME_SIZE		(PACKET_HEADER_SIZE + 2)
+#define ACK_LQI_INDEX		(PACKET_HEADER_SIZE + 1)
+#define ACK_CRC_OK		0x80
+
+// RX window in ticks of ACK_TICK_US, set for the profile (radio_ack_ticks);
+// once the sync word is in, the rest of the ACK gets as long again
+#define ACK_TICK_US		100
+
+// RF interrupts (RFIM) that wake the CPU: the end of a packet, sent or
+// received, and with RADIO_ACK the ACK's sync word
+#ifdef RADIO_ACK
+#define RADIO_RFIM		(RFIF_IRQ_DONE | RFIF_IRQ_SFD)
+#else
+#define RADIO_RFIM		RFIF_IRQ_DONE
+#endif
+
+// MARCSTATE is tested this often while the CPU idles through a calibration
+// (about 800 us), which has no interrupt of its own
+#define RADIO_CAL_POLL_US	20
+
+#if RADIO_TX_DELAY_US && (RADIO_TX_DELAY_US < 10 || RADIO_TX_DELAY_US > 2500)
+#error "RADIO_TX_DELAY_US must be 0 or between 10 and 2500"
+#endif
+
+#ifdef RADIO_ACK
+#if defined(RADIO_FIXED_LENGTH) || defined(RADIO_TX_ISR)
+#error "RADIO_ACK needs variable length mode and DMA TX (no RADIO_FIXED_LENGTH / RADIO_TX_ISR)"
+#endif
+#if RADIO_ACK_TIMEOUT_US < 0 || RADIO_ACK_TIMEOUT_US > 10000
+#error "RADIO_ACK_TIMEOUT_US must be between 0 and 10000"
+#endif
+#if RADIO_ACK_BACKOFF_MS < 1 || (RADIO_ACK_BACKOFF_MS << RADIO_ACK_RETRIES) > 255
+#error "RADIO_ACK_BACKOFF_MS << RADIO_ACK_RETRIES must be between 1 and 255"
+#endif
+#endif
+
+// Clear channel assessment (RADIO_CCA): PKTSTATUS.CCA follows the
+// MCSM1.CCA_MODE condition, which also gates STX in RX
+#define PKTSTATUS_CCA		0x10
+
+#ifdef RADIO_CCA
+#define RADIO_MCSM1_CCA		MCSM1_CCA_MODE_RSSI1	// RSSI below threshold, not receiving
+#else
+#define RADIO_MCSM1_CCA		MCSM1_CCA_MODE_ALWAYS
+#endif
+#ifdef RADIO_ACK
+#define RADIO_MCSM1_TXOFF	MCSM1_TXOFF_MODE_RX	// Listen for the ACK
+#else
+#define RADIO_MCSM1_TXOFF	MCSM1_TXOFF_MODE_IDLE
+#endif
+
+// Link layer registers in the radio profiles (cc1110_radio_tables.h),
+// which follow the build options rather than the profile. ADDR comes from
+// the device identity once the image is in.
+#ifdef RADIO_FIXED_LENGTH
+#define RADIO_LINK_PKTLEN	MAX_PACKET_SIZE		// Packet length - 61 fixed
+#define RADIO_LINK_PKTCTRL0	0x44			// Fixed packet size with whitening
+#else
+#define RADIO_LINK_PKTLEN	(MAX_PACKET_SIZE - 1)	// Maximum length byte value - 60
+#define RADIO_LINK_PKTCTRL0	0x45			// Variable packet size with whitening
+#endif
+#define RADIO_LINK_PKTCTRL1	(PKTCTRL1_APPEND_STATUS | ADR_CHK_0_BRDCST)
+#define RADIO_LINK_ADDR		0x00
+#define RADIO_LINK_MCSM1	(RADIO_MCSM1_CCA | MCSM1_RXOFF_MODE_IDLE | RADIO_MCSM1_TXOFF)
+#define RADIO_LINK_AGCCTRL1	(RADIO_CCA_THRESHOLD_DB & AGCCTRL1_CARRIER_SENSE_ABS_THR)	// CARRIER_SENSE_ABS_THR only, ORed with the profile's bits (RADIO_CCA)
+
+#ifdef RADIO_CCA
+#ifdef RADIO_TX_ISR
+#error "RADIO_CCA needs the DMA TX path (no RADIO_TX_ISR)"
+#endif
+#if RADIO_CCA_THRESHOLD_DB < -7 || RADIO_CCA_THRESHOLD_DB > 7
+#error "RADIO_CCA_THRESHOLD_DB must be between -7 and 7"
+#endif
+#if RADIO_CCA_LISTEN_US < 10 || RADIO_CCA_LISTEN_US > 2500
+#error "RADIO_CCA_LISTEN_US must be between 10 and 2500"
+#endif
+#if RADIO_CCA_TRIES < 1 || RADIO_CCA_BACKOFF_MS < 1 || (RADIO_CCA_BACKOFF_MS << (RADIO_CCA_TRIES - 1)) > 255
+#error "RADIO_CCA_TRIES must be at least 1, RADIO_CCA_BACKOFF_MS << (RADIO_CCA_TRIES - 1) between 1 and 255"
+#endif
+#endif
+
+#ifdef RADIO_AES
+#ifdef RADIO_TX_ISR
+#error "RADIO_AES needs the DMA TX path (no RADIO_TX_ISR)"
+#endif
+#if PACKET_HEADER_SIZE != CRYPT_FRAME_HEADER_SIZE || \
+    PACKET_PAYLOAD_INDEX + CRYPT_BLOCKS(MAX_REPORT_SIZE) * CRYPT_BLOCK_SIZE > MAX_PACKET_SIZE
+#error "sensor_crypt.h does not match the packet layout"
+#endif
+#endif
+
+
+/*==== TYPES =================================================================*/
+
+// Radio profile, as generated by tools/radio_gen.cpp from profiles/*.rf
+#define RADIO_IMAGE_SIZE	32
+
+typedef struct {
+  uint8 regs[RADIO_IMAGE_SIZE];	// SYNC1 (0xDF00) to FSCAL0 (0xDF1F), copied by DMA
+  uint8 test2;			// Not retained in PM2/PM3, written on every wake
+  uint8 test1;
+  uint8 test0;
+  uint8 pa_table0;
+  uint16 sync_us;		// Preamble and sync word on air, for the ACK window
+} RADIO_SETTINGS;
+
+// Constant tables live in flash on the 8051, which the DMA controller reads
+// through its XDATA mapping at the same address
+#if defined (SDCC) || defined (__SDCC)
+#define RADIO_TABLE		__code
+#else
+#define RADIO_TABLE
+#endif
+
+#include "cc1110_radio_tables.h"
+
+#if RADIO_PROFILE >= RADIO_PROFILES
+#error "RADIO_PROFILE must be one of the RADIO_PROFILE_* in cc1110_radio_tables.h"
+#endif
+
+// No profile in the radio registers
+#define RADIO_IMAGE_NONE	0xFF
 
 
 /*==== CONSTS ================================================================*/
@@ -24,9 +169,57 @@
 static uint8 packet_index;
 
 // Page 196 of cc1110-cc11110
-static unsigned char xdata packet_header[] = {DESTINATION_ADDR, MAX_PAYLOAD_SIZE, 1, 1}; // destination, size, stream num of packets, seq number
+#ifdef RADIO_FIXED_LENGTH
+#define PACKET_DEST_INDEX	0
+static unsigned char xdata packet_header[PACKET_HEADER_SIZE] = {DESTINATION_ADDR, MAX_PAYLOAD_SIZE, DEVICE_NUMBER, 0}; // destination, size, source (device address), seq number (send_packet())
+#else
+// In variable length mode the radio sends the length byte first; it counts
+// every byte after itself and is filled in by radio_set_payload_length().
+#define PACKET_DEST_INDEX	1
+static unsigned char xdata packet_header[PACKET_HEADER_SIZE] = {0, DESTINATION_ADDR, DEVICE_NUMBER, 0}; // length, destination, source (device address), seq number (send_packet())
+#endif
 static unsigned char xdata packet[MAX_PACKET_SIZE] = {0};
 
+// Frame sequence number, one per frame put on air (retransmissions keep
+// theirs). XRAM is retained in PM2 and PM3, so it only starts over at reset:
+// a gap seen by the receiver is a lost frame, never a reading the sensor
+// chose not to send.
+static uint8 xdata radio_seq = 0;
+
+#ifdef RADIO_ACK
+static unsigned char xdata ack_frame[ACK_FRAME_SIZE];
+
+// Delivery statistics since reset
+static uint16 xdata radio_ack_retries  = 0;    // Retransmissions
+static uint16 xdata radio_ack_failures = 0;    // Packets never acknowledged
+#endif
+
+#ifdef RADIO_AES
+// Report length to seal in send_packet(), see radio_set_payload_length()
+static uint8 radio_report_len;
+#endif
+
+// RF interrupt flags (RADIO_RFIM) taken by rf_isr since they were last
+// cleared; the radio's waits idle until the one they need turns up
+static volatile uint8 radio_irq;
+
+// Profile for radio_start() (radio_set_profile()), and the one in the radio
+// registers, which keep it through PM2 and PM3 like XRAM: it is only loaded
+// again after a reset or a change of profile
+static uint8 xdata radio_profile = RADIO_PROFILE;
+static uint8 xdata radio_image   = RADIO_IMAGE_NONE;
+
+#ifdef RADIO_ACK
+// ACK window for the profile in ticks of ACK_TICK_US, see radio_wait_ack()
+static uint8 xdata radio_ack_ticks;
+#endif
+
+#ifdef RADIO_CCA
+// Channel access statistics since reset
+static uint16 xdata radio_cca_busy     = 0;    // Assessments that found the channel busy
+static uint16 xdata radio_cca_forced   = 0;    // Packets sent without a clear channel
+#endif
+
 /*==== ISR ================================================================*/
 
 INTERRUPT(rftxrx_isr, RFTXRX_VECTOR)
@@ -49,6 +242,25 @@ INTERRUPT(rftxrx_isr, RFTXRX_VECTOR)
   P1_0 ^= 1; // yellow led off	
 }
 
+
+/******************************************************************************
+* @fn  rf_isr
+*
+* @brief
+*      RF general interrupt, one of RADIO_RFIM. Moves the flags into
+*      radio_irq, for the waits in idle mode, and clears them.
+*
+******************************************************************************/
+INTERRUPT(rf_isr, RF_VECTOR)
+{
+  uint8 flags = RFIF;
+
+  // Module flags first (writing 1 leaves a flag alone), then the CPU flag
+  RFIF = ~flags;
+  S1CON = 0;
+  radio_irq |= flags;
+}
+
 /*******************************************************************************
 * If building with a C++ compiler, make all of the definitions in this header
 * have a C binding.
@@ -59,32 +271,340 @@ extern "C"
 #endif
 	
 	
-void send_packet() {
+/******************************************************************************
+* @fn  radio_set_payload_length
+*
+* @brief
+*      Set the length byte of the packet in 'packet' for a payload of the
+*      given size. In fixed length mode (RADIO_FIXED_LENGTH) every packet is
+*      MAX_PACKET_SIZE bytes on air and the header keeps MAX_PAYLOAD_SIZE.
+*      With RADIO_AES the size is that of the report at PACKET_PAYLOAD_INDEX,
+*      without the CRYPT_OVERHEAD; in fixed length mode the whole
+*      MAX_REPORT_SIZE, padding and all, is sealed.
+*
+******************************************************************************/
+void radio_set_payload_length(uint8 payload_len)
+{
+#ifdef RADIO_AES
+#ifdef RADIO_FIXED_LENGTH
+  radio_report_len = MAX_REPORT_SIZE;
+#else
+  radio_report_len = payload_len;
+#endif
+  payload_len += CRYPT_OVERHEAD;
+#endif
 
-  // use timer 3 to delay tx to allow time to switch from tx to rx
-	
-  T3CTL=0xDC;
-  T3OVFIF=0; 
-  while (!T3OVFIF);
-  T3CTL=0;
+#ifdef RADIO_FIXED_LENGTH
+  (void)payload_len;
+#else
+  packet[0] = (PACKET_HEADER_SIZE - 1) + payload_len;
+#endif
+}
 
-	
 
+/******************************************************************************
+* @fn  radio_set_profile
+*
+* @brief
+*      Select the radio profile (RADIO_PROFILE_*, cc1110_radio_tables.h).
+*      The next radio_start() loads it into the radio.
+*
+* @return uint8
+*          FALSE if there is no such profile; the current one stays.
+*
+******************************************************************************/
+uint8 radio_set_profile(uint8 profile)
+{
+  if (profile >= RADIO_PROFILES)
+    return FALSE;
+
+  radio_profile = profile;
+  return TRUE;
+}
+
+
+/******************************************************************************
+* @fn  radio_set_identity
+*
+* @brief
+*      Put the device and destination address of the device identity
+*      (deviceIdentityLoad()) in the packet header and select its radio
+*      profile. Call once at boot.
+*
+******************************************************************************/
+void radio_set_identity(void)
+{
+  packet_header[PACKET_DEST_INDEX]   = device_destination;
+  packet_header[PACKET_SOURCE_INDEX] = device_address;
+
+  // The site's radio profile, if provisioned, over the build's RADIO_PROFILE
+  if (device_profile != IDENTITY_PROFILE_NONE)
+    radio_set_profile(device_profile);
+
+#if defined(RADIO_ACK) || defined(RADIO_CCA) || SLEEP_JITTER_MS
+  // The backoff and wake jitter random numbers differ from one device to the
+  // next. Each write to RNDL shifts the old RNDL into RNDH.
+  RNDL = device_address;
+  RNDL = device_address ^ 0x5A;
+#endif
+}
+
+
+#if defined(RADIO_ACK) || defined(RADIO_CCA)
+/******************************************************************************
+* @fn  radio_backoff
+*
+* @brief
+*      Random wait of 1 to 'window' ms before the next try, radio idle and
+*      CPU in idle mode.
+*
+******************************************************************************/
+static void radio_backoff(uint8 window)
+{
+  uint8 ms;
+
+  // Clock the random number generator's LFSR once
+  ADCCON1 = (ADCCON1 & ~ADCCON1_RCTRL) | ADCCON1_RCTRL_LFSR13;
+  ms = (RNDL % window) + 1;
+
+  HAL_TIMER_IDLE(HAL_TIMER_MS, ms);
+}
+#endif
+
+
+#ifdef RADIO_CCA
+/******************************************************************************
+* @fn  radio_cca_start
+*
+* @brief
+*      Listen before talk, then start the TX DMA and the transmission. Each
+*      try listens for RADIO_CCA_LISTEN_US, so the RSSI is valid, and strobes
+*      STX, which the radio only takes on a clear channel; a busy channel
+*      means idle and a random backoff. After RADIO_CCA_TRIES busy channels
+*      the packet is sent from IDLE, where STX is not gated.
+*
+******************************************************************************/
+static void radio_cca_start(void)
+{
+  uint8 attempt;
+
+  for (attempt = 0; attempt < RADIO_CCA_TRIES; attempt++)
+  {
+    RFST = RFST_SRX;
+    HAL_IDLE_POLL(MARCSTATE == MARC_STATE_RX, RADIO_CAL_POLL_US);
+    HAL_TIMER_IDLE(HAL_TIMER_US(RADIO_CCA_LISTEN_US), 1);
+
+    DMA_ARM_CHANNEL(DMA_CH_RADIO);
+    RFST = RFST_STX;
+
+    // The radio leaves RX within a few clocks if it took the strobe
+    HAL_WAIT_UNTIL(MARCSTATE != MARC_STATE_RX || !(PKTSTATUS & PKTSTATUS_CCA));
+    if (MARCSTATE != MARC_STATE_RX)
+      return;
+
+    // Busy. The DMA may have moved a byte received meanwhile; rearming
+    // starts it over.
+    DMA_ABORT_CHANNEL(DMA_CH_RADIO);
+    RFST = RFST_SIDLE;
+    HAL_WAIT_UNTIL(MARCSTATE == MARC_STATE_IDLE);
+    radio_irq = 0;
+    radio_cca_busy++;
+
+    if (attempt + 1 < RADIO_CCA_TRIES)
+      radio_backoff(RADIO_CCA_BACKOFF_MS << attempt);
+  }
+
+  radio_cca_forced++;
+  DMA_ARM_CHANNEL(DMA_CH_RADIO);
+  RFST = RFST_STX;
+}
+#endif
+
+
+/******************************************************************************
+* @fn  radio_transmit
+*
+* @brief
+*      Put 'packet' on air. Returns once the radio has left TX: in IDLE, or
+*      with RADIO_ACK in RX, listening for the acknowledgement. The CPU idles
+*      from the strobe, calibration included, until the radio's IRQ_DONE
+*      interrupt says the packet and its CRC are out.
+*
+******************************************************************************/
+static void radio_transmit(void)
+{
   packet_index = 0;
-	
+  radio_irq = 0;
+
+#ifdef RADIO_TX_ISR
+  // The RFTXRX interrupt feeds every byte
   RFST = RFST_STX;
-  while (MARCSTATE != MARC_STATE_TX);
-	
-  // tx happens here
-  while (MARCSTATE != MARC_STATE_IDLE);
-	
-  RFIF=0;
-	
+#else
+  // DMA feeds RFD on every radio byte request
+#ifdef RADIO_CCA
+  radio_cca_start();
+#else
+  DMA_ARM_CHANNEL(DMA_CH_RADIO);
+  RFST = RFST_STX;
+#endif
+#endif
+
+  HAL_IDLE_UNTIL(radio_irq & RFIF_IRQ_DONE);
+
+  // TXOFF_MODE takes effect within a few microseconds of IRQ_DONE
+#ifdef RADIO_ACK
+  HAL_WAIT_UNTIL(MARCSTATE == MARC_STATE_RX);	// MCSM1.TXOFF_MODE = RX
+#else
+  HAL_WAIT_UNTIL(MARCSTATE == MARC_STATE_IDLE);
+#endif
+  radio_irq = 0;
 	
 	// Reset
 	packet_index = 0;
 }
 
+
+#ifdef RADIO_ACK
+/******************************************************************************
+* @fn  radio_wait_ack
+*
+* @brief
+*      Listen for the gateway's acknowledgement of the packet just sent, with
+*      the radio already in RX and the CPU idle. The window closes after
+*      radio_ack_ticks without a sync word; the radio is idle on return.
+*
+* @return uint8
+*          TRUE if a valid ACK for this packet came in.
+*
+******************************************************************************/
+static uint8 radio_wait_ack(void)
+{
+  dmaDone &= ~(0x01 << DMA_CH_RADIO_RX);
+  DMA_ARM_CHANNEL(DMA_CH_RADIO_RX);
+
+  halTimerStart(HAL_TIMER_US(ACK_TICK_US));
+  HAL_IDLE_UNTIL(DMA_CHANNEL_DONE(DMA_CH_RADIO_RX) ||
+                 (halTimerTicks >= radio_ack_ticks && !(radio_irq & RFIF_IRQ_SFD)) ||
+                 halTimerTicks >= 2 * radio_ack_ticks);
+  halTimerStop();
+
+  RFST = RFST_SIDLE;
+  HAL_WAIT_UNTIL(MARCSTATE == MARC_STATE_IDLE);
+  radio_irq = 0;
+
+  if (!DMA_CHANNEL_DONE(DMA_CH_RADIO_RX))
+  {
+    DMA_ABORT_CHANNEL(DMA_CH_RADIO_RX);
+    return FALSE;
+  }
+
+  return ack_frame[0] == PACKET_HEADER_SIZE - 1 &&
+         ack_frame[PACKET_DEST_INDEX] == device_address &&
+         (ack_frame[PACKET_SOURCE_INDEX] == device_destination || device_destination == 0) &&
+         ack_frame[PACKET_SEQ_INDEX] == packet[PACKET_SEQ_INDEX] &&
+         (ack_frame[ACK_LQI_INDEX] & ACK_CRC_OK);
+}
+#endif
+
+
+/******************************************************************************
+* @fn  send_packet
+*
+* @brief
+*      Transmit 'packet' and wait until the radio is idle again. Every call
+*      stamps the header with the next frame sequence number (radio_seq).
+*      With RADIO_ACK the packet is repeated, with the same sequence number,
+*      until the gateway acknowledges it or RADIO_ACK_RETRIES run out.
+*      With RADIO_CCA every transmission waits for a clear channel first.
+*      With RADIO_AES the payload is sealed (cryptSeal()) once the sequence
+*      number is in, so retransmissions are the same frame. A unit out of
+*      session counts sends the notice instead, once, as nothing
+*      acknowledges it.
+*
+* @return uint8
+*          FALSE if RADIO_ACK is on and the packet was never acknowledged,
+*          or the readings went out as the notice only.
+*
+******************************************************************************/
+uint8 send_packet() {
+#ifdef RADIO_ACK
+  uint8 attempt;
+#endif
+
+#if RADIO_TX_DELAY_US
+  // Hold the transmission back for a receiver that needs the time to get
+  // back to RX, CPU idle
+  HAL_TIMER_IDLE(HAL_TIMER_US(RADIO_TX_DELAY_US), 1);
+#endif
+
+  packet[PACKET_SEQ_INDEX] = radio_seq++;
+#ifdef RADIO_AES
+  if (!cryptSeal(packet, radio_report_len))
+  {
+    // The notice goes out once; with RADIO_ACK the radio still listens
+    // after it, and the ACK wait takes it back to idle
+    radio_transmit();
+#ifdef RADIO_ACK
+    radio_wait_ack();
+#endif
+    return FALSE;
+  }
+#endif
+
+#ifdef RADIO_ACK
+  for (attempt = 0; ; attempt++)
+  {
+    radio_transmit();
+    if (radio_wait_ack())
+      return TRUE;
+    if (attempt == RADIO_ACK_RETRIES)
+      break;
+    radio_ack_retries++;
+    radio_backoff(RADIO_ACK_BACKOFF_MS << attempt);
+  }
+  radio_ack_failures++;
+  return FALSE;
+#else
+  radio_transmit();
+  return TRUE;
+#endif
+}
+
+
+/******************************************************************************
+* @fn  radio_load_image
+*
+* @brief
+*      Copy the register block of the selected radio profile from flash into
+*      the radio registers, one DMA block transfer with the CPU in idle
+*      mode, then set the own address from the device identity for the
+*      address check on anything received (broadcasts to 0 are accepted
+*      too). Radio idle.
+*
+******************************************************************************/
+static void radio_load_image(void)
+{
+  const RADIO_SETTINGS RADIO_TABLE *p = &radio_profiles[radio_profile];
+
+  halDmaConfigure(DMA_CH_RADIO,
+    XDATA_ADDR(p->regs), XDATA_ADDR(&SYNC1),
+    DMA_VLEN_LEN(DMA_VLEN_USE_LEN, RADIO_IMAGE_SIZE),
+    DMA_WORDSIZE_BYTE | DMA_TMODE_BLOCK | DMA_TRIG_NONE,
+    DMA_SRCINC_1 | DMA_DESTINC_1 | DMA_IRQMASK_ENABLE | DMA_M8_USE_8_BITS | DMA_PRI_HIGH);
+  DMA_ARM_CHANNEL(DMA_CH_RADIO);
+  DMAREQ = 0x01 << DMA_CH_RADIO;
+  HAL_IDLE_UNTIL(DMA_CHANNEL_DONE(DMA_CH_RADIO));
+
+  ADDR = device_address;
+  radio_image = radio_profile;
+
+#ifdef RADIO_ACK
+  // The ACK's sync word comes later at lower data rates
+  radio_ack_ticks = (uint8)((RADIO_ACK_TIMEOUT_US + p->sync_us + ACK_TICK_US - 1) / ACK_TICK_US);
+#endif
+}
+
+
 	
 void radio_start() 
 {  
@@ -95,77 +615,61 @@ void radio_start()
 	  // Configure the radio interrupt flags
 		RFIF = 0; // RX Interrupt Flag
 		RFTXRXIF = 0;	
+
+		// The RF general interrupt ends every wait on the radio (rf_isr)
+		radio_irq = 0;
+		RFIM = RADIO_RFIM;
+		S1CON = 0;
+		IEN2 |= IEN2_RFIE;
 	
 		// radio init
 		RFST=RFST_SIDLE; // enter idle state
 	
 	
-    /* NOTE: The register settings are hard-coded for the predefined set of data
-     * rates and frequencies. To enable other data rates or frequencies these
-     * register settings should be adjusted accordingly (use SmartRF(R) Studio).
-     */
-/*
-		# Address Config = No address check 
-		# Base Frequency = 868.299866 
-		# CRC Enable = true 
-		# Carrier Frequency = 871.499084 
-		# Channel Number = 16 
-		# Channel Spacing = 199.951172 
-		# Data Rate = 249.939 
-		# Deviation = 126.953125 
-		# Device Address = 0 
-		# Manchester Enable = false 
-		# Modulated = true 
-		# Modulation Format = GFSK 
-		# PA Ramping = false 
-		# Packet Length = 61 
-		# Packet Length Mode = Fixed packet length mode. Length configured in PKTLEN register 
-		# Preamble Count = 4 
-		# RX Filter BW = 541.666667 
-		# Sync Word Qualifier Mode = 30/32 sync word bits detected 
-		# TX Power = 0 
-		# Whitening = true 
-		# ---------------------------------------------------
-		# Setting for uVision Project CC1110
-		# ---------------------------------------------------
-*/
-		PKTLEN    = MAX_PACKET_SIZE;  // Packet Length  - 61 fixed
-		PKTCTRL0  = 0x44;  // Packet Automation Control - fixed packet size with whitening
-		CHANNR    = 0x10;  // Channel Number  - 16
-		FSCTRL1   = 0x0C;  // Frequency Synthesizer Control 
-		FREQ2     = 0x21;  // Frequency Control Word, High Byte 
-		FREQ1     = 0x65;  // Frequency Control Word, Middle Byte 
-		FREQ0     = 0x6A;  // Frequency Control Word, Low Byte 
-		MDMCFG4   = 0x2D;  // Modem configuration 
-		MDMCFG3   = 0x3B;  // Modem Configuration 
-		MDMCFG2   = 0x13;  // Modem Configuration 
-		DEVIATN   = 0x62;  // Modem Deviation Setting 
-		MCSM0     = 0x30;  // Main Radio Control State Machine Configuration 		-- go idle after sending packet
-		MCSM0     = 0x18;  // Main Radio Control State Machine Configuration 
-		FOCCFG    = 0x1D;  // Frequency Offset Compensation Configuration 
-		BSCFG     = 0x1C;  // Bit Synchronization Configuration 
-		AGCCTRL2  = 0xC7;  // AGC Control 
-		AGCCTRL1  = 0x00;  // AGC Control 
-		AGCCTRL0  = 0xB0;  // AGC Control 
-		FREND1    = 0xB6;  // Front End RX Configuration 
-		FSCAL3    = 0xEA;  // Frequency Synthesizer Calibration 
-		FSCAL2    = 0x2A;  // Frequency Synthesizer Calibration 
-		FSCAL1    = 0x00;  // Frequency Synthesizer Calibration 
-		FSCAL0    = 0x1F;  // Frequency Synthesizer Calibration 
-		TEST1     = 0x31;  // Various Test Settings 
-		TEST0     = 0x09;  // Various Test Settings 
-		PA_TABLE0 = 0x50;  // PA Power Setting 0 
-		
-		
+		// The radio profile (cc1110_radio_tables.h); TEST2-0 are lost in
+		// PM2/PM3, PA_TABLE0 goes with them
+		if (radio_image != radio_profile)
+			radio_load_image();
+		TEST2     = radio_profiles[radio_image].test2;
+		TEST1     = radio_profiles[radio_image].test1;
+		TEST0     = radio_profiles[radio_image].test0;
+		PA_TABLE0 = radio_profiles[radio_image].pa_table0;
+
 		// Packet 0ing
 		packet_index = 0;
 
+#ifdef RADIO_TX_ISR
 		//enable interrupts.
 		RFTXRXIF=0;
 		RFTXRXIE=1;		
+#else
+		// TX data is moved by DMA, triggered by the same radio byte request
+		// that would otherwise raise the RFTXRX interrupt.
+		RFTXRXIF=0;
+		RFTXRXIE=0;
+
+		halDmaConfigure(DMA_CH_RADIO,
+			XDATA_ADDR(packet), XDATA_ADDR(&X_RFD),
+#ifdef RADIO_FIXED_LENGTH
+			DMA_VLEN_LEN(DMA_VLEN_USE_LEN, MAX_PACKET_SIZE),
+#else
+			DMA_VLEN_LEN(DMA_VLEN_FIRST_BYTE_P_1, MAX_PACKET_SIZE),
+#endif
+			DMA_WORDSIZE_BYTE | DMA_TMODE_SINGLE | DMA_TRIG_RADIO,
+			DMA_SRCINC_1 | DMA_DESTINC_0 | DMA_IRQMASK_DISABLE | DMA_M8_USE_8_BITS | DMA_PRI_HIGH);	// IRQ_DONE ends TX
+
+#ifdef RADIO_ACK
+		// The ACK, length byte first, plus the status bytes
+		halDmaConfigure(DMA_CH_RADIO_RX,
+			XDATA_ADDR(&X_RFD), XDATA_ADDR(ack_frame),
+			DMA_VLEN_LEN(DMA_VLEN_FIRST_BYTE_P_3, ACK_FRAME_SIZE),
+			DMA_WORDSIZE_BYTE | DMA_TMODE_SINGLE | DMA_TRIG_RADIO,
+			DMA_SRCINC_0 | DMA_DESTINC_1 | DMA_IRQMASK_ENABLE | DMA_M8_USE_8_BITS | DMA_PRI_HIGH);
+#endif
+#endif
 		
 		RFST=RFST_SIDLE;
-		while(MARCSTATE!=MARC_STATE_IDLE);		
+		HAL_WAIT_UNTIL(MARCSTATE == MARC_STATE_IDLE);		
 		
 	 //   P1_0 ^= 1; // off		
 	
@@ -0,0 +1,108 @@
+#ifndef CC1110_RADIO_TABLES_H
+#define CC1110_RADIO_TABLES_H
+
+/***********************************************************************************
+* Generated by tools/radio_gen.cpp from profiles/fast.rf profiles/robust.rf - do not edit.
+*/
+
+// Profiles, by their index in radio_profiles[]
+#define RADIO_PROFILE_FAST                  0
+#define RADIO_PROFILE_ROBUST                1
+#define RADIO_PROFILES                      2
+
+#ifdef RADIO_HOST
+static const char *const radio_profile_names[RADIO_PROFILES] = { "fast", "robust" };
+#else
+static const RADIO_SETTINGS RADIO_TABLE radio_profiles[RADIO_PROFILES] = {
+    // Fast: 250 kbps GFSK at 871.5 MHz, for short links
+    // 871.499084 MHz (868.299866 MHz + 16 x 199.951 kHz), GFSK 249.939 kbps,
+    // deviation 126.953 kHz, RX filter 541.667 kHz, 4 byte preamble
+    {
+        {
+            0xD3,                   // SYNC1
+            0x91,                   // SYNC0
+            RADIO_LINK_PKTLEN,      // PKTLEN
+            RADIO_LINK_PKTCTRL1,    // PKTCTRL1
+            RADIO_LINK_PKTCTRL0,    // PKTCTRL0
+            RADIO_LINK_ADDR,        // ADDR
+            0x10,                   // CHANNR
+            0x0C,                   // FSCTRL1
+            0x00,                   // FSCTRL0
+            0x21,                   // FREQ2
+            0x65,                   // FREQ1
+            0x6A,                   // FREQ0
+            0x2D,                   // MDMCFG4
+            0x3B,                   // MDMCFG3
+            0x13,                   // MDMCFG2
+            0x22,                   // MDMCFG1
+            0xF8,                   // MDMCFG0
+            0x62,                   // DEVIATN
+            0x07,                   // MCSM2
+            RADIO_LINK_MCSM1,       // MCSM1
+            0x18,                   // MCSM0
+            0x1D,                   // FOCCFG
+            0x1C,                   // BSCFG
+            0xC7,                   // AGCCTRL2
+            0x00 | RADIO_LINK_AGCCTRL1, // AGCCTRL1
+            0xB0,                   // AGCCTRL0
+            0xB6,                   // FREND1
+            0x10,                   // FREND0
+            0xEA,                   // FSCAL3
+            0x2A,                   // FSCAL2
+            0x00,                   // FSCAL1
+            0x1F,                   // FSCAL0
+        },
+        0x88,                   // TEST2
+        0x31,                   // TEST1
+        0x09,                   // TEST0
+        0x50,                   // PA_TABLE0
+        257,                    // Preamble and sync word, us
+    },
+    // Robust: 38.4 kbps GFSK at 871.5 MHz, for long links
+    // 871.499084 MHz (868.299866 MHz + 16 x 199.951 kHz), GFSK 38.383 kbps,
+    // deviation 19.043 kHz, RX filter 101.562 kHz, 4 byte preamble
+    {
+        {
+            0xD3,                   // SYNC1
+            0x91,                   // SYNC0
+            RADIO_LINK_PKTLEN,      // PKTLEN
+            RADIO_LINK_PKTCTRL1,    // PKTCTRL1
+            RADIO_LINK_PKTCTRL0,    // PKTCTRL0
+            RADIO_LINK_ADDR,        // ADDR
+            0x10,                   // CHANNR
+            0x06,                   // FSCTRL1
+            0x00,                   // FSCTRL0
+            0x21,                   // FREQ2
+            0x65,                   // FREQ1
+            0x6A,                   // FREQ0
+            0xCA,                   // MDMCFG4
+            0x83,                   // MDMCFG3
+            0x13,                   // MDMCFG2
+            0x22,                   // MDMCFG1
+            0xF8,                   // MDMCFG0
+            0x34,                   // DEVIATN
+            0x07,                   // MCSM2
+            RADIO_LINK_MCSM1,       // MCSM1
+            0x18,                   // MCSM0
+            0x16,                   // FOCCFG
+            0x6C,                   // BSCFG
+            0x43,                   // AGCCTRL2
+            0x40 | RADIO_LINK_AGCCTRL1, // AGCCTRL1
+            0x91,                   // AGCCTRL0
+            0x56,                   // FREND1
+            0x10,                   // FREND0
+            0xE9,                   // FSCAL3
+            0x2A,                   // FSCAL2
+            0x00,                   // FSCAL1
+            0x1F,                   // FSCAL0
+        },
+        0x81,                   // TEST2
+        0x35,                   // TEST1
+        0x09,                   // TEST0
+        0x50,                   // PA_TABLE0
+        1668,                   // Preamble and sync word, us
+    },
+};
+#endif
+
+#endif /* CC1110_RADIO_TABLES_H */
@@ -72,10 +72,17 @@
 #ifndef COMPILER_H
 #define COMPILER_H
 
+/** Host simulation (g++ on Linux)
+  * SFRs and xdata registers are objects of the simulated register file, see
+  * sim/sim_hal.h.
+ */
+#if defined HOST_SIM
+# include "sim_hal.h"
+
 /** SDCC - Small Device C Compiler
   * http://sdcc.sf.net
  */
-#if defined (SDCC) || defined (__SDCC)
+#elif defined (SDCC) || defined (__SDCC)
 # define SBIT(name, addr, bit)  __sbit  __at(addr+bit)                    name
 # define SFR(name, addr)        __sfr   __at(addr)                        name
 # define SFRX(name, addr)       __xdata volatile unsigned char __at(addr) name
@@ -0,0 +1,341 @@
+#ifndef DEVICE_IDENTITY_H
+#define DEVICE_IDENTITY_H
+
+/*==== INCLUDES ==============================================================*/
+#include "types.h"
+#include "sensor_config.h"
+#include <string.h>
+#if !defined(IDENTITY_HOST) && defined(RADIO_AES)
+#include "cc1110.h"
+#include "ioCCxx10_bitdef.h"
+#include "hal_dma.h"
+#include "hal_power.h"
+#endif
+
+/*
+ * Device identity, kept in the last flash page and read once at boot. The
+ * linker's --code-size keeps the image out of that page (see the Makefile);
+ * 'make provision ADDRESS=n' adds a record for the unit to the image with
+ * tools/identity_gen.cpp and flashes both. A blank page (erased flash, all
+ * 0xFF, e.g. after 'make upload') leaves the build defaults DEVICE_NUMBER,
+ * DESTINATION_ADDR and RADIO_PROFILE in place.
+ *
+ * Record layout at IDENTITY_PAGE_ADDR:
+ *
+ *  Offset  Size  Field
+ *  0       2     IDENTITY_MAGIC0, IDENTITY_MAGIC1
+ *  2       1     Layout version (IDENTITY_VERSION)
+ *  3       1     Device address: radio ADDR register and the source byte
+ *                of every frame header, 1 to 254
+ *  4       1     Destination address (gateway), or 0 for broadcast
+ *  5       1     Radio profile of the site (RADIO_PROFILE_*, see
+ *                cc1110_radio_tables.h), or 0xFF for RADIO_PROFILE
+ *  6       1     Reserved, 0xFF
+ *  7       1     Check byte: the complement of the sum of bytes 0 to 6
+ *
+ * Units sending with RADIO_AES (sensor_crypt.h) may have their own AES-128
+ * key in a second record right after it, at IDENTITY_KEY_ADDR ('make
+ * provision ADDRESS=n KEY=hex'); without one they use RADIO_AES_KEY.
+ *
+ *  Offset  Size  Field
+ *  0       2     IDENTITY_KEY_MAGIC0, IDENTITY_KEY_MAGIC1
+ *  2       1     Layout version (IDENTITY_VERSION)
+ *  3       16    Key
+ *  19      1     Check byte: the complement of the sum of bytes 0 to 18
+ *
+ * RADIO_AES units count the sessions they start in the rest of the page,
+ * from IDENTITY_SESSIONS_ADDR on: one bit per session, cleared by a flash
+ * write, so the count survives resets and power loss and only goes up. The
+ * 16 bit words fill up in order, each giving IDENTITY_SESSION_BITS sessions
+ * from bit 0 up, and so is programmed that many times at most between
+ * erases. Erasing the page (make upload/provision) starts the count over,
+ * so the gateway has to forget the unit's session then. After
+ * IDENTITY_SESSIONS_MAX sessions there are no more; the unit then needs a
+ * new key, see cryptSeal().
+ *
+ * Host programs that build records (the provisioning tool, the simulator
+ * front end) define IDENTITY_HOST before including this header; they get
+ * identity_make() instead of the firmware side.
+ */
+
+/*==== CONSTS ================================================================*/
+
+#define IDENTITY_PAGE_ADDR      0x7C00   // Last 1 KB page of the 32 KB flash
+#define IDENTITY_PAGE_SIZE      1024
+#define IDENTITY_SIZE           8
+
+#define IDENTITY_MAGIC0         'I'
+#define IDENTITY_MAGIC1         'D'
+#define IDENTITY_VERSION        0x01
+
+#define IDENTITY_OFS_ADDRESS    3
+#define IDENTITY_OFS_DEST       4
+#define IDENTITY_OFS_PROFILE    5
+#define IDENTITY_OFS_CHECK      7
+
+#define IDENTITY_KEY_ADDR       (IDENTITY_PAGE_ADDR + IDENTITY_SIZE)
+#define IDENTITY_KEY_SIZE       20
+#define IDENTITY_KEY_MAGIC0     'K'
+#define IDENTITY_KEY_MAGIC1     'Y'
+#define IDENTITY_KEY_OFS_KEY    3
+#define IDENTITY_KEY_OFS_CHECK  19
+
+// Session counter words, after the key record, and the sessions each word
+// counts
+#define IDENTITY_SESSIONS_ADDR  (IDENTITY_PAGE_ADDR + 32)
+#define IDENTITY_SESSION_WORDS  ((IDENTITY_PAGE_ADDR + IDENTITY_PAGE_SIZE - IDENTITY_SESSIONS_ADDR) / 2)
+#define IDENTITY_SESSION_BITS   8
+#define IDENTITY_SESSIONS_MAX   (IDENTITY_SESSION_WORDS * IDENTITY_SESSION_BITS)
+
+// deviceSessionNext() once IDENTITY_SESSIONS_MAX have been used
+#define IDENTITY_SESSION_NONE   0
+
+#if IDENTITY_KEY_ADDR + IDENTITY_KEY_SIZE > IDENTITY_SESSIONS_ADDR
+#error "The session counter overlaps the key record"
+#endif
+
+// Flash write timing, FWT = 21000 * f / 16 MHz, for the 26 MHz HS XOSC and
+// the 13 MHz HS RCOSC
+#define IDENTITY_FWT_XOSC       0x22
+#define IDENTITY_FWT_RCOSC      0x11
+
+// Valid device addresses; 0 and 255 are the broadcast addresses
+#define IDENTITY_ADDRESS_MIN    1
+#define IDENTITY_ADDRESS_MAX    254
+
+// No radio profile in the record
+#define IDENTITY_PROFILE_NONE   0xFF
+
+// The identity record in flash
+#ifndef IDENTITY_HOST
+#ifdef HOST_SIM
+#define IDENTITY_RECORD         sim_flash(IDENTITY_PAGE_ADDR)
+#define IDENTITY_KEY_RECORD     sim_flash(IDENTITY_KEY_ADDR)
+#define IDENTITY_SESSIONS       sim_flash(IDENTITY_SESSIONS_ADDR)
+#else
+#define IDENTITY_RECORD         ((const uint8 __code *)IDENTITY_PAGE_ADDR)
+#define IDENTITY_KEY_RECORD     ((const uint8 __code *)IDENTITY_KEY_ADDR)
+#define IDENTITY_SESSIONS       ((const uint8 __code *)IDENTITY_SESSIONS_ADDR)
+#endif
+#endif
+
+
+/*==== LOCAL VARIABLES =======================================================*/
+
+#ifndef IDENTITY_HOST
+// Identity in use: the provisioned one, else the build defaults
+static uint8 xdata device_address     = DEVICE_NUMBER;
+static uint8 xdata device_destination = DESTINATION_ADDR;
+static uint8 xdata device_profile     = IDENTITY_PROFILE_NONE;
+#endif
+
+#if !defined(IDENTITY_HOST) && defined(RADIO_AES)
+// What a session counter word is programmed with, for the DMA
+static uint8 xdata identity_flash_word[2];
+#endif
+
+
+/*==== FUNCTIONS =============================================================*/
+
+/******************************************************************************
+* @fn  identity_check
+*
+* @brief
+*      Check byte of a record in the identity page, over its first 'len'
+*      bytes. Takes a generic pointer so it works on the record in flash.
+*
+******************************************************************************/
+static inline uint8 identity_check(const uint8 *rec, uint8 len)
+{
+    uint8 sum = 0;
+    uint8 i;
+
+    for (i = 0; i < len; i++)
+        sum += rec[i];
+    return (uint8)~sum;
+}
+
+
+/******************************************************************************
+* @fn  identity_valid
+*
+* @brief
+*      TRUE if 'rec' is a well formed identity record of a known version.
+*
+******************************************************************************/
+static inline uint8 identity_valid(const uint8 *rec)
+{
+    return rec[0] == IDENTITY_MAGIC0 && rec[1] == IDENTITY_MAGIC1 &&
+           rec[2] == IDENTITY_VERSION &&
+           rec[IDENTITY_OFS_ADDRESS] >= IDENTITY_ADDRESS_MIN &&
+           rec[IDENTITY_OFS_ADDRESS] <= IDENTITY_ADDRESS_MAX &&
+           rec[IDENTITY_OFS_CHECK] == identity_check(rec, IDENTITY_OFS_CHECK);
+}
+
+
+/******************************************************************************
+* @fn  identity_key_valid
+*
+* @brief
+*      TRUE if 'rec' is a well formed key record of a known version.
+*
+******************************************************************************/
+static inline uint8 identity_key_valid(const uint8 *rec)
+{
+    return rec[0] == IDENTITY_KEY_MAGIC0 && rec[1] == IDENTITY_KEY_MAGIC1 &&
+           rec[2] == IDENTITY_VERSION &&
+           rec[IDENTITY_KEY_OFS_CHECK] == identity_check(rec, IDENTITY_KEY_OFS_CHECK);
+}
+
+
+#ifdef IDENTITY_HOST
+/******************************************************************************
+* @fn  identity_make
+*
+* @brief
+*      Fill in an identity record (host side: provisioning tool, simulator).
+*
+******************************************************************************/
+static void identity_make(uint8 *rec, uint8 address, uint8 destination, uint8 profile)
+{
+    rec[0] = IDENTITY_MAGIC0;
+    rec[1] = IDENTITY_MAGIC1;
+    rec[2] = IDENTITY_VERSION;
+    rec[IDENTITY_OFS_ADDRESS] = address;
+    rec[IDENTITY_OFS_DEST] = destination;
+    rec[IDENTITY_OFS_PROFILE] = profile;
+    rec[6] = 0xFF;
+    rec[IDENTITY_OFS_CHECK] = identity_check(rec, IDENTITY_OFS_CHECK);
+}
+
+
+/******************************************************************************
+* @fn  identity_key_make
+*
+* @brief
+*      Fill in a key record for a 16 byte AES key (host side).
+*
+******************************************************************************/
+static void identity_key_make(uint8 *rec, const uint8 *key)
+{
+    rec[0] = IDENTITY_KEY_MAGIC0;
+    rec[1] = IDENTITY_KEY_MAGIC1;
+    rec[2] = IDENTITY_VERSION;
+    memcpy(rec + IDENTITY_KEY_OFS_KEY, key, IDENTITY_KEY_OFS_CHECK - IDENTITY_KEY_OFS_KEY);
+    rec[IDENTITY_KEY_OFS_CHECK] = identity_check(rec, IDENTITY_KEY_OFS_CHECK);
+}
+#endif
+
+
+#ifndef IDENTITY_HOST
+/******************************************************************************
+* @fn  deviceIdentityLoad
+*
+* @brief
+*      Read the identity record from flash into device_address,
+*      device_destination and device_profile. Call once at boot, before the
+*      radio is started.
+*
+* @return uint8
+*          TRUE if the device has been provisioned, FALSE if it runs with
+*          the build defaults.
+*
+******************************************************************************/
+uint8 deviceIdentityLoad(void)
+{
+    if (!identity_valid(IDENTITY_RECORD))
+        return FALSE;
+
+    device_address     = IDENTITY_RECORD[IDENTITY_OFS_ADDRESS];
+    device_destination = IDENTITY_RECORD[IDENTITY_OFS_DEST];
+    device_profile     = IDENTITY_RECORD[IDENTITY_OFS_PROFILE];
+    return TRUE;
+}
+#endif
+
+
+#if !defined(IDENTITY_HOST) && defined(RADIO_AES)
+/******************************************************************************
+* @fn  identity_flash_write_word
+*
+* @brief
+*      Program the flash word at 'addr' (even) with 'value', which can only
+*      clear bits. The flash controller takes its data from DMA channel
+*      DMA_CH_FLASH; the CPU waits out the write, some 20 us.
+*
+******************************************************************************/
+static void identity_flash_write_word(uint16 addr, uint16 value)
+{
+    identity_flash_word[0] = (uint8)value;
+    identity_flash_word[1] = (uint8)(value >> 8);
+
+    halDmaConfigure(DMA_CH_FLASH,
+        XDATA_ADDR(identity_flash_word), XDATA_ADDR(&X_FWDATA),
+        DMA_VLEN_LEN(DMA_VLEN_USE_LEN, 2),
+        DMA_WORDSIZE_BYTE | DMA_TMODE_SINGLE | DMA_TRIG_FLASH,
+        DMA_SRCINC_1 | DMA_DESTINC_0 | DMA_IRQMASK_DISABLE | DMA_M8_USE_8_BITS | DMA_PRI_HIGH);
+    DMA_ARM_CHANNEL(DMA_CH_FLASH);
+
+    FWT = (CLKCON & CLKCON_OSC) ? IDENTITY_FWT_RCOSC : IDENTITY_FWT_XOSC;
+    FADDRH = (uint8)(addr >> 9);    // Word address
+    FADDRL = (uint8)(addr >> 1);
+
+    // Running from flash, FCTL.WRITE must be set by an instruction at an
+    // even address
+#if defined (SDCC) || defined (__SDCC)
+    __asm
+    .even
+    orl _FCTL, #0x02
+    nop
+    __endasm;
+#else
+    FCTL |= FCTL_WRITE;
+#endif
+    HAL_WAIT_UNTIL(!(FCTL & FCTL_BUSY));
+}
+
+
+/******************************************************************************
+* @fn  deviceSessionNext
+*
+* @brief
+*      Count a new session in the identity page (RADIO_AES), see the page
+*      layout above. Sessions are numbered from 1 after the page is written.
+*
+* @return uint16
+*          Number of the new session, or IDENTITY_SESSION_NONE once all
+*          IDENTITY_SESSIONS_MAX have been used.
+*
+******************************************************************************/
+uint16 deviceSessionNext(void)
+{
+    uint16 n;
+    uint16 word;
+    uint8  used;
+    uint8  i;
+
+    // The first word with a set bit left among its IDENTITY_SESSION_BITS.
+    // A write cut short may have cleared other bits too; they count as used,
+    // so the count still only goes up.
+    for (n = 0; n < IDENTITY_SESSION_WORDS; n++)
+    {
+        word = IDENTITY_SESSIONS[2 * n] | ((uint16)IDENTITY_SESSIONS[2 * n + 1] << 8);
+        used = 0;
+        for (i = 0; i < 16; i++)
+            if (!(word & (1 << i)))
+                used++;
+        if (used < IDENTITY_SESSION_BITS)
+        {
+            // Clear the lowest bit still set
+            identity_flash_write_word(IDENTITY_SESSIONS_ADDR + 2 * n, word & (word - 1));
+            return n * IDENTITY_SESSION_BITS + used + 1;
+        }
+    }
+    return IDENTITY_SESSION_NONE;
+}
+#endif
+
+
+#endif /* DEVICE_IDENTITY_H */
+
+/*==== END OF FILE ==========================================================*/
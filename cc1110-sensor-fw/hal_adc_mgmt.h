@@ -4,6 +4,10 @@
 /*==== INCLUDES ==============================================================*/
 #include "types.h"
 #include "cc1110.h"
+#include "hal_dma.h"
+#include "hal_power.h"
+#include "sensor_config.h"
+#include "sensor_convert.h"
 //#include "hal_main.h"
 
 /*==== CONSTS ================================================================*/
@@ -38,6 +42,40 @@
 // Bit masks used for ADCCON1 ADC control 1
 #define ADCCON1_ST_START    0x70     // Starting conversion
 #define ADCCON1_ST_NORMAL   0x03     // Normal Operation
+#define ADCCON1_STSEL_FULL  0x10     // STSEL = 01: full speed, no trigger
+
+// Sensor channels converted by halAdcSampleSensors(): AIN0 (PIR), AIN1
+// (thermopile) and AIN6 (thermistor). A sequence runs from AIN0 up to the
+// last channel and skips the pins not enabled as analog inputs in ADCCFG.
+#define ADC_SENSOR_LAST_CH  ADC_AIN6
+#define ADC_SENSOR_CH_BM    (BM(ADC_AIN0) | BM(ADC_AIN1) | BM(ADC_AIN6))
+#define ADC_SENSOR_COUNT    3
+
+// Sensor pins that only ever carry an analog signal. Their digital input
+// buffers stay off (ADCCFG bit set) between conversions and in PM2/PM3 too:
+// a mid-supply level on a live buffer draws current and, on P0_0 to P0_3,
+// sets Port 0 interrupt flags once PICTL.P0IENL is on. With PIR_WAKE the
+// PIR pin is the digital wake input and is left out.
+#ifdef PIR_WAKE
+#define ADC_ANALOG_PINS_BM  (BM(ADC_AIN1) | BM(ADC_AIN6))
+#else
+#define ADC_ANALOG_PINS_BM  ADC_SENSOR_CH_BM
+#endif
+
+// Conversions of each sensor channel per sample (see ADC_OVERSAMPLE_BITS)
+#define ADC_OVERSAMPLES     (1 << (2 * ADC_OVERSAMPLE_BITS))
+#define ADC_BURST_LEN       (ADC_SENSOR_COUNT * ADC_OVERSAMPLES)
+
+// Extra bits of resolution of the thermopile and thermistor readings
+#ifdef ADC_SINGLE_POLLED
+#define ADC_SENSOR_EXTRA_BITS   0
+#else
+#define ADC_SENSOR_EXTRA_BITS   ADC_OVERSAMPLE_BITS
+#endif
+
+#if ADC_OVERSAMPLE_BITS > 3
+#error "ADC_OVERSAMPLE_BITS must be 0 to 3"
+#endif
 
 /*==== TYPES =================================================================*/
 
@@ -88,9 +126,10 @@
 // Expression indicating whether a conversion is finished or not.
 #define ADC_SAMPLE_READY()      (ADCCON1 & 0x80)
 
-// Macro for setting/clearing a channel as input of the ADC
+// Macro for setting/clearing a channel as input of the ADC. The pins in
+// ADC_ANALOG_PINS_BM are never cleared.
 #define ADC_ENABLE_CHANNEL(ch)   ADCCFG |=  (0x01 << ch)
-#define ADC_DISABLE_CHANNEL(ch)  ADCCFG &= ~(0x01 << ch)
+#define ADC_DISABLE_CHANNEL(ch)  ADCCFG &= ~((0x01 << ch) & ~ADC_ANALOG_PINS_BM)
 
 // Macro for getting the ADC results
 #define ADC_GET_VALUE( v )       GET_WORD( ADCH, ADCL, v )
@@ -102,7 +141,7 @@ ADC input: VDD/3 (VDD is the battery voltage) */
 do { \
 	ADCCON2 = 0x3F; \
 	ADCCON1 = 0x73; \
-while(!(ADCCON1 & 0x80)); \
+HAL_WAIT_UNTIL(ADCCON1 & 0x80); \
 	v = ADCL; \
 	v |= (((unsigned int)ADCH) << 8); \
 } while(0)	
@@ -120,7 +159,7 @@ production test and that the offset was found to be 29.75 mV */
 do { \
 	ADCCON2 = 0x3E; \
 	ADCCON1 = 0x73; \
-	while(!(ADCCON1 & 0x80)); \
+	HAL_WAIT_UNTIL(ADCCON1 & 0x80); \
 	v = ADCL; \
 	v |= (((unsigned int)ADCH) << 8); \
 	} while(0)
@@ -131,6 +170,32 @@ do { \
 #define OFFSET (OFFSET_DATASHEET + OFFSET_MEASURED_AT_25_DEGREES_CELCIUS) // 779.75
 #define TEMP_COEFF 2.43
 	
+/*==== LOCAL VARIABLES =======================================================*/
+
+// Set from the ADC ISR when an extra conversion (ADCCON3) has completed
+static volatile uint8 adc_done = FALSE;
+
+// Raw (leftbound) sequence results as written by DMA, channel interleaved
+static int16 xdata adc_burst[ADC_BURST_LEN];
+
+
+/*==== ISR ===================================================================*/
+
+/******************************************************************************
+* @fn  adc_isr
+*
+* @brief
+*      ADC end of (extra) conversion. Only enabled while halAdcConvertIdle()
+*      waits, so halAdcSampleSingle() can keep polling ADCIF.
+*
+******************************************************************************/
+INTERRUPT(adc_isr, ADC_VECTOR)
+{
+    ADCIF = 0;
+    adc_done = TRUE;
+}
+
+
 /*==== FUNCTIONS =============================================================*/
 
 /******************************************************************************
@@ -161,7 +226,7 @@ int16 halAdcSampleSingle(byte reference, byte resolution, uint8 input) {
     ADCIF = 0; // Clear the ADC flag
 	
     ADC_SINGLE_CONVERSION(reference | resolution | input);
-    while(!ADCIF);
+    HAL_WAIT_UNTIL(ADCIF);
     ADC_GET_VALUE( value );
 
     ADC_DISABLE_CHANNEL(input);
@@ -187,8 +252,7 @@ int16 halAdcSampleSingle(byte reference, byte resolution, uint8 input) {
 // (the ADC value is 2s complement)
 // Battery voltage, VDD = adc value * (3.75 / 2047)
 // To avoid using a float, the below function will return the battery voltage * 10
-// Battery voltage * 10 = adc value * (3.75 / 2047) * 10
-#define CONST_BATTERY 0.0183195 // (3.75 / 2047) * 10
+// Battery voltage * 10 = adc value * (3.75 / 2047) * 10, see convert_battery()
 int16 getBatteryVoltage(void) 
 {
 	int16 adcValue;
@@ -196,9 +260,123 @@ int16 getBatteryVoltage(void)
 	SAMPLE_BATTERY_VOLTAGE(adcValue);
 	// Note that the conversion result always resides in MSB section of ADCH:ADCL
 	adcValue >>= 4; // Shift 4 due to 12 bits resolution
-	return CONST_BATTERY * adcValue;
+	return convert_battery(adcValue);
 	//return test;
 }
+
+
+/******************************************************************************
+* @fn  halAdcConvertIdle
+*
+* @brief
+*      Extra (ADCCON3) conversion with the CPU in idle mode until the ADC
+*      interrupt signals the end of conversion.
+*
+* Parameters:
+*
+* @param BYTE settings
+*          Reference, resolution and channel, as for ADC_SINGLE_CONVERSION().
+*
+* @return INT16
+*          The raw conversion result (leftbound ADCH:ADCL)
+*
+******************************************************************************/
+int16 halAdcConvertIdle(byte settings)
+{
+    int16 value;
+
+    adc_done = FALSE;
+    ADCIF = 0;
+    ADCIE = 1;
+
+    ADC_SINGLE_CONVERSION(settings);
+    HAL_IDLE_UNTIL(adc_done);
+
+    ADCIE = 0;
+    ADC_GET_VALUE( value );
+    return value;
+}
+
+
+/******************************************************************************
+* @fn  halAdcSampleSensors
+*
+* @brief
+*      Convert all sensor channels and the battery voltage in one go: a
+*      sequence conversion of AIN0, AIN1 and AIN6 whose results DMA moves into
+*      XRAM, followed by an extra conversion of VDD/3 against the internal
+*      1.25 V reference. The CPU idles during both instead of polling ADCIF.
+*
+*      VDD/3 needs a different reference and resolution than the sequence
+*      (ADCCON2 applies to every channel in it), which is why it is converted
+*      as the extra conversion.
+*
+*      With ADC_OVERSAMPLE_BITS = n the sequence runs back-to-back
+*      ADC_OVERSAMPLES (4^n) times in one DMA burst, and the thermopile and
+*      thermistor are decimated to 10 + n bits: the 4^n samples are summed
+*      and the sum shifted right by n. The PIR keeps the latest sample, as
+*      averaging would smooth out the motion it is meant to see.
+*
+* Parameters:
+*
+* @param int16 xdata *adc
+*          ADC_SENSOR_COUNT results (PIR, thermopile, thermistor), rightbound.
+*          The PIR is 10 bit like halAdcSampleSingle(ADC_REF_AVDD, ADC_10_BIT,
+*          ...), the others 10 + ADC_OVERSAMPLE_BITS bit.
+*
+* @return int16
+*          Battery voltage * 10, as getBatteryVoltage().
+*
+******************************************************************************/
+int16 halAdcSampleSensors(int16 xdata *adc)
+{
+    int16 value;
+    uint8 i;
+#if ADC_OVERSAMPLE_BITS
+    int32 sum;
+    uint8 n;
+#endif
+
+    // One 16 bit word from ADCL:ADCH per conversion in the sequence(s)
+    halDmaConfigure(DMA_CH_ADC,
+        XDATA_ADDR(&X_ADCL), XDATA_ADDR(adc_burst),
+        DMA_VLEN_LEN(DMA_VLEN_USE_LEN, ADC_BURST_LEN),
+        DMA_WORDSIZE_WORD | DMA_TMODE_SINGLE | DMA_TRIG_ADC_CHALL,
+        DMA_SRCINC_0 | DMA_DESTINC_1 | DMA_IRQMASK_ENABLE | DMA_M8_USE_8_BITS | DMA_PRI_NORMAL);
+    DMA_ARM_CHANNEL(DMA_CH_ADC);
+
+    ADCCFG |= ADC_SENSOR_CH_BM;
+    ADC_SEQUENCE_SETUP(ADC_REF_AVDD | ADC_10_BIT | ADC_SENSOR_LAST_CH);
+#if ADC_OVERSAMPLE_BITS
+    // Repeat the sequence at full speed until stopped
+    ADCCON1 = ADCCON1_STSEL_FULL | ADCCON1_ST_NORMAL;
+    HAL_IDLE_UNTIL(DMA_CHANNEL_DONE(DMA_CH_ADC));
+    ADCCON1 = ADCCON1_STSEL | ADCCON1_ST_NORMAL;                // Back to ST triggered
+#else
+    ADCCON1 = ADCCON1_ST | ADCCON1_STSEL | ADCCON1_ST_NORMAL;   // Start sequence now
+    HAL_IDLE_UNTIL(DMA_CHANNEL_DONE(DMA_CH_ADC));
+#endif
+    ADCCFG &= ~(ADC_SENSOR_CH_BM & ~ADC_ANALOG_PINS_BM);
+
+    // Leftbound 10 bit results, see halAdcSampleSingle()
+    adc[0] = adc_burst[ADC_BURST_LEN - ADC_SENSOR_COUNT] >> 6;
+    for (i = 1; i < ADC_SENSOR_COUNT; i++)
+    {
+#if ADC_OVERSAMPLE_BITS
+        sum = 0;
+        for (n = 0; n < ADC_OVERSAMPLES; n++)
+            sum += adc_burst[n * ADC_SENSOR_COUNT + i] >> 6;
+        adc[i] = (int16)(sum >> ADC_OVERSAMPLE_BITS);
+#else
+        adc[i] = adc_burst[i] >> 6;
+#endif
+    }
+
+    // Battery: VDD/3 against 1.25 V at 12 bits, see getBatteryVoltage()
+    value = halAdcConvertIdle(ADC_REF_1_25_V | ADC_12_BIT | ADC_VDD_3);
+    value >>= 4;
+    return convert_battery(value);
+}
 /*
 // Refer to above macro
 float getTemp(void)
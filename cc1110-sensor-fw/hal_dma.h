@@ -0,0 +1,203 @@
+#ifndef HAL_DMA_H
+#define HAL_DMA_H
+
+/*==== INCLUDES ==============================================================*/
+#include "types.h"
+#include "cc1110.h"
+#include "ioCCxx10_bitdef.h"
+
+/*==== CONSTS ================================================================*/
+
+// DMA descriptor field values (ref. CC1110 data sheet, "DMA Controller")
+
+// VLEN - variable length transfer mode
+#define DMA_VLEN_USE_LEN            (0x00 << 5)  // Use LEN for transfer count
+#define DMA_VLEN_FIRST_BYTE_P_1     (0x01 << 5)  // Transfer first byte + 1 bytes
+#define DMA_VLEN_FIRST_BYTE         (0x02 << 5)  // Transfer the number of bytes given by the first byte
+#define DMA_VLEN_FIRST_BYTE_P_2     (0x03 << 5)  // Transfer first byte + 2 bytes
+#define DMA_VLEN_FIRST_BYTE_P_3     (0x04 << 5)  // Transfer first byte + 3 bytes
+
+// WORDSIZE
+#define DMA_WORDSIZE_BYTE           (0x00 << 7)
+#define DMA_WORDSIZE_WORD           (0x01 << 7)
+
+// TMODE - transfer mode
+#define DMA_TMODE_SINGLE            (0x00 << 5)
+#define DMA_TMODE_BLOCK             (0x01 << 5)
+#define DMA_TMODE_SINGLE_REPEATED   (0x02 << 5)
+#define DMA_TMODE_BLOCK_REPEATED    (0x03 << 5)
+
+// TRIG - trigger event
+#define DMA_TRIG_NONE               0
+#define DMA_TRIG_PREV               1
+#define DMA_TRIG_T1_CH0             2
+#define DMA_TRIG_T1_CH1             3
+#define DMA_TRIG_T1_CH2             4
+#define DMA_TRIG_T2_OVFL            6
+#define DMA_TRIG_T3_CH0             7
+#define DMA_TRIG_T3_CH1             8
+#define DMA_TRIG_T4_CH0             9
+#define DMA_TRIG_T4_CH1             10
+#define DMA_TRIG_FLASH              18
+#define DMA_TRIG_RADIO              19
+#define DMA_TRIG_ADC_CHALL          20
+#define DMA_TRIG_ADC_CH0            21
+#define DMA_TRIG_ENC_DW             29
+#define DMA_TRIG_ENC_UP             30
+
+// SRCINC / DESTINC - address increment after each transfer
+#define DMA_SRCINC_0                (0x00 << 6)
+#define DMA_SRCINC_1                (0x01 << 6)
+#define DMA_SRCINC_2                (0x02 << 6)
+#define DMA_SRCINC_M1               (0x03 << 6)
+#define DMA_DESTINC_0               (0x00 << 4)
+#define DMA_DESTINC_1               (0x01 << 4)
+#define DMA_DESTINC_2               (0x02 << 4)
+#define DMA_DESTINC_M1              (0x03 << 4)
+
+// IRQMASK / M8 / PRIORITY
+#define DMA_IRQMASK_DISABLE         (0x00 << 3)
+#define DMA_IRQMASK_ENABLE          (0x01 << 3)
+#define DMA_M8_USE_8_BITS           (0x00 << 2)
+#define DMA_M8_USE_7_BITS           (0x01 << 2)
+#define DMA_PRI_LOW                 (0x00)
+#define DMA_PRI_NORMAL              (0x01)
+#define DMA_PRI_HIGH                (0x02)
+
+// Channel allocation. Channel 0 is reserved for the PM2 errata work-around
+// in main(); channels 1-4 share the descriptor array below. The AES output
+// shares the ADC's channel, which is set up again for every conversion run,
+// and flash writes the AES input's, which is idle when a session starts.
+#define DMA_CH_RADIO                1
+#define DMA_CH_ADC                  2
+#define DMA_CH_RADIO_RX             3    // ACK reception (RADIO_ACK)
+#define DMA_CH_ENC_IN               4    // AES coprocessor input (RADIO_AES)
+#define DMA_CH_ENC_OUT              2    // AES coprocessor output (RADIO_AES)
+#define DMA_CH_FLASH                4    // Session counter (RADIO_AES)
+
+
+/*==== TYPES =================================================================*/
+
+// DMA descriptor as read by the DMA controller (8 bytes, big-endian addresses)
+typedef struct {
+    uint8 srcAddrH;
+    uint8 srcAddrL;
+    uint8 destAddrH;
+    uint8 destAddrL;
+    uint8 vlenLenH;      // VLEN[7:5], LEN[12:8]
+    uint8 lenL;          // LEN[7:0]
+    uint8 wsTmodeTrig;   // WORDSIZE[7], TMODE[6:5], TRIG[4:0]
+    uint8 incIrqPrio;    // SRCINC[7:6], DESTINC[5:4], IRQMASK[3], M8[2], PRIORITY[1:0]
+} DMA_DESC;
+
+
+/*==== MACROS=================================================================*/
+
+// 16 bit XDATA address of an object, as used in DMA descriptors.
+#ifndef XDATA_ADDR
+#define XDATA_ADDR(p)                ((uint16)(p))
+#endif
+
+// VLEN mode and transfer count as passed to halDmaConfigure(). VLEN goes in
+// the high byte, next to LEN[12:8], not in the same byte as LEN[7:0].
+#define DMA_VLEN_LEN(vlen, len)      ((uint16)((vlen) << 8) | (len))
+
+// Arm/abort a channel and check for completion
+#define DMA_ARM_CHANNEL(ch)          do { DMAARM = (0x01 << (ch)); } while (0)
+#define DMA_ABORT_CHANNEL(ch)        do { DMAARM = DMAARM_ABORT | (0x01 << (ch)); } while (0)
+#define DMA_CHANNEL_DONE(ch)         (dmaDone & (0x01 << (ch)))
+
+
+/*==== LOCAL VARIABLES =======================================================*/
+
+// Descriptors for channels 1-4 (must be contiguous, pointed to by DMA1CFG)
+static DMA_DESC xdata dmaCh1234[4];
+
+// Channel completion bits, set from the DMA ISR
+static volatile uint8 dmaDone = 0;
+
+
+/*==== ISR ===================================================================*/
+
+/******************************************************************************
+* @fn  dma_isr
+*
+* @brief
+*      DMA transfer complete. Records the finished channels in 'dmaDone' so
+*      the code waiting on them (usually in idle mode) can carry on.
+*
+******************************************************************************/
+INTERRUPT(dma_isr, DMA_VECTOR)
+{
+    uint8 flags;
+
+    DMAIF = 0;
+    flags = DMAIRQ;
+    DMAIRQ = ~flags;     // Writing 1 has no effect, only clear what we saw
+    dmaDone |= flags;
+}
+
+
+/*==== FUNCTIONS =============================================================*/
+
+/******************************************************************************
+* @fn  halDmaInit
+*
+* @brief
+*      Point DMA channels 1-4 at their descriptor array and enable the DMA
+*      interrupt. Channel 0 is left alone.
+*
+******************************************************************************/
+void halDmaInit(void)
+{
+    DMA1CFGH = (uint8)(XDATA_ADDR(dmaCh1234) >> 8);
+    DMA1CFGL = (uint8)XDATA_ADDR(dmaCh1234);
+
+    DMAIF = 0;
+    DMAIRQ = 0;
+    DMAIE = 1;
+}
+
+
+/******************************************************************************
+* @fn  halDmaConfigure
+*
+* @brief
+*      Fill in the descriptor of DMA channel 1-4. The channel is not armed.
+*
+* Parameters:
+*
+* @param uint8 ch
+*          Channel number (1-4).
+*        uint16 src, dest
+*          XDATA addresses, see XDATA_ADDR().
+*        uint16 vlenLen
+*          DMA_VLEN_* bits in the high byte plus the 13 bit transfer count,
+*          see DMA_VLEN_LEN().
+*        uint8 wsTmodeTrig
+*          DMA_WORDSIZE_*, DMA_TMODE_* and DMA_TRIG_* bits.
+*        uint8 incIrqPrio
+*          DMA_SRCINC_*, DMA_DESTINC_*, DMA_IRQMASK_*, DMA_M8_* and DMA_PRI_* bits.
+*
+******************************************************************************/
+void halDmaConfigure(uint8 ch, uint16 src, uint16 dest, uint16 vlenLen,
+                     uint8 wsTmodeTrig, uint8 incIrqPrio)
+{
+    DMA_DESC xdata *desc = &dmaCh1234[ch - 1];
+
+    desc->srcAddrH    = (uint8)(src >> 8);
+    desc->srcAddrL    = (uint8)src;
+    desc->destAddrH   = (uint8)(dest >> 8);
+    desc->destAddrL   = (uint8)dest;
+    desc->vlenLenH    = (uint8)(vlenLen >> 8);
+    desc->lenL        = (uint8)vlenLen;
+    desc->wsTmodeTrig = wsTmodeTrig;
+    desc->incIrqPrio  = incIrqPrio;
+
+    dmaDone &= ~(0x01 << ch);
+}
+
+
+#endif /* HAL_DMA_H */
+
+/*==== END OF FILE ==========================================================*/
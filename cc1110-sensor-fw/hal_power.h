@@ -0,0 +1,155 @@
+#ifndef HAL_POWER_H
+#define HAL_POWER_H
+
+/*==== INCLUDES ==============================================================*/
+#include "cc1110.h"
+#include "ioCCxx10_bitdef.h"
+#include "hal_timer.h"
+
+/*==== CONSTS ================================================================*/
+
+// Bit masks to check SLEEP register
+#define SLEEP_XOSC_STB_BM   0x40  // bit mask, check the stability of XOSC
+#define SLEEP_HFRC_STB_BM   0x20  // bit maks, check the stability of the High-frequency RC oscillator
+#define SLEEP_OSC_PD_BM     0x04  // bit mask, power down system clock oscillator(s)
+
+#define POWER_MODE_0  0x00  // Clock oscillators on, voltage regulator on
+#define POWER_MODE_1  0x01  // 32.768 KHz oscillator on, voltage regulator on
+#define POWER_MODE_2  0x02  // 32.768 KHz oscillator on, voltage regulator off
+#define POWER_MODE_3  0x03  // All clock oscillators off, voltage regulator off
+
+// SLEEP.XOSC_S is tested this often while the CPU idles through the HS XOSC
+// start-up (a few hundred us from power-up)
+#define HAL_XOSC_POLL_US    20
+
+
+/*==== MACROS=================================================================*/
+
+// Macro for checking status of the high frequency RC oscillator.
+#define IS_HFRC_STABLE()    (SLEEP & SLEEP_HFRC_STB_BM)
+
+// Macro for checking status of the crystal oscillator
+#define IS_XOSC_STABLE()    (SLEEP & SLEEP_XOSC_STB_BM)
+
+
+#ifndef BENCH
+
+// Enter the mode selected by SLEEP.MODE: idle (PM0) or PM1-3
+#define HAL_CPU_IDLE()            do { PCON |= PCON_IDLE; } while (0)
+
+
+// Busy-wait until a hardware status condition is true
+#define HAL_WAIT_UNTIL(cond)      do { } while (!(cond))
+
+
+// Put the CPU in idle mode (PM0 with PCON.IDLE, peripherals keep running)
+// until 'cond' is true. Any enabled interrupt wakes the CPU, so 'cond' is
+// normally a flag set from an ISR.
+//
+// Interrupts are disabled while 'cond' is tested, so an ISR firing between
+// the test and the idle entry cannot be missed: a write to IEN0 (EA = 1)
+// holds off interrupts for one more instruction, which is the PCON write.
+// SLEEP.MODE must be PM0 here, otherwise PCON.IDLE enters a power mode.
+#define HAL_IDLE_UNTIL(cond)      \
+  do {                            \
+    EA = 0;                       \
+    while (!(cond)) {             \
+      EA = 1;                     \
+      HAL_CPU_IDLE();             \
+      EA = 0;                     \
+    }                             \
+    EA = 1;                       \
+  } while (0)
+
+#else
+
+// BENCH builds run on SDCC's 8051 simulator (see bench/), where no CC1110
+// status bit ever changes and no interrupt ever comes. There the CPU never
+// idles and every wait tests its condition once, so the cycle counts are the
+// CPU's own work; the time spent waiting on the hardware is 'make sim's job.
+#define HAL_CPU_IDLE()            do { } while (0)
+#define HAL_WAIT_UNTIL(cond)      do { (void)(cond); } while (0)
+#define HAL_IDLE_UNTIL(cond)      HAL_WAIT_UNTIL(cond)
+
+#endif /* BENCH */
+
+
+// Power the HS XOSC up/down while running from the HS RCOSC, without
+// switching to it. SLEEP.OSC_PD only affects the oscillator that is not the
+// system clock source, so the crystal can start up while the CPU keeps working
+// and halClockSwitchToXosc() then only waits for what is left of its start-up.
+#define HAL_XOSC_POWER_UP()       do { SLEEP &= ~SLEEP_OSC_PD; } while (0)
+#define HAL_XOSC_POWER_DOWN()     do { SLEEP |= SLEEP_OSC_PD; } while (0)
+
+
+/*==== FUNCTIONS =============================================================*/
+
+/******************************************************************************
+* @fn  halClockSwitchToXosc
+*
+* @brief
+*      High Speed Crystal Oscillator (HS XOSC) @ 26Mhz           (clk_xosc.c)
+*
+*      > Clock must be 26Mhz to be able to use radio
+*      > Select HS XOSC as system clock source and set the clockspeed to 26 Mhz.
+*        Once the clock source change has been initiated, the clock source should
+*        not be changed/updated again until the current clock change has finished.
+*
+******************************************************************************/
+void halClockSwitchToXosc(void)
+{
+    // Set the system clock source to HS XOSC and max CPU speed,
+    // ref. [clk]=>[clk_xosc.c]
+    SLEEP &= ~SLEEP_OSC_PD; // Power up unused oscillator (HS XOSC).
+    // Wait until the HS XOSC is stable, CPU idle for what is left of its
+    // start-up (none if HAL_XOSC_POWER_UP() started it early enough)
+    if (!(SLEEP & SLEEP_XOSC_S)) // <<--- XOSC aka 'HS XOSC'!!
+        HAL_IDLE_POLL(SLEEP & SLEEP_XOSC_S, HAL_XOSC_POLL_US);
+    CLKCON = (CLKCON & ~(CLKCON_CLKSPD | CLKCON_OSC)) | CLKSPD_DIV_1; // Change the system clock source to HS XOSC and set the clock speed to 26 MHz.
+    HAL_WAIT_UNTIL(!(CLKCON & CLKCON_OSC)); // Wait until system clock source has changed to HS XOSC (CLKCON.OSC = 0).
+
+    HAL_WAIT_UNTIL(IS_XOSC_STABLE());
+}
+
+
+/******************************************************************************
+* @fn  halClockSwitchToRcosc
+*
+* @brief
+*      High speed RC oscillator (HS RCOSC) @ XX Mhz
+*
+*      > Need to have this active before we can setup the power mode.
+*      Switches back from the HS XOSC and powers the crystal down.
+*
+******************************************************************************/
+void halClockSwitchToRcosc(void)
+{
+    // Power down the HS RCOSC, since it is not beeing used.
+    // Note that the HS RCOSC should not be powered down before the applied
+    // system clock source is stable (SLEEP.XOSC_STB = 1).
+    SLEEP |= SLEEP_OSC_PD;
+
+    // Switch system clock source to HS RCOSC and max CPU speed:
+    // Note that this is critical for Power Mode 2. After reset or
+    // exiting Power Mode 2 the system clock source is HS RCOSC,
+    // but to emphasize the requirement we choose to be explicit here.
+    SLEEP &= ~SLEEP_OSC_PD;
+    HAL_WAIT_UNTIL(SLEEP & SLEEP_HFRC_S); // Wait until the HS RCOSC  is stable. // <<--- RCOSC aka 'HFRC'!!
+
+    // change system clock source to HS RCOSC and set max CPU clock speed (CLKCON.CLKSPD = 1)
+    CLKCON = (CLKCON & ~CLKCON_CLKSPD) | CLKCON_OSC | CLKCON_CLKSPD0;
+
+    // Wait until system clock source has actually changed (CLKCON.OSC = 1)
+    HAL_WAIT_UNTIL(CLKCON & CLKCON_OSC);
+
+    // Check stability
+    HAL_WAIT_UNTIL(IS_HFRC_STABLE());
+
+    // Power down [HS XOSC] (SLEEP.OSC_PD = 1)
+    SLEEP |= SLEEP_OSC_PD;
+}
+
+
+#endif /* HAL_POWER_H */
+
+/*==== END OF FILE ==========================================================*/
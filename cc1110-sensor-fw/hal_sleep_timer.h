@@ -0,0 +1,372 @@
+#ifndef HAL_SLEEP_TIMER_H
+#define HAL_SLEEP_TIMER_H
+
+/*==== INCLUDES ==============================================================*/
+#include "types.h"
+#include "cc1110.h"
+#include "ioCCxx10_bitdef.h"
+#include "sensor_config.h"
+
+/*==== CONSTS ================================================================*/
+
+// The sleep timer counts the 32.768 kHz clock, prescaled by 2^(5*WOR_RES):
+//
+//   t_EVENT0 = EVENT0 * 2^(5*WOR_RES) / 32768 s
+//
+//   WOR_RES  tick         max EVENT0 period
+//   0        30.5 us      2 s
+//   1        0.977 ms     64 s
+//   2        31.25 ms     34 min
+//   3        1 s          18.2 h
+//
+// The finest resolution that can hold the interval is used, which keeps the
+// rounding error (and so the wake-up jitter) at one tick of that resolution.
+// WOR_RES stops at 1 (SLEEP_TIMER_RES_MAX): the PM2 entry sequence waits for
+// WORTIME0 to change with the CPU running, which takes up to one tick, so a
+// coarser tick would cost up to 31 ms or 1 s of active time on every wake.
+// Longer intervals are made of several timer wakes of at most 64 s.
+#define SLEEP_TIMER_EVENT0_MAX      0xFFFFUL
+#define SLEEP_TIMER_RES_MAX         WORCTRL_WOR_RES_32
+
+// Intervals up to this many milliseconds are converted in 32 bit arithmetic
+// without overflow (ms * 4096 < 2^32); longer ones are handled in seconds.
+#define SLEEP_TIMER_MS_LIMIT        1048575UL
+
+// SLEEP_JITTER_MS in 32.768 kHz clock periods
+#define SLEEP_JITTER_TICKS          ((SLEEP_JITTER_MS << 12) / 125)
+
+
+/*==== LOCAL VARIABLES =======================================================*/
+
+// Active sleep timer setting, loaded into WORCTRL/WOREVT before each PM2 entry
+static uint8  xdata sleep_wor_res    = WORCTRL_WOR_RES_1;
+static uint16 xdata sleep_event0     = 0xEEEE;
+
+#if SLEEP_JITTER_MS
+// Jitter in EVENT0 ticks, and EVENT0 for the next sleep (sleepTimerJitter())
+static uint16 xdata sleep_jitter     = 0;
+static uint16 xdata sleep_event0_next = 0xEEEE;
+#define SLEEP_EVENT0                 sleep_event0_next
+#else
+#define SLEEP_EVENT0                 sleep_event0
+#endif
+
+// Intervals longer than one EVENT0 period are split into several timer wakes
+static uint16 xdata sleep_wakes      = 1;    // Timer wakes per interval
+static uint16 xdata sleep_wakes_left = 0;    // Timer wakes left in this interval
+
+// Sleep timer switched off (interval 0): wake-up on external events only, PM3
+static uint8 xdata sleep_timer_off   = FALSE;
+
+// Set from the ISR; TRUE at boot so the first pass through the loop reports
+static volatile uint8 sleep_timer_fired = TRUE;
+
+
+/*==== MACROS=================================================================*/
+
+// Load the active setting into the sleep timer. EVENT0 must be written right
+// after aligning with a positive 32 kHz clock edge in the PM2 entry sequence.
+#define SLEEP_TIMER_LOAD_RES() \
+  do { \
+    WORCTRL = (WORCTRL & ~WORCTRL_WOR_RES) | sleep_wor_res; \
+  } while (0)
+
+#define SLEEP_TIMER_LOAD_EVENT0() \
+  do { \
+    WOREVT1 = (uint8)(SLEEP_EVENT0 >> 8); \
+    WOREVT0 = (uint8)SLEEP_EVENT0; \
+  } while (0)
+
+
+/*==== ISR ===================================================================*/
+
+/***********************************************************************************
+* @fn          sleep_timer_isr
+*
+* @brief       Sleep Timer Interrupt Service Routine, which executes when
+*              the Sleep Timer expires. Note that the [SLEEP.MODE] bits must
+*              be cleared inside this ISR in order to prevent unintentional
+*              Power Mode 2 entry.
+*/
+INTERRUPT(sleep_timer_isr, ST_VECTOR) // use compiler.h macro
+//void sleep_timer_isr(void) interrupt ST_VECTOR
+{
+
+    // Clear Sleep Timer CPU interrupt flag (IRCON.STIF = 0)
+    STIF = 0;
+
+    // Clear Sleep Timer Module Interrupt Flag (WORIRQ.EVENT0_FLAG = 0)
+    WORIRQ &= ~WORIRQ_EVENT0_FLAG;
+
+    // Clear the [SLEEP.MODE] bits, because an interrupt can also occur
+    // before the SoC has actually entered Power Mode 2.
+	  // Note: Not required when resuming from PM0; Clear SLEEP.MODE[1:0]
+    SLEEP &= ~SLEEP_MODE;
+
+    sleep_timer_fired = TRUE;
+}
+
+
+/*==== FUNCTIONS =============================================================*/
+
+/***********************************************************************************
+* @fn          setup_sleep_interrupt
+*
+* @brief       Function which sets up the Sleep Timer Interrupt
+*              for Power Mode 2 usage.
+*/
+
+void setup_sleep_interrupt(void)
+{
+    // Clear Sleep Timer CPU Interrupt flag (IRCON.STIF = 0)
+    STIF = 0;
+
+    // Clear Sleep Timer Module Interrupt Flag (WORIRQ.EVENT0_FLAG = 0)
+    WORIRQ &= ~WORIRQ_EVENT0_FLAG;
+
+    // Enable Sleep Timer Module Interrupt (WORIRQ.EVENT0_MASK = 1)
+    WORIRQ |= WORIRQ_EVENT0_MASK;
+
+    // Enable Sleep Timer CPU Interrupt (IEN0.STIE = 1)
+    STIE = 1;
+
+    // Enable Global Interrupt (IEN0.EA = 1)
+    EA = 1;
+
+}
+
+
+/******************************************************************************
+* @fn  sleepTimerSetTicks
+*
+* @brief
+*      Pick the finest WOR_RES that can hold the given number of 32.768 kHz
+*      clock periods in EVENT0 and make it the active setting. Past the
+*      SLEEP_TIMER_RES_MAX limit each wake is split into several equal ones.
+*
+* Parameters:
+*
+* @param uint32 ticks
+*          Interval in 32.768 kHz clock periods.
+*        uint16 wakes
+*          Number of timer wakes per interval.
+*
+******************************************************************************/
+void sleepTimerSetTicks(uint32 ticks, uint16 wakes)
+{
+    uint8  res   = WORCTRL_WOR_RES_1;
+    uint8  shift = 0;
+    uint32 event0;
+    uint32 split;
+#if SLEEP_JITTER_MS
+    uint32 jitter;
+#endif
+
+    for (;;)
+    {
+        // Round to the nearest tick of this resolution
+        event0 = shift ? (ticks + (1UL << (shift - 1))) >> shift : ticks;
+        if (event0 <= SLEEP_TIMER_EVENT0_MAX || res == SLEEP_TIMER_RES_MAX)
+            break;
+        res++;
+        shift += 5;
+    }
+
+    if (event0 > SLEEP_TIMER_EVENT0_MAX)
+    {
+        split = event0 / SLEEP_TIMER_EVENT0_MAX + 1;
+        if (split * wakes > 0xFFFF)
+            split = 0xFFFF / wakes;
+        event0 = (event0 + (split >> 1)) / split;
+        wakes *= (uint16)split;
+        if (event0 > SLEEP_TIMER_EVENT0_MAX)
+            event0 = SLEEP_TIMER_EVENT0_MAX;
+    }
+    if (event0 == 0)
+        event0 = 1;
+
+    sleep_wor_res    = res;
+    sleep_event0     = (uint16)event0;
+#if SLEEP_JITTER_MS
+    // At this resolution, and never moving EVENT0 below 1 or past its maximum
+    jitter = shift ? SLEEP_JITTER_TICKS >> shift : SLEEP_JITTER_TICKS;
+    if (jitter > event0 - 1)
+        jitter = event0 - 1;
+    if (jitter > 2 * (SLEEP_TIMER_EVENT0_MAX - event0))
+        jitter = 2 * (SLEEP_TIMER_EVENT0_MAX - event0);
+    sleep_jitter     = (uint16)jitter;
+    sleep_event0_next = (uint16)event0;
+#endif
+    sleep_wakes      = wakes;
+    sleep_wakes_left = 0;
+    sleep_timer_off  = FALSE;
+    STIE = 1;
+}
+
+
+/******************************************************************************
+* @fn  sleepTimerOff
+*
+* @brief
+*      Stop waking up on the sleep timer. The device then sleeps in PM3 and
+*      only wakes on external interrupts (e.g. the PIR, see PIR_WAKE).
+*
+******************************************************************************/
+void sleepTimerOff(void)
+{
+    STIE = 0;
+    sleep_timer_off = TRUE;
+}
+
+
+/******************************************************************************
+* @fn  sleepTimerSetSeconds
+*
+* @brief
+*      Set the interval between reports in seconds. Takes effect at the next
+*      PM2 entry, so it can be called at any time while awake. Intervals longer
+*      than 64 s are made of several equal timer wakes (sleepTimerSetTicks()).
+*      An interval of 0 switches the timer off (see sleepTimerOff()).
+*
+******************************************************************************/
+void sleepTimerSetSeconds(uint32 seconds)
+{
+    uint32 wakes;
+
+    if (seconds == 0)
+    {
+        sleepTimerOff();
+        return;
+    }
+
+    if (seconds <= SLEEP_TIMER_MS_LIMIT / 1000)
+    {
+        sleepTimerSetTicks(seconds << 15, 1);
+        return;
+    }
+
+    // Whole seconds per wake, split further by sleepTimerSetTicks()
+    wakes = seconds / SLEEP_TIMER_EVENT0_MAX + 1;
+    if (wakes > 0xFFFF)
+        wakes = 0xFFFF;
+    sleepTimerSetTicks((seconds / wakes) << 15, (uint16)wakes);
+}
+
+
+/******************************************************************************
+* @fn  sleepTimerSetMs
+*
+* @brief
+*      Set the interval between reports in milliseconds. See sleepTimerSetSeconds().
+*
+******************************************************************************/
+void sleepTimerSetMs(uint32 ms)
+{
+    if (ms == 0)
+    {
+        sleepTimerOff();
+        return;
+    }
+
+    if (ms > SLEEP_TIMER_MS_LIMIT)
+    {
+        sleepTimerSetSeconds(ms / 1000);
+        return;
+    }
+
+    // ms * 32768 / 1000 == ms * 4096 / 125
+    sleepTimerSetTicks((ms << 12) / 125, 1);
+}
+
+
+#if SLEEP_JITTER_MS
+/******************************************************************************
+* @fn  sleepTimerJitter
+*
+* @brief
+*      Pick the EVENT0 for the next sleep: the interval's EVENT0 moved by a
+*      random -sleep_jitter / 2 to +sleep_jitter / 2 ticks (SLEEP_JITTER_MS).
+*      Call while awake, before the PM2 entry sequence, which has no time
+*      for it between the 32 kHz edge and SLEEP_TIMER_LOAD_EVENT0().
+*
+******************************************************************************/
+void sleepTimerJitter(void)
+{
+    uint16 rnd;
+
+    // Clock the random number generator's LFSR once
+    ADCCON1 = (ADCCON1 & ~ADCCON1_RCTRL) | ADCCON1_RCTRL_LFSR13;
+    rnd = ((uint16)RNDH << 8) | RNDL;
+
+    sleep_event0_next = sleep_event0 - (sleep_jitter >> 1) +
+                        rnd % (uint16)(sleep_jitter + 1);
+}
+#endif
+
+
+/******************************************************************************
+* @fn  sleepTimerWakeTaken
+*
+* @brief
+*      Check and clear the sleep timer wake-up flag, to tell timer wake-ups
+*      from wake-ups by other interrupts.
+*
+* @return uint8
+*          TRUE if the sleep timer fired since the last call.
+*
+******************************************************************************/
+uint8 sleepTimerWakeTaken(void)
+{
+    uint8 fired;
+
+    EA = 0;
+    fired = sleep_timer_fired;
+    sleep_timer_fired = FALSE;
+    EA = 1;
+
+    return fired;
+}
+
+
+/******************************************************************************
+* @fn  sleepTimerIntervalDue
+*
+* @brief
+*      Call once per sleep timer wake. Counts the timer wakes of a multi-wake
+*      interval.
+*
+* @return uint8
+*          TRUE when the whole interval has elapsed and a report is due, FALSE
+*          when the device should go straight back to sleep.
+*
+******************************************************************************/
+uint8 sleepTimerIntervalDue(void)
+{
+    if (sleep_wakes_left)
+        sleep_wakes_left--;
+
+    if (sleep_wakes_left)
+        return FALSE;
+
+    sleep_wakes_left = sleep_wakes;
+    return TRUE;
+}
+
+
+/******************************************************************************
+* @fn  sleepTimerPowerMode
+*
+* @brief
+*      Power mode to enter between wake-ups: PM2 while the sleep timer is
+*      running, PM3 (all oscillators off) when it has been switched off.
+*
+******************************************************************************/
+uint8 sleepTimerPowerMode(void)
+{
+    return sleep_timer_off ? SLEEP_MODE_PM3 : SLEEP_MODE_PM2;
+}
+
+
+#endif /* HAL_SLEEP_TIMER_H */
+
+/*==== END OF FILE ==========================================================*/
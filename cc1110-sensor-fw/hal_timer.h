@@ -0,0 +1,128 @@
+#ifndef HAL_TIMER_H
+#define HAL_TIMER_H
+
+/*==== INCLUDES ==============================================================*/
+#include "types.h"
+#include "cc1110.h"
+#include "ioCCxx10_bitdef.h"
+
+/*
+ * Timed waits. Timer 3 ticks wake the CPU from idle mode, so every wait on
+ * the wake-up path idles rather than spins: for a time (HAL_TIMER_IDLE), for
+ * a status bit with no interrupt of its own, tested on every tick
+ * (HAL_IDLE_POLL), or for an ISR's flag with a timeout (halTimerStart() and
+ * HAL_IDLE_UNTIL on both). One wait at a time.
+ */
+
+/*==== CONSTS ================================================================*/
+
+// Timer 3 counts at 13 MHz / 128 while halTimerStart() runs it
+// (CLKCON.TICKSPD = 13 MHz, the most the HS RCOSC allows, and the same from
+// the HS XOSC), one count every 9.85 us. A tick is 'period' counts.
+#define HAL_TIMER_TICKSPD       TICKSPD_DIV_2
+
+// Tick periods: 1.004 ms, and the nearest to 'us' microseconds (10 to 2500)
+#define HAL_TIMER_MS            102
+#define HAL_TIMER_US(us)        ((uint8)(((us) * 13UL + 64) / 128))
+
+
+/*==== MACROS ================================================================*/
+
+// Idle for 'ticks' ticks of 'period' counts (HAL_TIMER_MS, HAL_TIMER_US(us))
+#define HAL_TIMER_IDLE(period, ticks)           \
+  do {                                          \
+    halTimerStart(period);                      \
+    HAL_IDLE_UNTIL(halTimerTicks >= (ticks));   \
+    halTimerStop();                             \
+  } while (0)
+
+// Idle until 'cond', a hardware status with no interrupt of its own, is
+// true. It is tested every 'us' microseconds (10 to 2500), which bounds the
+// time lost after it comes true.
+#define HAL_IDLE_POLL(cond, us)                 \
+  do {                                          \
+    halTimerStart(HAL_TIMER_US(us));            \
+    HAL_IDLE_UNTIL(cond);                       \
+    halTimerStop();                             \
+  } while (0)
+
+
+/*==== LOCAL VARIABLES =======================================================*/
+
+// Ticks since halTimerStart(), counted by the Timer 3 ISR
+static volatile uint16 halTimerTicks;
+
+// CLKCON.TICKSPD to restore in halTimerStop()
+static uint8 halTimerTickspd;
+
+
+/*==== ISR ===================================================================*/
+
+/******************************************************************************
+* @fn  hal_timer_t3_isr
+*
+* @brief
+*      Timer 3 overflow, one tick. Only enabled between halTimerStart() and
+*      halTimerStop().
+*
+******************************************************************************/
+INTERRUPT(hal_timer_t3_isr, T3_VECTOR)
+{
+    // Module flag first, then the CPU flag
+    T3OVFIF = 0;
+    T3IF = 0;
+    halTimerTicks++;
+}
+
+
+/*==== FUNCTIONS =============================================================*/
+
+/******************************************************************************
+* @fn  halTimerStart
+*
+* @brief
+*      Start counting ticks in halTimerTicks, the first one 'period' counts
+*      from now. Wait for them with HAL_IDLE_UNTIL(halTimerTicks >= n): the
+*      tick interrupt wakes the CPU from idle mode.
+*
+* Parameters:
+*
+* @param uint8 period
+*          Timer 3 counts per tick, HAL_TIMER_MS or HAL_TIMER_US(us).
+*
+******************************************************************************/
+void halTimerStart(uint8 period)
+{
+    halTimerTickspd = CLKCON & CLKCON_TICKSPD;
+    CLKCON = (CLKCON & ~CLKCON_TICKSPD) | HAL_TIMER_TICKSPD;
+
+    T3CC0 = period - 1;
+    T3CTL = T3CTL_DIV_128 | T3CTL_MODE_MODULO | T3CTL_CLR;
+    halTimerTicks = 0;
+    T3OVFIF = 0;
+    T3IF = 0;
+    T3IE = 1;
+    T3CTL = T3CTL_DIV_128 | T3CTL_START | T3CTL_OVFIM | T3CTL_MODE_MODULO | T3CTL_CLR;
+}
+
+
+/******************************************************************************
+* @fn  halTimerStop
+*
+* @brief
+*      Stop Timer 3 and its interrupt, and restore CLKCON.TICKSPD.
+*
+******************************************************************************/
+void halTimerStop(void)
+{
+    T3CTL = 0;
+    T3IE = 0;
+    T3OVFIF = 0;
+    T3IF = 0;
+    CLKCON = (CLKCON & ~CLKCON_TICKSPD) | halTimerTickspd;
+}
+
+
+#endif /* HAL_TIMER_H */
+
+/*==== END OF FILE ==========================================================*/
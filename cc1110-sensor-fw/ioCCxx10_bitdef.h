@@ -249,7 +249,7 @@
 
 
 
-// P0INP (0x8F) - Port 0 Input Mode (bit 0 & 1 not used)
+// P0INP (0x8F) - Port 0 Input Mode (1: tri-state, 0: pull-up/down per P2INP.PDUP0)
 
 // P1INP (0xF6) - Port 1 Input Mode (bit 0 & 1 not used)
 
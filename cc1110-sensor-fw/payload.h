@@ -0,0 +1,215 @@
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+/*==== INCLUDES ==============================================================*/
+#include "types.h"
+#include "sensor_config.h"
+#include <stdio.h>
+#include <string.h>
+
+/*==== CONSTS ================================================================*/
+
+/*
+ * Binary payload layout (version 1). All multi-byte fields are little-endian.
+ *
+ *  Offset  Size  Field
+ *  0       1     Payload version (PAYLOAD_VERSION)
+ *  1       1     Flags (PAYLOAD_FLAG_*)
+ *  2       2     Report sequence number
+ *  4       1     Number of records that follow
+ *  5       8*n   Records:
+ *                  +0  int16  Battery voltage * 10
+ *                  +2  int16  AIN0 - PIR
+ *                  +4  int16  AIN1 - Thermopile
+ *                  +6  int16  AIN6 - Thermistor
+ *
+ * AIN0 is a 10 bit reading. AIN1 and AIN6 have 10 + n bits, n being given by
+ * PAYLOAD_FLAG_OVERSAMPLE (see ADC_OVERSAMPLE_BITS).
+ *
+ * With PAYLOAD_FLAG_PIR_DSP (PIR_DSP builds) the AIN0 field is the output of
+ * the motion detector instead: PAYLOAD_PIR_MOTION while motion is seen, and
+ * in the low bits the number of motion events since power-on, modulo
+ * PAYLOAD_PIR_EVENTS_MASK + 1.
+ */
+#define PAYLOAD_VERSION         0x01
+#define PAYLOAD_HEADER_SIZE     5
+#define PAYLOAD_RECORD_SIZE     8
+#define PAYLOAD_ADC_CHANNELS    3
+
+// Flags
+#define PAYLOAD_FLAG_FIRST      0x01     // First report since power-on / reset
+#define PAYLOAD_FLAG_MOTION     0x02     // Sent early on PIR motion (wake-up or PIR_DSP)
+#define PAYLOAD_FLAG_PIR_DSP    0x04     // AIN0 field is the motion detector output
+#define PAYLOAD_FLAG_ACK        0x08     // Sender waits for an ACK (RADIO_ACK, cc1110_radio.h)
+#define PAYLOAD_FLAG_OVERSAMPLE_MASK  0x30
+#define PAYLOAD_FLAG_OVERSAMPLE(n)    (((n) << 4) & PAYLOAD_FLAG_OVERSAMPLE_MASK)
+
+// AIN0 field with PAYLOAD_FLAG_PIR_DSP
+#define PAYLOAD_PIR_MOTION      0x4000
+#define PAYLOAD_PIR_EVENTS_MASK 0x3FFF
+
+// Number of records that fit in a payload area of the given size
+#define PAYLOAD_MAX_RECORDS(size)   (((size) - PAYLOAD_HEADER_SIZE) / PAYLOAD_RECORD_SIZE)
+
+
+/*==== TYPES =================================================================*/
+
+// One set of readings, as taken on a single wake-up
+typedef struct {
+    int16 battery;                          // Battery voltage * 10
+    int16 adc[PAYLOAD_ADC_CHANNELS];        // PIR, thermopile, thermistor
+} PAYLOAD_RECORD;
+
+
+/*==== LOCAL VARIABLES =======================================================*/
+
+#ifdef PAYLOAD_ASCII
+static unsigned char xdata payload_format[] = "V|%02d|D|%06d|%06d|%06d";
+#endif
+
+// Readings waiting to be sent. XRAM is retained in PM2, so the ring survives
+// the sleep between wake-ups; when it overflows the oldest reading is lost.
+static PAYLOAD_RECORD xdata batch_ring[BATCH_SIZE];
+static uint8 xdata batch_head  = 0;      // Next slot to write
+static uint8 xdata batch_count = 0;      // Number of valid records
+
+
+/*==== FUNCTIONS =============================================================*/
+
+/******************************************************************************
+* @fn  payload_put_int16
+*
+* @brief
+*      Store a 16 bit value at the given location in little-endian order.
+*
+* @return uint8
+*          Number of bytes written (always 2)
+*
+******************************************************************************/
+uint8 payload_put_int16(uint8 xdata *buf, int16 value)
+{
+    buf[0] = (uint8)value;
+    buf[1] = (uint8)((uint16)value >> 8);
+    return 2;
+}
+
+
+/******************************************************************************
+* @fn  batch_add
+*
+* @brief
+*      Store one set of readings in the batch ring.
+*
+* Parameters:
+*
+* @param int16 battery
+*          Battery voltage * 10, as returned by getBatteryVoltage().
+*        int16 xdata *adc
+*          PAYLOAD_ADC_CHANNELS raw ADC readings (PIR, thermopile, thermistor).
+*
+* @return uint8
+*          TRUE when BATCH_SIZE readings are waiting and a packet should be sent.
+*
+******************************************************************************/
+uint8 batch_add(int16 battery, int16 xdata *adc)
+{
+    PAYLOAD_RECORD xdata *rec = &batch_ring[batch_head];
+    uint8 i;
+
+    rec->battery = battery;
+    for (i = 0; i < PAYLOAD_ADC_CHANNELS; i++)
+        rec->adc[i] = adc[i];
+
+    if (++batch_head >= BATCH_SIZE)
+        batch_head = 0;
+    if (batch_count < BATCH_SIZE)
+        batch_count++;
+
+    return batch_count >= BATCH_SIZE;
+}
+
+
+/******************************************************************************
+* @fn  batch_fills_next
+*
+* @brief
+*      TRUE if the next batch_add() will fill the batch, i.e. a packet will be
+*      sent after the coming reading.
+*
+******************************************************************************/
+uint8 batch_fills_next(void)
+{
+    return batch_count >= BATCH_SIZE - 1;
+}
+
+
+/******************************************************************************
+* @fn  payload_encode_batch
+*
+* @brief
+*      Encode all readings waiting in the batch ring, oldest first, into the
+*      payload area of the packet buffer and empty the ring. Fields are written
+*      straight into 'buf', no intermediate formatting is done.
+*
+* Parameters:
+*
+* @param uint8 xdata *buf
+*          Start of the payload area in the packet buffer.
+*        uint16 seq
+*          Report sequence number.
+*        uint8 flags
+*          PAYLOAD_FLAG_* bits.
+*
+* @return uint8
+*          Number of payload bytes written.
+*
+******************************************************************************/
+uint8 payload_encode_batch(uint8 xdata *buf, uint16 seq, uint8 flags)
+{
+    PAYLOAD_RECORD xdata *rec;
+    uint8 len;
+    uint8 idx;
+#ifndef PAYLOAD_ASCII
+    uint8 n;
+    uint8 i;
+#endif
+
+#ifdef PAYLOAD_ASCII
+    // Debug build: the legacy ASCII payload of the latest reading only,
+    // e.g. V|33|D|000907|000393|000138
+    (void)seq;
+    (void)flags;
+    idx = batch_head ? batch_head - 1 : BATCH_SIZE - 1;
+    rec = &batch_ring[idx];
+    sprintf((char *)buf, (char *)payload_format, rec->battery, rec->adc[0], rec->adc[1], rec->adc[2]);
+    len = (uint8)strlen((char *)buf);
+#else
+    buf[0] = PAYLOAD_VERSION;
+    buf[1] = flags;
+    payload_put_int16(buf + 2, (int16)seq);
+    buf[4] = batch_count;
+    len = PAYLOAD_HEADER_SIZE;
+
+    // Oldest record first
+    idx = (batch_head + BATCH_SIZE - batch_count) % BATCH_SIZE;
+    for (n = 0; n < batch_count; n++)
+    {
+        rec = &batch_ring[idx];
+
+        len += payload_put_int16(buf + len, rec->battery);
+        for (i = 0; i < PAYLOAD_ADC_CHANNELS; i++)
+            len += payload_put_int16(buf + len, rec->adc[i]);
+
+        if (++idx >= BATCH_SIZE)
+            idx = 0;
+    }
+#endif
+
+    batch_count = 0;
+    return len;
+}
+
+
+#endif /* PAYLOAD_H */
+
+/*==== END OF FILE ==========================================================*/
@@ -0,0 +1,69 @@
+#ifndef SENSOR_BENCH_H
+#define SENSOR_BENCH_H
+
+/*==== INCLUDES ==============================================================*/
+#include "types.h"
+#include "hal_sleep_timer.h"
+
+/*==== CONSTS ================================================================*/
+
+// Phases of a wake cycle timed by 'make bench'. The names printed for each
+// id are in bench/bench.sh, keep both lists in step.
+#define BENCH_MARKER            0   // Two markers back to back (overhead)
+#define BENCH_WAKE              1   // Whole wake, loop top to PM entry
+#define BENCH_ADC_SENSORS       2   // halAdcSampleSensors()
+#define BENCH_ADC_BATTERY       3   // getBatteryVoltage()
+#define BENCH_ADC_PIR           4   // halAdcSampleSingle(AIN0)
+#define BENCH_ADC_THERMOPILE    5   // halAdcSampleSingle(AIN1)
+#define BENCH_ADC_THERMISTOR    6   // halAdcSampleSingle(AIN6)
+#define BENCH_ENCODE            7   // payload_encode_batch() (sprintf with PAYLOAD_ASCII)
+#define BENCH_XOSC              8   // halClockSwitchToXosc()
+#define BENCH_RADIO_START       9   // radio_start()
+#define BENCH_SEND              10  // send_packet()
+#define BENCH_RCOSC             11  // halClockSwitchToRcosc()
+#define BENCH_SLEEP             12  // PM2 entry sequence up to PCON.IDLE
+#define BENCH_PIR_DSP           13  // pirDspMeasure() (PIR_DSP)
+
+// Marker ids: the phase for its start, the phase | 0x80 for its end
+#define BENCH_END_BIT           0x80
+
+
+/*==== MACROS=================================================================*/
+
+// Mark the start and end of a phase. Outside BENCH builds they are empty.
+#ifdef BENCH
+#define BENCH_BEGIN(phase)      bench_mark(phase)
+#define BENCH_END(phase)        bench_mark((phase) | BENCH_END_BIT)
+#else
+#define BENCH_BEGIN(phase)
+#define BENCH_END(phase)
+#endif
+
+
+/*==== FUNCTIONS =============================================================*/
+
+#ifdef BENCH
+/******************************************************************************
+* @fn  bench_mark
+*
+* @brief
+*      Phase marker. bench/bench.sh puts a breakpoint on this function and
+*      reads the marker id from DPL (the first argument) and the cycle count
+*      at each stop.
+*
+*      The simulator has no sleep timer, so the end of the PM entry sequence
+*      stands in for its interrupt and the next pass through the main loop is
+*      a timer wake again.
+*
+******************************************************************************/
+void bench_mark(uint8 id)
+{
+    if (id == (BENCH_SLEEP | BENCH_END_BIT))
+        sleep_timer_fired = TRUE;
+}
+#endif
+
+
+#endif /* SENSOR_BENCH_H */
+
+/*==== END OF FILE ==========================================================*/
@@ -0,0 +1,384 @@
+#ifndef SENSOR_CONFIG_H
+#define SENSOR_CONFIG_H
+
+/***********************************************************************************
+* BUILD OPTIONS
+*
+* Compile time switches for the sensor firmware. Every option below can be
+* enabled from the Makefile command line, e.g. 'make PAYLOAD_ASCII=1', or by
+* passing the matching -D flag to SDCC directly.
+*/
+
+/*==== PAYLOAD ===============================================================*/
+
+// PAYLOAD_ASCII
+//
+// Send the legacy human readable payload ("V|33|D|000203|000134|000406")
+// formatted with sprintf() instead of the packed binary payload. This pulls
+// the whole SDCC printf runtime into flash and costs thousands of cycles per
+// report, so only use it for debugging with the old Arduino receiver sketch.
+//#define PAYLOAD_ASCII
+
+// BATCH_SIZE
+//
+// Number of wake-ups whose readings are collected in retained XRAM and sent
+// together in one packet. The HS XOSC and the radio are only powered on every
+// BATCH_SIZE-th wake-up. 1 sends every reading straight away. At most
+// PAYLOAD_MAX_RECORDS(MAX_REPORT_SIZE) readings fit in one packet: 6, or 5
+// with RADIO_AES.
+#ifndef BATCH_SIZE
+#define BATCH_SIZE              1
+#endif
+
+
+/*==== ADC ===================================================================*/
+
+// ADC_SINGLE_POLLED
+//
+// Sample each channel with its own halAdcSampleSingle() / getBatteryVoltage()
+// call, busy-waiting on ADCIF every time. By default the sensor channels are
+// converted as one ADC sequence moved by DMA channel DMA_CH_ADC, followed by
+// the battery voltage, with the CPU idle throughout.
+//#define ADC_SINGLE_POLLED
+
+// ADC_OVERSAMPLE_BITS
+//
+// Extra bits of resolution for the thermopile (AIN1) and thermistor (AIN6),
+// 0 to 3. Each report then runs 4^n back-to-back ADC sequences in one DMA
+// burst and decimates them to a 10 + n bit reading, which takes out most of
+// the count-to-count jitter. The PIR stays a single 10 bit sample. The
+// setting is sent in the payload flags (PAYLOAD_FLAG_OVERSAMPLE). The raw
+// burst is kept in XRAM, 6 * 4^n bytes (384 bytes at n = 3). Not used with
+// ADC_SINGLE_POLLED.
+#ifndef ADC_OVERSAMPLE_BITS
+#define ADC_OVERSAMPLE_BITS     0
+#endif
+
+
+/*==== SLEEP TIMER ===========================================================*/
+
+// SLEEP_INTERVAL_MS
+//
+// Default time between wake-ups in milliseconds, applied at boot. It can be
+// changed at runtime with sleepTimerSetMs() / sleepTimerSetSeconds(). The
+// default matches the original fixed EVENT0 of 0xEEEE at 32.768 kHz (~1.87 s).
+#ifndef SLEEP_INTERVAL_MS
+#define SLEEP_INTERVAL_MS       1866UL
+#endif
+
+// SLEEP_JITTER_MS
+//
+// Spread of the wake-up times: every sleep is moved by a random amount of up
+// to +/- SLEEP_JITTER_MS / 2, so the average interval stays the same. Units
+// switched on together with the same interval otherwise wake, and transmit,
+// in lockstep until their RC oscillators drift apart. The random numbers are
+// seeded from the device address. Rounded to the sleep timer resolution in
+// use (1 ms at most, see hal_sleep_timer.h); intervals longer than 64 s are
+// made of several timer wakes, each moved on its own. 0 disables it.
+#ifndef SLEEP_JITTER_MS
+#define SLEEP_JITTER_MS         0UL
+#endif
+
+
+/*==== PIR ===================================================================*/
+
+// PIR_WAKE
+//
+// Wake from PM2/PM3 on an edge from the PIR front end on P0_0 (Port 0
+// interrupt) and report motion within milliseconds instead of waiting for
+// the next sleep timer wake. With SLEEP_INTERVAL_MS set to 0 the timer is
+// off and the device sleeps in PM3 between motion events.
+//
+// Needs an external comparator between the PIR front end and P0_0, or a PIR
+// with a digital output. The bare analog PIR signal sits around mid-supply,
+// which is no valid digital level: the input buffer draws current and
+// chatters instead of giving one clean edge per motion.
+//#define PIR_WAKE
+
+// PIR_HOLDOFF_WAKES
+//
+// Sleep timer wakes to keep the PIR interrupt disabled after a motion
+// report, so a person moving in front of the sensor does not flood the
+// channel. In PM3 (no timer) the interrupt is re-armed after each report.
+#ifndef PIR_HOLDOFF_WAKES
+#define PIR_HOLDOFF_WAKES       1
+#endif
+
+// PIR_WAKE_EDGE_FALLING
+//
+// 1 to wake on the falling edge of P0_0 instead of the rising edge.
+#ifndef PIR_WAKE_EDGE_FALLING
+#define PIR_WAKE_EDGE_FALLING   0
+#endif
+
+// PIR_DSP
+//
+// Detect motion on the device instead of sending a single raw AIN0 sample.
+// A measurement takes a burst of PIR_DSP_SAMPLES AIN0 samples and runs it
+// through a baseline tracker, a band-pass, a peak-to-peak detector and
+// hysteresis (sensor_pir.h). The PIR field of the payload then carries the
+// motion state and a count of motion events (PAYLOAD_FLAG_PIR_DSP), and the
+// start of motion is reported straight away, like a PIR wake-up.
+//
+// The swing is taken across bursts, one measurement interval apart, so the
+// burst itself only needs to average out the ADC noise. With PIR_WAKE it
+// only runs on PIR wake-ups and, while motion lasts, on the timer wakes that
+// look for its end; otherwise on every measurement.
+//#define PIR_DSP
+
+// PIR_DSP_SAMPLES / PIR_DSP_PERIOD_MS
+//
+// Samples per burst (2 to 255) and the time between them in milliseconds
+// (Timer 3 paced, CPU idle in between; 0 converts back to back). Every
+// millisecond of burst keeps the CPU awake on the HS RCOSC. The defaults
+// take about 1 ms per burst.
+#ifndef PIR_DSP_SAMPLES
+#define PIR_DSP_SAMPLES         8
+#endif
+#ifndef PIR_DSP_PERIOD_MS
+#define PIR_DSP_PERIOD_MS       0
+#endif
+
+// PIR_DSP_ON_COUNTS / PIR_DSP_OFF_COUNTS
+//
+// Hysteresis on the band-passed peak-to-peak swing, in 10 bit counts: motion
+// starts above PIR_DSP_ON_COUNTS and ends below PIR_DSP_OFF_COUNTS.
+#ifndef PIR_DSP_ON_COUNTS
+#define PIR_DSP_ON_COUNTS       12
+#endif
+#ifndef PIR_DSP_OFF_COUNTS
+#define PIR_DSP_OFF_COUNTS      6
+#endif
+
+
+/*==== REPORT ON CHANGE ======================================================*/
+
+// REPORT_ON_CHANGE
+//
+// Only queue a reading for transmission when a channel has moved out of its
+// deadband around the last reported value, or REPORT_HEARTBEAT readings in a
+// row have been dropped. Unchanged wake-ups then go back to sleep without
+// starting the HS XOSC or the radio. Motion wake-ups are always reported.
+//#define REPORT_ON_CHANGE
+
+// REPORT_HEARTBEAT
+//
+// Report at least every REPORT_HEARTBEAT readings (sleep intervals) even when
+// nothing changed, so the receiver knows the sensor is alive. 0 disables it.
+#ifndef REPORT_HEARTBEAT
+#define REPORT_HEARTBEAT            32
+#endif
+
+// REPORT_DEADBAND_*
+//
+// Largest change that is not reported: battery in 0.1 V, the ADC channels in
+// 10 bit counts (scaled with ADC_OVERSAMPLE_BITS for the thermopile and
+// thermistor).
+#ifndef REPORT_DEADBAND_BATTERY
+#define REPORT_DEADBAND_BATTERY     1
+#endif
+#ifndef REPORT_DEADBAND_PIR
+#define REPORT_DEADBAND_PIR         8
+#endif
+#ifndef REPORT_DEADBAND_THERMOPILE
+#define REPORT_DEADBAND_THERMOPILE  3
+#endif
+#ifndef REPORT_DEADBAND_THERMISTOR
+#define REPORT_DEADBAND_THERMISTOR  2
+#endif
+
+/*==== CONVERSION ============================================================*/
+
+// Parameters of the raw-to-engineering-units conversion (sensor_convert.h).
+// They are only read by the host table generator (tools/convert_gen.cpp),
+// which 'make' reruns when this file changes, so they may be fractional; the
+// firmware itself only sees the generated fixed-point tables.
+
+// THERMISTOR_*
+//
+// The thermopile package's NTC on AIN6: resistance at 25 C, Beta (25/85) and
+// the fixed resistor from AVDD, with the NTC to ground. The defaults put 25 C
+// at 0.4 * AVDD.
+#ifndef THERMISTOR_R25
+#define THERMISTOR_R25              100000.0
+#endif
+#ifndef THERMISTOR_BETA
+#define THERMISTOR_BETA             3940.0
+#endif
+#ifndef THERMISTOR_R_SERIES
+#define THERMISTOR_R_SERIES         150000.0
+#endif
+
+// THERMOPILE_*
+//
+// The amplified thermopile on AIN1: the 10 bit reading with the target at
+// ambient temperature, and the counts per degree of target-to-ambient
+// difference around 25 C. The output follows Stefan-Boltzmann
+// (Tobj^4 - Tamb^4), so the gain is lower below 25 C and higher above.
+#ifndef THERMOPILE_OFFSET
+#define THERMOPILE_OFFSET           68
+#endif
+#ifndef THERMOPILE_COUNTS_PER_C
+#define THERMOPILE_COUNTS_PER_C     2.0
+#endif
+
+// CONVERT_TEMPERATURE
+//
+// Build convert_thermistor() and convert_thermopile() and their tables into
+// the firmware, for code that wants degrees C on the device (e.g. threshold
+// logic). Reports carry raw counts either way. Off, the firmware only has
+// convert_battery(), which saves the tables and lookups in flash; host
+// programs (CONVERT_HOST) always get them.
+//#define CONVERT_TEMPERATURE
+
+
+/*==== RADIO =================================================================*/
+
+// DEVICE_NUMBER / DESTINATION_ADDR
+//
+// Device address (source byte of the frame header and the radio's ADDR
+// register) and the address packets are sent to, 0 being broadcast. These
+// are only the defaults for units that have not been provisioned: the
+// identity in the last flash page (device_identity.h) overrides both.
+#ifndef DEVICE_NUMBER
+#define DEVICE_NUMBER           1
+#endif
+#ifndef DESTINATION_ADDR
+#define DESTINATION_ADDR        0x00
+#endif
+
+// RADIO_TX_ISR
+//
+// Feed the radio one byte at a time from the RFTXRX interrupt, as the
+// original firmware did, waking the CPU for every byte. By default the packet
+// is handed to DMA channel DMA_CH_RADIO and the CPU idles through the whole
+// air time.
+//#define RADIO_TX_ISR
+
+// RADIO_FIXED_LENGTH
+//
+// Send every packet as MAX_PACKET_SIZE bytes (fixed length mode, PKTCTRL0 =
+// 0x44) with the payload padded by NULs, for legacy receivers configured for
+// 61 byte packets. By default variable length mode is used and the length
+// byte covers only the header and the encoded payload.
+//#define RADIO_FIXED_LENGTH
+
+// RADIO_TX_DELAY_US
+//
+// Delay ahead of every packet, for receivers that need time to switch from
+// TX back to RX (10 to 2500 us, CPU idle; 0 sends at once). The default keeps
+// the 630 us the original firmware spun on Timer 3 (16384 counts at full
+// tick speed), which deployed gateways may rely on.
+#ifndef RADIO_TX_DELAY_US
+#define RADIO_TX_DELAY_US       630
+#endif
+
+// RADIO_PROFILE
+//
+// Radio profile after reset, one of profiles/*.rf as generated into
+// cc1110_radio_tables.h (e.g. make RADIO_PROFILE=robust). RADIO_PROFILE_FAST
+// sends at 250 kbps for the least airtime on short links,
+// RADIO_PROFILE_ROBUST at 38.4 kbps for long ones. A profile in the device
+// identity ('make provision PROFILE=robust') overrides it, and
+// radio_set_profile() switches at run time. Sensors and gateway of a site
+// must use the same profile.
+#ifndef RADIO_PROFILE
+#define RADIO_PROFILE           RADIO_PROFILE_FAST
+#endif
+
+// RADIO_ACK
+//
+// Ask the gateway to acknowledge every packet (PAYLOAD_FLAG_ACK). After TX
+// the radio goes straight to RX (no recalibration) for at most
+// RADIO_ACK_TIMEOUT_US waiting for the ACK's sync word; without a valid ACK
+// the packet is sent again after a random backoff, up to RADIO_ACK_RETRIES
+// times. Needs variable length mode and the DMA TX path (not
+// RADIO_FIXED_LENGTH or RADIO_TX_ISR).
+//#define RADIO_ACK
+
+// RADIO_ACK_TIMEOUT_US
+//
+// RX window for the start of the ACK, from the end of TX: the gateway's
+// turnaround (0 to 10000 us). The ACK's preamble and sync word at the
+// profile's data rate are added to it (257 us at 250 kbps, 1668 us at
+// 38.4 kbps), and the sum is rounded to 98.5 us steps. Once the sync word
+// has been seen the rest of the ACK is waited for, at most the same time
+// again.
+#ifndef RADIO_ACK_TIMEOUT_US
+#define RADIO_ACK_TIMEOUT_US    340
+#endif
+
+// RADIO_ACK_RETRIES / RADIO_ACK_BACKOFF_MS
+//
+// Retransmissions of an unacknowledged packet, and the backoff before them:
+// a random 1 to RADIO_ACK_BACKOFF_MS << n ms before retry n + 1, so sensors
+// that collided are unlikely to collide again.
+#ifndef RADIO_ACK_RETRIES
+#define RADIO_ACK_RETRIES       3
+#endif
+#ifndef RADIO_ACK_BACKOFF_MS
+#define RADIO_ACK_BACKOFF_MS    4
+#endif
+
+// RADIO_CCA
+//
+// Listen before talk. The radio enters RX first and the TX strobe is only
+// taken on a clear channel (MCSM1.CCA_MODE: RSSI below the carrier sense
+// threshold and no packet being received). A busy channel defers the packet
+// by a random 1 to RADIO_CCA_BACKOFF_MS << n ms after busy assessment n + 1;
+// after RADIO_CCA_TRIES busy assessments the packet is sent anyway, so no
+// reading is dropped by the sensor itself. Each try costs a calibration and
+// RADIO_CCA_LISTEN_US in RX. Not used with RADIO_TX_ISR.
+//#define RADIO_CCA
+
+// RADIO_CCA_THRESHOLD_DB
+//
+// Carrier sense threshold, -7 to 7 dB from the level the AGC regulates to
+// (AGCCTRL1.CARRIER_SENSE_ABS_THR, AGCCTRL2.MAGN_TARGET).
+#ifndef RADIO_CCA_THRESHOLD_DB
+#define RADIO_CCA_THRESHOLD_DB  0
+#endif
+
+// RADIO_CCA_LISTEN_US
+//
+// Time in RX before the assessment, for the RSSI to become valid (10 to
+// 2500 us). It takes longer with the narrower RX filter of a low data rate
+// profile.
+#ifndef RADIO_CCA_LISTEN_US
+#define RADIO_CCA_LISTEN_US     100
+#endif
+
+// RADIO_CCA_TRIES / RADIO_CCA_BACKOFF_MS
+//
+// Clear channel assessments per transmission, and the backoff between them.
+#ifndef RADIO_CCA_TRIES
+#define RADIO_CCA_TRIES         5
+#endif
+#ifndef RADIO_CCA_BACKOFF_MS
+#define RADIO_CCA_BACKOFF_MS    2
+#endif
+
+// RADIO_AES
+//
+// Encrypt and authenticate every payload with AES-128 CCM (sensor_crypt.h),
+// done by the ENC coprocessor and DMA while the CPU idles. Costs 11 bytes
+// per packet (marker, session, frame counter, 4 byte MIC), so one record
+// less fits. The gateway needs the unit's key to read anything. Not used
+// with RADIO_TX_ISR.
+//#define RADIO_AES
+
+// RADIO_AES_KEY
+//
+// Key of RADIO_AES units that have not been given one of their own with
+// 'make provision KEY=...' (device_identity.h), as a list of 16 bytes. The
+// default is the FIPS-197 example key: fine on the bench, useless anywhere
+// else.
+#ifndef RADIO_AES_KEY
+#define RADIO_AES_KEY           0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, \
+                                0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F
+#endif
+
+
+#endif /* SENSOR_CONFIG_H */
+
+/*==== END OF FILE ==========================================================*/
@@ -0,0 +1,164 @@
+#ifndef SENSOR_CONVERT_H
+#define SENSOR_CONVERT_H
+
+/*==== INCLUDES ==============================================================*/
+#include "types.h"
+#include "sensor_config.h"
+
+// Host programs always convert temperatures, the firmware with
+// CONVERT_TEMPERATURE (sensor_config.h)
+#if defined(CONVERT_HOST) && !defined(CONVERT_TEMPERATURE)
+#define CONVERT_TEMPERATURE
+#endif
+
+// Tables live in flash on the 8051
+#if defined (SDCC) || defined (__SDCC)
+#define CONVERT_TABLE           __code
+#else
+#define CONVERT_TABLE
+#endif
+
+// Fixed-point tables generated from the THERMISTOR_* / THERMOPILE_*
+// parameters in sensor_config.h (tools/convert_gen.cpp)
+#include "sensor_convert_tables.h"
+
+/*
+ * Raw readings to engineering units in integer arithmetic only, so neither
+ * the firmware nor anything else using this header needs floating point.
+ * The functions are static inline because the header is also built into host
+ * programs (the gateway), where the tables then match this tree's settings.
+ *
+ * The thermistor and thermopile tables and functions are only built with
+ * CONVERT_TEMPERATURE, an opt-in firmware option; host programs define
+ * CONVERT_HOST before including this header and always get them.
+ * convert_battery() is always there.
+ */
+
+
+/*==== FUNCTIONS =============================================================*/
+
+/******************************************************************************
+* @fn  convert_battery
+*
+* @brief
+*      Battery voltage from a rightbound 12 bit VDD/3 reading against the
+*      internal 1.25 V reference: VDD = raw * 3.75 V / 2047.
+*
+* @return int16
+*          Battery voltage * 10, truncated like the original float version.
+*
+******************************************************************************/
+static inline int16 convert_battery(int16 raw)
+{
+    if (raw <= 0)
+        return 0;
+    return (int16)(((uint32)raw * CONVERT_BATTERY_MUL) >> CONVERT_BATTERY_SHIFT);
+}
+
+
+#ifdef CONVERT_TEMPERATURE
+
+/******************************************************************************
+* @fn  convert_interp
+*
+* @brief
+*      Linear interpolation in a table with one entry every 2^bits of 'pos'.
+*      Past the last entry the last value is returned.
+*
+******************************************************************************/
+static inline int16 convert_interp(const int16 CONVERT_TABLE *table, uint8 entries, uint16 pos, uint8 bits)
+{
+    uint8 i = (uint8)(pos >> bits);
+    int16 frac = (int16)(pos & ((1 << bits) - 1));
+
+    if (i >= entries - 1)
+        return table[entries - 1];
+    return table[i] + (int16)(((int32)(table[i + 1] - table[i]) * frac) >> bits);
+}
+
+
+/******************************************************************************
+* @fn  convert_thermistor
+*
+* @brief
+*      Temperature of the NTC on AIN6 (the thermopile's ambient sensor).
+*
+* Parameters:
+*
+* @param int16 counts
+*          Rightbound reading against AVDD, 10 + extra_bits bits.
+*        uint8 extra_bits
+*          Oversampling bits of the reading (ADC_SENSOR_EXTRA_BITS, or
+*          PAYLOAD_FLAG_OVERSAMPLE on the receiving side).
+*
+* @return int16
+*          Temperature in C * 100, -40 C to 125 C.
+*
+******************************************************************************/
+static inline int16 convert_thermistor(int16 counts, uint8 extra_bits)
+{
+    if (counts < 0)
+        counts = 0;
+    return convert_interp(convert_thermistor_table, CONVERT_THERMISTOR_ENTRIES, (uint16)counts,
+                          CONVERT_THERMISTOR_STEP_BITS + extra_bits);
+}
+
+
+/******************************************************************************
+* @fn  convert_thermopile
+*
+* @brief
+*      Target temperature seen by the thermopile on AIN1, compensated for the
+*      temperature of the thermopile itself. The net signal is proportional
+*      to Tobj^4 - Tamb^4: the ambient temperature is turned into table
+*      counts, the net signal added, and the sum looked up backwards.
+*
+* Parameters:
+*
+* @param int16 counts
+*          Rightbound reading against AVDD, 10 + extra_bits bits.
+*        uint8 extra_bits
+*          Oversampling bits of the reading.
+*        int16 ambient
+*          Thermopile temperature in C * 100, from convert_thermistor().
+*
+* @return int16
+*          Target temperature in C * 100, clamped to the table range
+*          (-20.48 C to 122.88 C).
+*
+******************************************************************************/
+static inline int16 convert_thermopile(int16 counts, uint8 extra_bits, int16 ambient)
+{
+    int32 net = counts - ((int32)THERMOPILE_OFFSET << extra_bits);
+    int32 r;
+    uint8 i = 0;
+
+    // Net signal in table units
+    if (CONVERT_RADIANCE_FRAC_BITS >= extra_bits)
+        net *= 1 << (CONVERT_RADIANCE_FRAC_BITS - extra_bits);
+    else
+        net /= 1 << (extra_bits - CONVERT_RADIANCE_FRAC_BITS);
+
+    if (ambient < CONVERT_RADIANCE_MIN_C)
+        ambient = CONVERT_RADIANCE_MIN_C;
+    r = convert_interp(convert_radiance_table, CONVERT_RADIANCE_ENTRIES,
+                       (uint16)(ambient - CONVERT_RADIANCE_MIN_C), CONVERT_RADIANCE_STEP_BITS) + net;
+
+    if (r <= 0)
+        return CONVERT_RADIANCE_MIN_C;
+    if (r >= convert_radiance_table[CONVERT_RADIANCE_ENTRIES - 1])
+        return CONVERT_RADIANCE_MIN_C + ((CONVERT_RADIANCE_ENTRIES - 1) << CONVERT_RADIANCE_STEP_BITS);
+
+    while (convert_radiance_table[i + 1] <= r)
+        i++;
+    return CONVERT_RADIANCE_MIN_C + ((int16)i << CONVERT_RADIANCE_STEP_BITS) +
+           (int16)(((r - convert_radiance_table[i]) << CONVERT_RADIANCE_STEP_BITS) /
+                   (convert_radiance_table[i + 1] - convert_radiance_table[i]));
+}
+
+#endif /* CONVERT_TEMPERATURE */
+
+
+#endif /* SENSOR_CONVERT_H */
+
+/*==== END OF FILE ==========================================================*/
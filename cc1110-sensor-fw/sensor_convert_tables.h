@@ -0,0 +1,43 @@
+#ifndef SENSOR_CONVERT_TABLES_H
+#define SENSOR_CONVERT_TABLES_H
+
+/***********************************************************************************
+* Generated by tools/convert_gen.cpp from sensor_config.h - do not edit.
+*
+* THERMISTOR_R25 100000.0, THERMISTOR_BETA 3940.0, THERMISTOR_R_SERIES 150000.0
+* THERMOPILE_COUNTS_PER_C 2.000
+*/
+
+// Battery: VDD * 10 = (raw * MUL) >> SHIFT, exact for 0..2047
+#define CONVERT_BATTERY_MUL         19209UL
+#define CONVERT_BATTERY_SHIFT       20
+
+// Temperature tables, only built with CONVERT_TEMPERATURE (sensor_convert.h)
+#ifdef CONVERT_TEMPERATURE
+
+// Thermistor: C * 100 every 16 counts of the 10 bit reading
+#define CONVERT_THERMISTOR_STEP_BITS  4
+#define CONVERT_THERMISTOR_ENTRIES    33
+static const int16 CONVERT_TABLE convert_thermistor_table[CONVERT_THERMISTOR_ENTRIES] = {
+    12500,  11364,   8791,   7394,   6434,   5700,   5102,   4595,
+     4150,   3753,   3390,   3054,   2740,   2442,   2156,   1881,
+     1612,   1349,   1088,    828,    567,    301,     30,   -252,
+     -547,   -860,  -1199,  -1575,  -2004,  -2518,  -3185,  -4000,
+    -4000,
+};
+
+// Thermopile: counts * 2^FRAC_BITS of a target at C * 100 = MIN_C + (i << STEP_BITS)
+#define CONVERT_RADIANCE_MIN_C      (-2048)
+#define CONVERT_RADIANCE_STEP_BITS  9
+#define CONVERT_RADIANCE_ENTRIES    29
+#define CONVERT_RADIANCE_FRAC_BITS  6
+static const int16 CONVERT_TABLE convert_radiance_table[CONVERT_RADIANCE_ENTRIES] = {
+        0,    411,    848,   1310,   1800,   2318,   2866,   3444,
+     4054,   4697,   5373,   6085,   6833,   7618,   8442,   9306,
+    10211,  11159,  12150,  13187,  14270,  15401,  16582,  17813,
+    19096,  20433,  21824,  23273,  24779,
+};
+
+#endif /* CONVERT_TEMPERATURE */
+
+#endif /* SENSOR_CONVERT_TABLES_H */
@@ -0,0 +1,552 @@
+#ifndef SENSOR_CRYPT_H
+#define SENSOR_CRYPT_H
+
+/*==== INCLUDES ==============================================================*/
+#include "types.h"
+#include "sensor_config.h"
+#include <string.h>
+#ifdef CRYPT_HOST
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#else
+#include "cc1110.h"
+#include "ioCCxx10_bitdef.h"
+#include "hal_dma.h"
+#include "hal_power.h"
+#include "hal_timer.h"
+#include "device_identity.h"
+#endif
+
+/*
+ * Payload encryption and authentication (RADIO_AES): AES-128 in CCM mode
+ * (NIST SP 800-38C, RFC 3610) with a 4 byte MIC. The ENC coprocessor does
+ * the AES, with DMA moving every block in and out, so the CPU idles through
+ * the whole thing; a report costs eight blocks. The key is the unit's own,
+ * from the identity page (device_identity.h), or RADIO_AES_KEY for units
+ * that have not been given one.
+ *
+ * A secured frame, after the radio header (cc1110_radio.h):
+ *
+ *  Offset  Size  Field
+ *  4       1     CRYPT_MARKER; plain payloads start with PAYLOAD_VERSION or 'V'
+ *  5       4     Session, new at the first frame after reset: the unit's
+ *                session count (device_identity.h), 16 bits big-endian,
+ *                then 16 random bits from radio noise
+ *  9       2     Frame counter, high bytes, big-endian. The low byte is the
+ *                frame sequence number in the radio header.
+ *  11      n     Payload, encrypted
+ *  11 + n  4     MIC
+ *
+ * The nonce is {device address, session, 24 bit frame counter, 5 zero
+ * bytes}. It only repeats for a retransmission of the same frame (RADIO_ACK),
+ * which is sealed once and sent as is: a new session starts before the
+ * frame counter wraps. The session count in flash keeps sessions from
+ * repeating across resets, and lets the gateway turn away a frame from an
+ * older session as well as an older frame of the current one. A unit that
+ * has used up its session counts seals nothing more; it sends a bare
+ * notice, session 0 and no payload, until it gets a new key. The radio
+ * header, length byte included, and the session and counter are
+ * authenticated but sent in the clear.
+ *
+ * Host programs (the gateway's decoder, the simulator) define CRYPT_HOST
+ * before including this header; they get a software AES and
+ * crypt_ccm_open() instead of the firmware side.
+ */
+
+/*==== CONSTS ================================================================*/
+
+#define CRYPT_BLOCK_SIZE        16
+#define CRYPT_KEY_SIZE          16
+
+// Frame layout; the radio header is PACKET_HEADER_SIZE in cc1110_radio.h
+#define CRYPT_FRAME_HEADER_SIZE 4
+#define CRYPT_SOURCE_INDEX      2       // Device address
+#define CRYPT_SEQ_INDEX         3       // Frame sequence number
+#define CRYPT_MARKER_INDEX      4
+#define CRYPT_SESSION_INDEX     5
+#define CRYPT_COUNTER_INDEX     9
+#define CRYPT_PAYLOAD_INDEX     11
+
+#define CRYPT_MARKER            0x81
+#define CRYPT_SESSION_SIZE      4
+#define CRYPT_SESSION_COUNT_SIZE 2      // Session count, then noise
+#define CRYPT_SESSION_SPENT     0       // Count of the used up notice
+#define CRYPT_COUNTER_SIZE      2
+#define CRYPT_MIC_SIZE          4
+#define CRYPT_HEADER_SIZE       (1 + CRYPT_SESSION_SIZE + CRYPT_COUNTER_SIZE)
+#define CRYPT_OVERHEAD          (CRYPT_HEADER_SIZE + CRYPT_MIC_SIZE)
+
+// CCM: M = 4 byte MIC, L = 2 byte length field, 13 byte nonce. The
+// associated data is everything ahead of the payload, which fits in one
+// block with its 2 byte length.
+#define CRYPT_CCM_FLAGS_B0      0x49    // Adata, (M - 2) / 2 << 3, L - 1
+#define CRYPT_CCM_FLAGS_A       0x01    // L - 1
+#define CRYPT_AAD_SIZE          CRYPT_PAYLOAD_INDEX
+
+// Session noise: RSSI samples in RX, one bit from each
+#define CRYPT_NOISE_US          20
+#define CRYPT_NOISE_SAMPLES     (8 * (CRYPT_SESSION_SIZE - CRYPT_SESSION_COUNT_SIZE))
+
+// Blocks of a payload, zero padded
+#define CRYPT_BLOCKS(len)       (((len) + CRYPT_BLOCK_SIZE - 1) / CRYPT_BLOCK_SIZE)
+
+// Constant tables live in flash on the 8051
+#if defined (SDCC) || defined (__SDCC)
+#define CRYPT_TABLE             __code
+#else
+#define CRYPT_TABLE
+#endif
+
+
+#if defined(RADIO_AES) || defined(CRYPT_HOST)
+
+// Key of units without one of their own in the identity page
+static const uint8 CRYPT_TABLE crypt_default_key[CRYPT_KEY_SIZE] = { RADIO_AES_KEY };
+
+
+/*==== LOCAL FUNCTIONS =======================================================*/
+
+/******************************************************************************
+* @fn  crypt_nonce_block
+*
+* @brief
+*      CCM block made of flags, the nonce of 'frame' and a 16 bit number: B0
+*      (flags CRYPT_CCM_FLAGS_B0, payload length) or a counter block A_i
+*      (CRYPT_CCM_FLAGS_A, i). Generic pointers, so it serves the firmware
+*      and the host side alike.
+*
+******************************************************************************/
+static inline void crypt_nonce_block(uint8 *b, uint8 flags, const uint8 *frame, uint16 n)
+{
+    b[0] = flags;
+    b[1] = frame[CRYPT_SOURCE_INDEX];
+    memcpy(b + 2, frame + CRYPT_SESSION_INDEX, CRYPT_SESSION_SIZE + CRYPT_COUNTER_SIZE);
+    b[8] = frame[CRYPT_SEQ_INDEX];
+    memset(b + 9, 0, 5);
+    b[14] = (uint8)(n >> 8);
+    b[15] = (uint8)n;
+}
+
+
+/******************************************************************************
+* @fn  crypt_aad_block
+*
+* @brief
+*      CCM associated data block: its length, then the frame up to the
+*      payload, zero padded.
+*
+******************************************************************************/
+static inline void crypt_aad_block(uint8 *b, const uint8 *frame)
+{
+    b[0] = 0;
+    b[1] = CRYPT_AAD_SIZE;
+    memcpy(b + 2, frame, CRYPT_AAD_SIZE);
+    memset(b + 2 + CRYPT_AAD_SIZE, 0, CRYPT_BLOCK_SIZE - 2 - CRYPT_AAD_SIZE);
+}
+#endif
+
+
+#if defined(RADIO_AES) && !defined(CRYPT_HOST)
+
+/*==== LOCAL VARIABLES =======================================================*/
+
+// Key in use: in the identity page, or crypt_default_key
+static const uint8 *crypt_key;
+
+// Session and frame counter high bytes, retained in PM2/PM3 like the frame
+// sequence number
+static uint8  xdata crypt_session[CRYPT_SESSION_SIZE];
+static uint16 xdata crypt_counter;
+static uint8  xdata crypt_session_ok = FALSE;
+static uint8  xdata crypt_spent      = FALSE;   // No session counts left
+
+// Two blocks for B0 and the associated data, then the MAC and the counter
+// blocks
+static uint8  xdata crypt_block[2 * CRYPT_BLOCK_SIZE];
+
+// Run in progress: blocks the coprocessor has still to finish, and its mode
+static volatile uint8 crypt_blocks;
+static uint8 crypt_mode;
+
+// The ENCCS command for the next block. The last CBC-MAC block runs in CBC
+// mode, the only way to get the MAC out.
+#define CRYPT_NEXT_BLOCK() \
+    ((crypt_mode == ENCCS_MODE_CBCMAC && crypt_blocks == 1 ? ENCCS_MODE_CBC : crypt_mode) | \
+     ENCCS_CMD_ENC | ENCCS_ST)
+
+
+/*==== ISR ===================================================================*/
+
+/******************************************************************************
+* @fn  crypt_enc_isr
+*
+* @brief
+*      The ENC coprocessor finished a block (or a key/IV load). Starts the
+*      next block of the run; the DMA channels carry on with its data.
+*
+******************************************************************************/
+INTERRUPT(crypt_enc_isr, ENC_VECTOR)
+{
+    ENCIF_0 = 0;
+    ENCIF_1 = 0;
+    if (crypt_blocks && --crypt_blocks)
+        ENCCS = CRYPT_NEXT_BLOCK();
+}
+
+
+/*==== FUNCTIONS =============================================================*/
+
+/******************************************************************************
+* @fn  crypt_load
+*
+* @brief
+*      Load the key (ENCCS_CMD_LDKEY) or the IV (ENCCS_CMD_LDIV) from 'src',
+*      an all zero IV for NULL. Sixteen CPU writes, not worth a DMA setup.
+*
+******************************************************************************/
+static void crypt_load(uint8 cmd, const uint8 *src)
+{
+    uint8 i;
+
+    ENCCS = cmd | ENCCS_ST;
+    for (i = 0; i < CRYPT_BLOCK_SIZE; i++)
+        ENCDI = src ? src[i] : 0;
+    HAL_WAIT_UNTIL(ENCCS & ENCCS_RDY);
+}
+
+
+/******************************************************************************
+* @fn  crypt_run
+*
+* @brief
+*      Run 'blocks' blocks from 'in' through the coprocessor in 'mode', with
+*      the key and IV already loaded, the CPU idle meanwhile. DMA channel
+*      DMA_CH_ENC_IN feeds ENCDI and DMA_CH_ENC_OUT empties ENCDO into 'out'
+*      (may be 'in'); in CBC-MAC mode only the last block has an output.
+*
+******************************************************************************/
+static void crypt_run(uint8 mode, uint8 xdata *in, uint8 xdata *out, uint8 blocks)
+{
+    halDmaConfigure(DMA_CH_ENC_IN,
+        XDATA_ADDR(in), XDATA_ADDR(&X_ENCDI),
+        DMA_VLEN_LEN(DMA_VLEN_USE_LEN, blocks * CRYPT_BLOCK_SIZE),
+        DMA_WORDSIZE_BYTE | DMA_TMODE_SINGLE | DMA_TRIG_ENC_DW,
+        DMA_SRCINC_1 | DMA_DESTINC_0 | DMA_IRQMASK_DISABLE | DMA_M8_USE_8_BITS | DMA_PRI_HIGH);
+    halDmaConfigure(DMA_CH_ENC_OUT,
+        XDATA_ADDR(&X_ENCDO), XDATA_ADDR(out),
+        DMA_VLEN_LEN(DMA_VLEN_USE_LEN, (mode == ENCCS_MODE_CBCMAC ? 1 : blocks) * CRYPT_BLOCK_SIZE),
+        DMA_WORDSIZE_BYTE | DMA_TMODE_SINGLE | DMA_TRIG_ENC_UP,
+        DMA_SRCINC_0 | DMA_DESTINC_1 | DMA_IRQMASK_DISABLE | DMA_M8_USE_8_BITS | DMA_PRI_HIGH);
+    DMA_ARM_CHANNEL(DMA_CH_ENC_IN);
+    DMA_ARM_CHANNEL(DMA_CH_ENC_OUT);
+
+    crypt_mode = mode;
+    crypt_blocks = blocks;
+    ENCCS = CRYPT_NEXT_BLOCK();
+    HAL_IDLE_UNTIL(!crypt_blocks);
+}
+
+
+/******************************************************************************
+* @fn  crypt_new_session
+*
+* @brief
+*      Start a new session: count it in flash, fill in the rest from the LSB
+*      of the RSSI, which is noise with the radio in RX on a quiet channel,
+*      and start its frame counter over. The radio must be idle; it is again
+*      on return. Sets crypt_spent instead once the counts are used up.
+*
+******************************************************************************/
+static void crypt_new_session(void)
+{
+    uint16 count = deviceSessionNext();
+    uint8 i;
+
+    if (count == IDENTITY_SESSION_NONE)
+    {
+        crypt_spent = TRUE;
+        return;
+    }
+
+    crypt_session[0] = (uint8)(count >> 8);
+    crypt_session[1] = (uint8)count;
+
+    RFST = RFST_SRX;
+    HAL_IDLE_POLL(MARCSTATE == MARC_STATE_RX, CRYPT_NOISE_US);
+    halTimerStart(HAL_TIMER_US(CRYPT_NOISE_US));
+    for (i = 0; i < CRYPT_NOISE_SAMPLES; i++)
+    {
+        HAL_IDLE_UNTIL(halTimerTicks > i);
+        crypt_session[CRYPT_SESSION_COUNT_SIZE + (i >> 3)] =
+            (crypt_session[CRYPT_SESSION_COUNT_SIZE + (i >> 3)] << 1) | (RSSI & 0x01);
+    }
+    halTimerStop();
+
+    RFST = RFST_SIDLE;
+    HAL_WAIT_UNTIL(MARCSTATE == MARC_STATE_IDLE);
+    RFIF = 0;
+
+    crypt_counter = 0;
+    crypt_session_ok = TRUE;
+}
+
+
+/******************************************************************************
+* @fn  cryptInit
+*
+* @brief
+*      Pick the key: the unit's own from the identity page, else the build
+*      default. Call once at boot, after deviceIdentityLoad().
+*
+******************************************************************************/
+void cryptInit(void)
+{
+    if (identity_key_valid(IDENTITY_KEY_RECORD))
+        crypt_key = IDENTITY_KEY_RECORD + IDENTITY_KEY_OFS_KEY;
+    else
+        crypt_key = crypt_default_key;
+
+    ENCIF_0 = 0;
+    ENCIF_1 = 0;
+    ENCIE = 1;
+}
+
+
+/******************************************************************************
+* @fn  cryptSeal
+*
+* @brief
+*      Encrypt and authenticate the payload of 'frame' in place, radio header
+*      and sequence number already filled in. Writes the marker, session and
+*      counter ahead of the payload and the MIC after it; the payload is
+*      zero padded to whole blocks meanwhile. Needs the radio started, idle,
+*      for the first frame of a session.
+*
+*      With the session counts used up a new session would repeat a nonce,
+*      so the frame becomes the notice instead: marker, session and counter
+*      all 0 and no payload. The readings are not sent.
+*
+* Parameters:
+*
+* @param uint8 xdata *frame
+*          Radio frame, header first; the payload at CRYPT_PAYLOAD_INDEX.
+*        uint8 len
+*          Payload length.
+*
+* @return uint8
+*          FALSE if the frame is the notice.
+*
+******************************************************************************/
+uint8 cryptSeal(uint8 xdata *frame, uint8 len)
+{
+    uint8 xdata *payload = frame + CRYPT_PAYLOAD_INDEX;
+    uint8 blocks = CRYPT_BLOCKS(len);
+
+    // The counter goes on with the frame sequence number; 2^24 frames use
+    // up the session
+    if (frame[CRYPT_SEQ_INDEX] == 0 && crypt_session_ok && ++crypt_counter == 0)
+        crypt_session_ok = FALSE;
+    if (!crypt_session_ok && !crypt_spent)
+        crypt_new_session();
+
+    if (crypt_spent)
+    {
+        frame[CRYPT_MARKER_INDEX] = CRYPT_MARKER;
+        memset(frame + CRYPT_SESSION_INDEX, 0,
+               (CRYPT_PAYLOAD_INDEX - CRYPT_SESSION_INDEX) + len + CRYPT_MIC_SIZE);
+#ifndef RADIO_FIXED_LENGTH
+        frame[0] = CRYPT_PAYLOAD_INDEX - 1;
+#endif
+        return FALSE;
+    }
+
+    frame[CRYPT_MARKER_INDEX] = CRYPT_MARKER;
+    memcpy(frame + CRYPT_SESSION_INDEX, crypt_session, CRYPT_SESSION_SIZE);
+    frame[CRYPT_COUNTER_INDEX]     = (uint8)(crypt_counter >> 8);
+    frame[CRYPT_COUNTER_INDEX + 1] = (uint8)crypt_counter;
+    memset(payload + len, 0, blocks * CRYPT_BLOCK_SIZE - len);
+
+    crypt_load(ENCCS_CMD_LDKEY, crypt_key);
+
+    // CBC-MAC of B0 and the associated data, then on over the payload: T
+    crypt_nonce_block(crypt_block, CRYPT_CCM_FLAGS_B0, frame, len);
+    crypt_aad_block(crypt_block + CRYPT_BLOCK_SIZE, frame);
+    crypt_load(ENCCS_CMD_LDIV, NULL);
+    crypt_run(ENCCS_MODE_CBCMAC, crypt_block, crypt_block, 2);
+    if (blocks)
+    {
+        crypt_load(ENCCS_CMD_LDIV, crypt_block);
+        crypt_run(ENCCS_MODE_CBCMAC, payload, crypt_block, blocks);
+    }
+
+    // MIC: T encrypted with counter block A0. The payload with A1 on; the
+    // coprocessor counts the last bytes of the IV up from block to block.
+    crypt_nonce_block(crypt_block + CRYPT_BLOCK_SIZE, CRYPT_CCM_FLAGS_A, frame, 0);
+    crypt_load(ENCCS_CMD_LDIV, crypt_block + CRYPT_BLOCK_SIZE);
+    crypt_run(ENCCS_MODE_CTR, crypt_block, crypt_block, 1);
+    if (blocks)
+    {
+        crypt_block[2 * CRYPT_BLOCK_SIZE - 1] = 1;
+        crypt_load(ENCCS_CMD_LDIV, crypt_block + CRYPT_BLOCK_SIZE);
+        crypt_run(ENCCS_MODE_CTR, payload, payload, blocks);
+    }
+
+    memcpy(payload + len, crypt_block, CRYPT_MIC_SIZE);
+    return TRUE;
+}
+
+#endif /* RADIO_AES && !CRYPT_HOST */
+
+
+#ifdef CRYPT_HOST
+
+/*==== HOST SIDE =============================================================*/
+
+static const uint8_t crypt_sbox[256] = {
+    0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+    0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0, 0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+    0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+    0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+    0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0, 0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+    0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+    0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+    0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5, 0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+    0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+    0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+    0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C, 0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+    0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+    0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+    0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E, 0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+    0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+    0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16,
+};
+
+static inline uint8_t crypt_xtime(uint8_t x)
+{
+    return (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1B : 0x00));
+}
+
+// AES-128 encryption of one block (FIPS-197), round keys made on the fly.
+// 'in' and 'out' may be the same.
+static inline void crypt_aes(const uint8_t *key, const uint8_t *in, uint8_t *out)
+{
+    uint8_t rk[CRYPT_KEY_SIZE], s[CRYPT_BLOCK_SIZE], t[CRYPT_BLOCK_SIZE];
+    uint8_t rcon = 0x01, all;
+    int     round, i, c;
+
+    memcpy(rk, key, sizeof(rk));
+    for (i = 0; i < CRYPT_BLOCK_SIZE; i++)
+        s[i] = in[i] ^ rk[i];
+
+    for (round = 1; round <= 10; round++)
+    {
+        rk[0] ^= crypt_sbox[rk[13]] ^ rcon;
+        rk[1] ^= crypt_sbox[rk[14]];
+        rk[2] ^= crypt_sbox[rk[15]];
+        rk[3] ^= crypt_sbox[rk[12]];
+        for (i = 4; i < CRYPT_KEY_SIZE; i++)
+            rk[i] ^= rk[i - 4];
+        rcon = crypt_xtime(rcon);
+
+        // SubBytes and ShiftRows; byte i is row i % 4 of column i / 4
+        for (i = 0; i < CRYPT_BLOCK_SIZE; i++)
+            t[i] = crypt_sbox[s[(i + 4 * (i % 4)) % CRYPT_BLOCK_SIZE]];
+
+        if (round < 10)
+            for (c = 0; c < CRYPT_BLOCK_SIZE; c += 4)
+            {
+                uint8_t a0 = t[c], a1 = t[c + 1], a2 = t[c + 2], a3 = t[c + 3];
+
+                all = a0 ^ a1 ^ a2 ^ a3;
+                t[c]     = a0 ^ all ^ crypt_xtime(a0 ^ a1);
+                t[c + 1] = a1 ^ all ^ crypt_xtime(a1 ^ a2);
+                t[c + 2] = a2 ^ all ^ crypt_xtime(a2 ^ a3);
+                t[c + 3] = a3 ^ all ^ crypt_xtime(a3 ^ a0);
+            }
+
+        for (i = 0; i < CRYPT_BLOCK_SIZE; i++)
+            s[i] = t[i] ^ rk[i];
+    }
+    memcpy(out, s, CRYPT_BLOCK_SIZE);
+}
+
+// CCM MAC value T (all 16 bytes) of a frame with a plain 'len' byte payload
+static inline void crypt_ccm_mac(const uint8_t *key, const uint8_t *frame, size_t len, uint8_t *x)
+{
+    uint8_t b[CRYPT_BLOCK_SIZE];
+    size_t  i, j;
+
+    crypt_nonce_block(b, CRYPT_CCM_FLAGS_B0, frame, (uint16)len);
+    crypt_aes(key, b, x);
+    crypt_aad_block(b, frame);
+    for (j = 0; j < CRYPT_BLOCK_SIZE; j++)
+        x[j] ^= b[j];
+    crypt_aes(key, x, x);
+
+    for (i = 0; i < len; i += CRYPT_BLOCK_SIZE)
+    {
+        for (j = 0; j < CRYPT_BLOCK_SIZE && i + j < len; j++)
+            x[j] ^= frame[CRYPT_PAYLOAD_INDEX + i + j];
+        crypt_aes(key, x, x);
+    }
+}
+
+// CTR encryption of the payload in place, with counter blocks A1 on
+static inline void crypt_ccm_ctr(const uint8_t *key, uint8_t *frame, size_t len)
+{
+    uint8_t a[CRYPT_BLOCK_SIZE], s[CRYPT_BLOCK_SIZE];
+    size_t  i, j;
+
+    for (i = 0; i < len; i += CRYPT_BLOCK_SIZE)
+    {
+        crypt_nonce_block(a, CRYPT_CCM_FLAGS_A, frame, (uint16)(1 + i / CRYPT_BLOCK_SIZE));
+        crypt_aes(key, a, s);
+        for (j = 0; j < CRYPT_BLOCK_SIZE && i + j < len; j++)
+            frame[CRYPT_PAYLOAD_INDEX + i + j] ^= s[j];
+    }
+}
+
+// Check and decrypt the 'len' byte payload of a secured frame in place.
+// Returns false, with the frame as it was, if the MIC does not match.
+static inline bool crypt_ccm_open(const uint8_t *key, uint8_t *frame, size_t len)
+{
+    uint8_t a[CRYPT_BLOCK_SIZE], s0[CRYPT_BLOCK_SIZE], x[CRYPT_BLOCK_SIZE];
+    uint8_t diff = 0;
+    int     j;
+
+    crypt_ccm_ctr(key, frame, len);
+    crypt_ccm_mac(key, frame, len, x);
+    crypt_nonce_block(a, CRYPT_CCM_FLAGS_A, frame, 0);
+    crypt_aes(key, a, s0);
+    for (j = 0; j < CRYPT_MIC_SIZE; j++)
+        diff |= (uint8_t)(x[j] ^ s0[j] ^ frame[CRYPT_PAYLOAD_INDEX + len + j]);
+    if (diff)
+        crypt_ccm_ctr(key, frame, len);
+    return !diff;
+}
+
+// Key from 32 hex digits
+static inline bool crypt_parse_key(const char *hex, uint8_t *key)
+{
+    int i, hi, lo;
+
+    for (i = 0; i < CRYPT_KEY_SIZE; i++)
+    {
+        hi = hex[2 * i];
+        lo = hi ? hex[2 * i + 1] : 0;
+        if (!isxdigit(hi) || !isxdigit(lo))
+            return false;
+        hi = isdigit(hi) ? hi - '0' : (tolower(hi) - 'a' + 10);
+        lo = isdigit(lo) ? lo - '0' : (tolower(lo) - 'a' + 10);
+        key[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return hex[2 * CRYPT_KEY_SIZE] == 0;
+}
+
+#endif /* CRYPT_HOST */
+
+
+#endif /* SENSOR_CRYPT_H */
+
+/*==== END OF FILE ==========================================================*/
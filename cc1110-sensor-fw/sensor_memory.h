@@ -0,0 +1,58 @@
+#ifndef SENSOR_MEMORY_H
+#define SENSOR_MEMORY_H
+
+/*==== INCLUDES ==============================================================*/
+#include "types.h"
+#include "sensor_config.h"
+#include "cc1110_radio.h"
+#include "hal_adc_mgmt.h"
+#include "payload.h"
+#include "sensor_crypt.h"
+#include "device_identity.h"
+
+/*==== CONSTS ================================================================*/
+
+// Memory the linker is given, passed in by the Makefile (CODE_SIZE,
+// XRAM_SIZE) and wincompile.bat. Code stops short of the identity page; IRAM
+// (--model-small) is checked after linking, see 'make size'.
+#if !defined(MEMORY_CODE_SIZE) || !defined(MEMORY_XRAM_SIZE)
+#error "Define MEMORY_CODE_SIZE and MEMORY_XRAM_SIZE as the linker's --code-size and --xram-size"
+#endif
+
+#if MEMORY_CODE_SIZE > IDENTITY_PAGE_ADDR
+#error "The code would overlap the identity page"
+#endif
+
+// XRAM taken by the buffers whose size follows the build options, from the
+// largest down. The ADC burst alone is 384 bytes with ADC_OVERSAMPLE_BITS
+// = 3. The xdata scalars are left out: the sum is the least the options
+// need, the linker's --xram-size holds the whole image to MEMORY_XRAM_SIZE.
+#define MEMORY_XRAM_ADC         (ADC_BURST_LEN * 2)
+#define MEMORY_XRAM_BATCH       ((BATCH_SIZE + 1) * PAYLOAD_RECORD_SIZE)   // Ring + report_last
+#define MEMORY_XRAM_RADIO       (MAX_PACKET_SIZE + PACKET_HEADER_SIZE + ACK_FRAME_SIZE)
+#ifdef RADIO_AES
+#define MEMORY_XRAM_CRYPT       (CRYPT_SESSION_SIZE + 2 * CRYPT_BLOCK_SIZE)
+#else
+#define MEMORY_XRAM_CRYPT       0
+#endif
+#ifdef PAYLOAD_ASCII
+#define MEMORY_XRAM_FORMAT      24      // payload_format
+#else
+#define MEMORY_XRAM_FORMAT      0
+#endif
+
+// Fixed buffers: DMA descriptors of channels 1-4 and the PM2 errata code,
+// the ADC results and the flash word of the session counter
+#define MEMORY_XRAM_FIXED       (4 * 8 + 7 + 8 + 2 * ADC_SENSOR_COUNT + 2)
+
+#define MEMORY_XRAM_USED        (MEMORY_XRAM_ADC + MEMORY_XRAM_BATCH + MEMORY_XRAM_RADIO + \
+                                 MEMORY_XRAM_CRYPT + MEMORY_XRAM_FORMAT + MEMORY_XRAM_FIXED)
+
+#if MEMORY_XRAM_USED > MEMORY_XRAM_SIZE
+#error "The buffers for these build options do not fit in XRAM (MEMORY_XRAM_SIZE)"
+#endif
+
+
+#endif /* SENSOR_MEMORY_H */
+
+/*==== END OF FILE ==========================================================*/
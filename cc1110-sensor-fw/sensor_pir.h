@@ -0,0 +1,303 @@
+#ifndef SENSOR_PIR_H
+#define SENSOR_PIR_H
+
+/*==== INCLUDES ==============================================================*/
+#include "types.h"
+#include "cc1110.h"
+#include "ioCCxx10_bitdef.h"
+#include "sensor_config.h"
+#include "hal_adc_mgmt.h"
+#include "hal_power.h"
+#include "hal_timer.h"
+#include "payload.h"
+
+/*==== CONSTS ================================================================*/
+
+// PIR front end output on P0_0 / AIN0
+#define PIR_PIN_BM              PIN0
+
+// Motion detector (PIR_DSP). Samples are kept with PIR_DSP_FRAC_BITS
+// fractional bits. The band-pass is the difference of two first order
+// low-passes: a fast one against the ADC noise (time constant
+// 2^PIR_DSP_LP_SHIFT samples) and the baseline, which follows the slow drift
+// of the PIR output around mid-supply (2^PIR_DSP_BASE_SHIFT samples).
+#define PIR_DSP_FRAC_BITS       4
+#define PIR_DSP_LP_SHIFT        1
+#define PIR_DSP_BASE_SHIFT      6
+
+#if PIR_DSP_SAMPLES < 2 || PIR_DSP_SAMPLES > 255
+#error "PIR_DSP_SAMPLES must be between 2 and 255"
+#endif
+#if PIR_DSP_OFF_COUNTS > PIR_DSP_ON_COUNTS
+#error "PIR_DSP_OFF_COUNTS must not be above PIR_DSP_ON_COUNTS"
+#endif
+#if PIR_DSP_PERIOD_MS < 0 || PIR_DSP_PERIOD_MS > 255
+#error "PIR_DSP_PERIOD_MS must be between 0 and 255"
+#endif
+
+/*==== MACROS=================================================================*/
+
+// Whether this measurement runs the motion detector burst. With PIR_WAKE
+// only when the PIR woke us, while motion lasts so that its end is seen, and
+// once after power-on to settle the baseline.
+#ifdef PIR_WAKE
+#define PIR_DSP_DUE(motion_wake)    ((motion_wake) || pir_dsp_motion || !pir_dsp_valid)
+#else
+#define PIR_DSP_DUE(motion_wake)    TRUE
+#endif
+
+/*==== LOCAL VARIABLES =======================================================*/
+
+// Set from the Port 0 ISR when the PIR pin caused the wake-up
+static volatile uint8 pir_wake_pending = FALSE;
+
+// Timer wakes left before the PIR interrupt is armed again after a motion report
+static uint8 xdata pir_holdoff = 0;
+
+#ifdef PIR_DSP
+// Detector state, retained in XRAM across PM2 so the filters carry on from
+// one burst to the next
+static int16  xdata pir_dsp_lp;             // Low-pass, counts << PIR_DSP_FRAC_BITS
+static int16  xdata pir_dsp_base;           // Baseline, counts << PIR_DSP_FRAC_BITS
+static int16  xdata pir_dsp_prev_min;       // Band-pass extremes of the last burst
+static int16  xdata pir_dsp_prev_max;
+static uint8  xdata pir_dsp_valid  = FALSE; // Filters hold a sample
+static uint8  xdata pir_dsp_motion = FALSE;
+static uint16 xdata pir_dsp_events = 0;     // Motion events since power-on
+#endif
+
+
+/*==== ISR ===================================================================*/
+
+/******************************************************************************
+* @fn  port0_isr
+*
+* @brief
+*      Port 0 input interrupt. PICTL.P0IENL enables P0_0 to P0_3 as a group,
+*      so only an edge on the PIR pin counts as a motion wake-up. Like the
+*      sleep timer ISR, SLEEP.MODE is cleared in case the interrupt fires
+*      before PM2/PM3 has actually been entered, but only for the PIR pin:
+*      a stray flag from another pin of the group is cleared and the SoC
+*      goes back to sleep.
+*
+******************************************************************************/
+INTERRUPT(port0_isr, P0INT_VECTOR)
+{
+    if (P0IFG & PIR_PIN_BM)
+    {
+        pir_wake_pending = TRUE;
+
+        // One report per motion burst: stay quiet until the hold-off expires
+        P0IE = 0;
+
+        SLEEP &= ~SLEEP_MODE;
+    }
+
+    // Module flags first, then the CPU flag
+    P0IFG = 0;
+    P0IF = 0;
+}
+
+
+/*==== FUNCTIONS =============================================================*/
+
+/******************************************************************************
+* @fn  pirWakeInit
+*
+* @brief
+*      Configure P0_0 as a tri-state GPIO input (still usable as AIN0) and
+*      enable its interrupt as a wake-up source from PM2/PM3. The pin must
+*      see a digital level: an external comparator or a PIR with a digital
+*      output (see PIR_WAKE in sensor_config.h). Such an output drives the
+*      pin and sits low without motion, so the pull-up Port 0 pins have from
+*      reset (P0INP = 0) would draw current through it all through PM2/PM3;
+*      it is switched off. P0_1 shares the P0IENL group but stays an analog
+*      input (ADC_ANALOG_PINS_BM), so its buffer cannot raise the interrupt.
+*
+******************************************************************************/
+void pirWakeInit(void)
+{
+    P0SEL &= ~PIR_PIN_BM;
+    P0DIR &= ~PIR_PIN_BM;
+    P0INP |= PIR_PIN_BM;                // Tri-state, no pull
+
+#if PIR_WAKE_EDGE_FALLING
+    PICTL |= PICTL_P0ICON;
+#else
+    PICTL &= ~PICTL_P0ICON;
+#endif
+    PICTL |= PICTL_P0IENL;
+
+    P0IFG = 0;
+    P0IF = 0;
+    P0IE = 1;
+}
+
+
+/******************************************************************************
+* @fn  pirWakeTimerTick
+*
+* @brief
+*      Call on every sleep timer wake. Re-arms the PIR interrupt once the
+*      hold-off after a motion report has run out.
+*
+******************************************************************************/
+void pirWakeTimerTick(void)
+{
+    if (pir_holdoff)
+        pir_holdoff--;
+
+    if (!pir_holdoff && !P0IE)
+    {
+        P0IFG = 0;
+        P0IF = 0;
+        P0IE = 1;
+    }
+}
+
+
+/******************************************************************************
+* @fn  pirWakeTaken
+*
+* @brief
+*      Check and clear the PIR wake-up flag. After a motion wake-up the PIR
+*      interrupt stays disabled for 'holdoff' sleep timer wakes (see
+*      pirWakeTimerTick()), or is re-armed straight away when 'holdoff' is 0.
+*
+* @return uint8
+*          TRUE if motion woke the device since the last call.
+*
+******************************************************************************/
+uint8 pirWakeTaken(uint8 holdoff)
+{
+    uint8 pending;
+
+    EA = 0;
+    pending = pir_wake_pending;
+    pir_wake_pending = FALSE;
+    EA = 1;
+
+    if (pending)
+    {
+        pir_holdoff = holdoff;
+        if (!holdoff)
+            pirWakeTimerTick();
+    }
+
+    return pending;
+}
+
+
+#ifdef PIR_DSP
+/******************************************************************************
+* @fn  pirDspMeasure
+*
+* @brief
+*      Motion detector. Converts AIN0 PIR_DSP_SAMPLES times, PIR_DSP_PERIOD_MS
+*      apart (back to back when 0), with the CPU idle between and during the
+*      conversions. Each sample goes through the low-pass and the baseline
+*      tracker; their difference, the band-passed PIR signal, is tracked for
+*      its extremes.
+*      The peak-to-peak swing over this burst and the last one then switches
+*      the motion state with hysteresis (PIR_DSP_ON_COUNTS/OFF_COUNTS), and
+*      every start of motion counts as an event.
+*
+*      Timer 3 and CLKCON.TICKSPD are restored to idle afterwards, so
+*      send_packet() finds them as it expects. Runs on the HS RCOSC.
+*
+* @return uint8
+*          TRUE if motion started with this burst.
+*
+******************************************************************************/
+uint8 pirDspMeasure(void)
+{
+#if PIR_DSP_PERIOD_MS
+    uint16 due = 0;
+#endif
+    int16  x;
+    int16  bp;
+    int16  bp_min = 0x7FFF;
+    int16  bp_max = -0x7FFF;
+    int16  p2p;
+    uint8  n;
+    uint8  onset = FALSE;
+
+    ADC_ENABLE_CHANNEL(ADC_AIN0);
+
+#if PIR_DSP_PERIOD_MS
+    // 1 ms sample clock
+    halTimerStart(HAL_TIMER_MS);
+#endif
+
+    for (n = 0; n < PIR_DSP_SAMPLES; n++)
+    {
+#if PIR_DSP_PERIOD_MS
+        HAL_IDLE_UNTIL(halTimerTicks >= due);
+        due += PIR_DSP_PERIOD_MS;
+#endif
+
+        // Leftbound 10 bit result, see halAdcSampleSingle()
+        x = (halAdcConvertIdle(ADC_REF_AVDD | ADC_10_BIT | ADC_AIN0) >> 6) << PIR_DSP_FRAC_BITS;
+
+        if (!pir_dsp_valid)
+        {
+            pir_dsp_lp = x;
+            pir_dsp_base = x;
+            pir_dsp_prev_min = 0;
+            pir_dsp_prev_max = 0;
+            pir_dsp_valid = TRUE;
+        }
+        pir_dsp_lp += (x - pir_dsp_lp) >> PIR_DSP_LP_SHIFT;
+        pir_dsp_base += (pir_dsp_lp - pir_dsp_base) >> PIR_DSP_BASE_SHIFT;
+        bp = pir_dsp_lp - pir_dsp_base;
+
+        if (bp < bp_min)
+            bp_min = bp;
+        if (bp > bp_max)
+            bp_max = bp;
+    }
+
+#if PIR_DSP_PERIOD_MS
+    halTimerStop();
+#endif
+    ADC_DISABLE_CHANNEL(ADC_AIN0);
+
+    // Swing over the last two bursts, so a slow movement that turns between
+    // them is not lost
+    p2p = ((bp_max > pir_dsp_prev_max ? bp_max : pir_dsp_prev_max) -
+           (bp_min < pir_dsp_prev_min ? bp_min : pir_dsp_prev_min)) >> PIR_DSP_FRAC_BITS;
+    pir_dsp_prev_min = bp_min;
+    pir_dsp_prev_max = bp_max;
+
+    if (!pir_dsp_motion && p2p > PIR_DSP_ON_COUNTS)
+    {
+        pir_dsp_motion = TRUE;
+        pir_dsp_events++;
+        onset = TRUE;
+    }
+    else if (pir_dsp_motion && p2p < PIR_DSP_OFF_COUNTS)
+        pir_dsp_motion = FALSE;
+
+    return onset;
+}
+
+
+/******************************************************************************
+* @fn  pirDspReading
+*
+* @brief
+*      Motion detector output for the AIN0 field of the payload, see
+*      PAYLOAD_FLAG_PIR_DSP.
+*
+******************************************************************************/
+int16 pirDspReading(void)
+{
+    return (int16)((pir_dsp_motion ? PAYLOAD_PIR_MOTION : 0) |
+                   (pir_dsp_events & PAYLOAD_PIR_EVENTS_MASK));
+}
+#endif
+
+
+#endif /* SENSOR_PIR_H */
+
+/*==== END OF FILE ==========================================================*/
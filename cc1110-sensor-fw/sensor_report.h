@@ -0,0 +1,149 @@
+#ifndef SENSOR_REPORT_H
+#define SENSOR_REPORT_H
+
+/*==== INCLUDES ==============================================================*/
+#include "types.h"
+#include "sensor_config.h"
+#include "hal_adc_mgmt.h"
+#include "payload.h"
+
+/*==== CONSTS ================================================================*/
+
+// Deadbands of the sensor channels in payload units. The thermopile and
+// thermistor deadbands are given in 10 bit counts and scaled to the
+// oversampled resolution.
+#define REPORT_DEADBAND_AIN1    (REPORT_DEADBAND_THERMOPILE << ADC_SENSOR_EXTRA_BITS)
+#define REPORT_DEADBAND_AIN6    (REPORT_DEADBAND_THERMISTOR << ADC_SENSOR_EXTRA_BITS)
+
+// The motion detector output (PIR_DSP) only changes on motion events and
+// the end of motion, all of which are reported
+#ifdef PIR_DSP
+#define REPORT_DEADBAND_AIN0    0
+#else
+#define REPORT_DEADBAND_AIN0    REPORT_DEADBAND_PIR
+#endif
+
+
+/*==== LOCAL VARIABLES =======================================================*/
+
+#ifdef REPORT_ON_CHANGE
+static const int16 report_deadband[PAYLOAD_ADC_CHANNELS] = {
+    REPORT_DEADBAND_AIN0, REPORT_DEADBAND_AIN1, REPORT_DEADBAND_AIN6
+};
+
+// Last reading that was reported, retained in XRAM across PM2
+static PAYLOAD_RECORD xdata report_last;
+static uint8  xdata report_valid = FALSE;    // report_last holds a reading
+
+// Reports skipped since the last one that went out (for the heartbeat)
+static uint16 xdata report_skipped = 0;
+#endif
+
+
+/*==== FUNCTIONS =============================================================*/
+
+#ifdef REPORT_ON_CHANGE
+/******************************************************************************
+* @fn  report_exceeds
+*
+* @brief
+*      TRUE if 'value' is more than 'deadband' away from 'last'.
+*
+******************************************************************************/
+static uint8 report_exceeds(int16 value, int16 last, int16 deadband)
+{
+    int16 diff = value - last;
+
+    if (diff < 0)
+        diff = -diff;
+    return diff > deadband;
+}
+#endif
+
+
+/******************************************************************************
+* @fn  reportCertain
+*
+* @brief
+*      TRUE if reportDue() is known to accept the coming reading before it has
+*      been taken: always without REPORT_ON_CHANGE, else only when forced.
+*
+******************************************************************************/
+uint8 reportCertain(uint8 force)
+{
+#ifdef REPORT_ON_CHANGE
+    return force;
+#else
+    (void)force;
+    return TRUE;
+#endif
+}
+
+
+/******************************************************************************
+* @fn  reportDue
+*
+* @brief
+*      Report-on-change filter. Decides whether a new reading is worth sending
+*      (see REPORT_ON_CHANGE): it is when any channel moved out of its
+*      deadband around the last reported value, when REPORT_HEARTBEAT reports
+*      in a row have been skipped, or when 'force' is set. The reading then
+*      becomes the new reference. Without REPORT_ON_CHANGE every reading is due.
+*
+* Parameters:
+*
+* @param int16 battery
+*          Battery voltage * 10
+*        int16 xdata *adc
+*          PAYLOAD_ADC_CHANNELS sensor readings
+*        uint8 force
+*          Report regardless of the deadbands (e.g. motion wake-up)
+*
+* @return uint8
+*          TRUE if the reading should be queued for transmission.
+*
+******************************************************************************/
+uint8 reportDue(int16 battery, int16 xdata *adc, uint8 force)
+{
+#ifdef REPORT_ON_CHANGE
+    uint8 i;
+    uint8 due = force || !report_valid;
+
+#if REPORT_HEARTBEAT
+    if (report_skipped >= REPORT_HEARTBEAT - 1)
+        due = TRUE;
+#endif
+
+    if (!due && report_exceeds(battery, report_last.battery, REPORT_DEADBAND_BATTERY))
+        due = TRUE;
+
+    for (i = 0; !due && i < PAYLOAD_ADC_CHANNELS; i++)
+    {
+        if (report_exceeds(adc[i], report_last.adc[i], report_deadband[i]))
+            due = TRUE;
+    }
+
+    if (!due)
+    {
+        report_skipped++;
+        return FALSE;
+    }
+
+    report_last.battery = battery;
+    for (i = 0; i < PAYLOAD_ADC_CHANNELS; i++)
+        report_last.adc[i] = adc[i];
+    report_valid   = TRUE;
+    report_skipped = 0;
+#else
+    (void)battery;
+    (void)adc;
+    (void)force;
+#endif
+
+    return TRUE;
+}
+
+
+#endif /* SENSOR_REPORT_H */
+
+/*==== END OF FILE ==========================================================*/
@@ -0,0 +1,312 @@
+/***********************************************************************************
+* ENERGY MODEL
+*
+* Turns the power state log of a simulation run (sensor-sim -l) into charge
+* and energy per report, and projects the battery life for a sleep interval.
+* Built and run by 'make energy'.
+*
+*   sensor-energy [-V volts] [-b mAh] [-i seconds] [-m max_uJ] [-a max_ms]
+*                 [-c NAME=mA]... states.csv
+*
+*   -V  Supply voltage (default 3.0)
+*   -b  Battery capacity in mAh (default 2500, two AA cells)
+*   -i  Sleep interval to project for, seconds (default: as simulated)
+*   -m  Exit with status 1 if the energy per report exceeds max_uJ
+*   -a  Exit with status 1 if the time awake with the radio idle exceeds
+*       max_ms per wake-up: the CPU and ADC work of a wake, whether or not
+*       it sends a report
+*   -c  Override a current from the table below, e.g. -c pm2=0.0009
+*
+* The exit status is 2 for bad arguments or an unreadable log.
+*
+* Each state log row is one interval with a constant chip state. Its current
+* is the sum of a CPU part (by power mode and clock source), the HS XOSC if it
+* runs while the CPU is on the HS RCOSC, the radio part and the ADC. The
+* radio parts are the datasheet figures with the CPU idle on the HS XOSC,
+* less that idle current.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "sim.h"
+
+/*==== CONSTS ================================================================*/
+
+// Typical currents in mA at 3 V and 25 C from the CC1110Fx datasheet
+// (SWRS033), 868 MHz band. Board leakage and the sensor front ends are not
+// included: measure the board in PM2 and pass it with -c pm2=...
+static struct {
+    const char *name;
+    double      ma;
+} currents[] = {
+    { "active_rcosc",   1.8    },   // CPU running, 13 MHz HS RCOSC
+    { "idle_rcosc",     0.9    },   // PCON.IDLE, HS RCOSC
+    { "active_xosc",    5.1    },   // CPU running, 26 MHz HS XOSC
+    { "idle_xosc",      3.4    },   // PCON.IDLE, HS XOSC
+    { "xosc",           0.5    },   // HS XOSC starting/running beside the RCOSC
+    { "pm1",            0.2    },
+    { "pm2",            0.0005 },   // Sleep timer on
+    { "pm3",            0.0003 },
+    { "fs",             7.4    },   // Calibration and synthesizer settling
+    { "rx",             16.2   },   // 1.2 kBaud, sensitivity optimised
+    { "adc",            1.2    },   // ADC converting
+};
+
+enum {
+    I_ACTIVE_RCOSC, I_IDLE_RCOSC, I_ACTIVE_XOSC, I_IDLE_XOSC, I_XOSC,
+    I_PM1, I_PM2, I_PM3, I_FS, I_RX, I_ADC, I_COUNT
+};
+
+#define CURRENT(i)      (currents[i].ma * 1e-3)
+
+// TX current by PA_TABLE0 setting (868 MHz, mA), CPU idle on the HS XOSC.
+// Settings not listed are charged as the strongest one.
+static const struct {
+    uint8_t pa;
+    double  dbm;
+    double  ma;
+} tx_currents[] = {
+    { 0x03, -30, 12.1 },
+    { 0x0E, -20, 12.5 },
+    { 0x1D, -15, 13.3 },
+    { 0x34, -10, 14.4 },
+    { 0x60,  -5, 14.9 },
+    { 0x50,   0, 16.4 },
+    { 0x85,   5, 19.2 },
+    { 0xCB,   7, 24.8 },
+    { 0xC2,  10, 31.1 },
+};
+
+#define TX_CURRENTS     (sizeof(tx_currents) / sizeof(tx_currents[0]))
+#define CURRENT_NAMES   (sizeof(currents) / sizeof(currents[0]))
+
+
+/*==== TYPES =================================================================*/
+
+// One state log row
+struct EnergyRow {
+    double t, duration;
+    int    cpu, radio, xosc, adc, cpu_xosc, pa;
+};
+
+
+/*==== LOCAL FUNCTIONS =======================================================*/
+
+static void usage(void)
+{
+    size_t i;
+
+    fprintf(stderr,
+        "usage: sensor-energy [-V volts] [-b mAh] [-i seconds] [-m max_uJ] [-a max_ms]\n"
+        "                     [-c NAME=mA]... states.csv\n"
+        "NAME is one of");
+    for (i = 0; i < CURRENT_NAMES; i++)
+        fprintf(stderr, " %s", currents[i].name);
+    fprintf(stderr, "\n");
+    exit(2);
+}
+
+// "pm2=0.0009"
+static void parse_current(const char *arg)
+{
+    const char *eq = strchr(arg, '=');
+    size_t      i;
+
+    if (!eq)
+        usage();
+    for (i = 0; i < CURRENT_NAMES; i++)
+        if (strlen(currents[i].name) == (size_t)(eq - arg) &&
+            !strncmp(arg, currents[i].name, eq - arg))
+            break;
+    if (i == CURRENT_NAMES)
+        usage();
+    currents[i].ma = atof(eq + 1);
+}
+
+// Table entry for a PA_TABLE0 setting
+static size_t tx_entry(uint8_t pa)
+{
+    size_t i;
+
+    for (i = 0; i < TX_CURRENTS; i++)
+        if (tx_currents[i].pa == pa)
+            return i;
+    return TX_CURRENTS - 1;
+}
+
+// Chip current in one state (A)
+static double row_current(const EnergyRow &r)
+{
+    double i = 0;
+
+    switch (r.cpu)
+    {
+    case SIM_CPU_ACTIVE: i = CURRENT(r.cpu_xosc ? I_ACTIVE_XOSC : I_ACTIVE_RCOSC); break;
+    case SIM_CPU_IDLE:   i = CURRENT(r.cpu_xosc ? I_IDLE_XOSC : I_IDLE_RCOSC);     break;
+    case SIM_CPU_PM1:    i = CURRENT(I_PM1);                                         break;
+    case SIM_CPU_PM2:    i = CURRENT(I_PM2);                                         break;
+    case SIM_CPU_PM3:    i = CURRENT(I_PM3);                                         break;
+    }
+    if (r.xosc && !r.cpu_xosc)
+        i += CURRENT(I_XOSC);
+
+    switch (r.radio)
+    {
+    case SIM_RADIO_FS: i += CURRENT(I_FS) - CURRENT(I_IDLE_XOSC);                      break;
+    case SIM_RADIO_RX: i += CURRENT(I_RX) - CURRENT(I_IDLE_XOSC);                      break;
+    case SIM_RADIO_TX: i += tx_currents[tx_entry(r.pa)].ma * 1e-3 - CURRENT(I_IDLE_XOSC); break;
+    }
+    if (r.adc)
+        i += CURRENT(I_ADC);
+
+    return i;
+}
+
+static bool awake(int cpu)
+{
+    return cpu == SIM_CPU_ACTIVE || cpu == SIM_CPU_IDLE;
+}
+
+static std::vector<EnergyRow> read_log(const char *path)
+{
+    std::vector<EnergyRow> rows;
+    EnergyRow r;
+    char      line[256];
+    FILE     *f = fopen(path, "r");
+
+    if (!f)
+    {
+        fprintf(stderr, "sensor-energy: cannot read %s\n", path);
+        exit(2);
+    }
+    if (!fgets(line, sizeof(line), f) || strncmp(line, "t,duration,cpu,radio,xosc,adc,cpu_xosc,pa", 41))
+    {
+        fprintf(stderr, "sensor-energy: %s is not a sensor-sim state log\n", path);
+        exit(2);
+    }
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "%lf,%lf,%d,%d,%d,%d,%d,%d", &r.t, &r.duration, &r.cpu, &r.radio,
+                   &r.xosc, &r.adc, &r.cpu_xosc, &r.pa) == 8)
+            rows.push_back(r);
+    fclose(f);
+    return rows;
+}
+
+
+/*==== FUNCTIONS =============================================================*/
+
+int main(int argc, char **argv)
+{
+    double  volts = 3.0, capacity = 2500, interval = 0, max_uj = 0, max_ms = 0;
+    double  q_awake = 0, q_sleep = 0, t_awake = 0, t_sleep = 0, t_quiet = 0;
+    double  q_radio = 0, q_cpu_xosc = 0, q_adc = 0;
+    double  q_wake, t_wake, i_sleep, reports_per_wake, i_avg, uj_report;
+    int     wakes = 0, reports = 0, last_cpu = -1, last_radio = -1;
+    uint8_t pa = 0;
+    int     opt;
+
+    while ((opt = getopt(argc, argv, "V:b:i:m:a:c:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'V': volts = atof(optarg);     break;
+        case 'b': capacity = atof(optarg);  break;
+        case 'i': interval = atof(optarg);  break;
+        case 'm': max_uj = atof(optarg);    break;
+        case 'a': max_ms = atof(optarg);    break;
+        case 'c': parse_current(optarg);    break;
+        default:  usage();
+        }
+    }
+    if (optind != argc - 1 || volts <= 0 || capacity <= 0 || interval < 0)
+        usage();
+
+    std::vector<EnergyRow> rows = read_log(argv[optind]);
+
+    for (const EnergyRow &r : rows)
+    {
+        double q = row_current(r) * r.duration;
+
+        if (awake(r.cpu))
+        {
+            if (!awake(last_cpu))
+                wakes++;
+            q_awake += q;
+            t_awake += r.duration;
+            if (r.radio == SIM_RADIO_IDLE)
+                t_quiet += r.duration;
+            if (r.cpu_xosc)
+                q_cpu_xosc += q;
+        }
+        else
+        {
+            q_sleep += q;
+            t_sleep += r.duration;
+        }
+        if (r.radio == SIM_RADIO_TX)
+        {
+            if (last_radio != SIM_RADIO_TX)
+                reports++;
+            pa = r.pa;
+        }
+        if (r.radio != SIM_RADIO_IDLE)
+            q_radio += q;
+        if (r.adc)
+            q_adc += CURRENT(I_ADC) * r.duration;
+        last_cpu = r.cpu;
+        last_radio = r.radio;
+    }
+    if (!wakes || !reports)
+    {
+        fprintf(stderr, "sensor-energy: no %s in the log, run the simulation for longer\n",
+                wakes ? "reports" : "wake-ups");
+        return 2;
+    }
+
+    // Per wake cycle as simulated; the sleep current is the average over the
+    // sleeping time, so it carries PM2 vs PM3 as the firmware chose
+    q_wake = q_awake / wakes;
+    t_wake = t_awake / wakes;
+    i_sleep = t_sleep > 0 ? q_sleep / t_sleep : CURRENT(I_PM2);
+    reports_per_wake = (double)reports / wakes;
+    if (interval == 0)
+        interval = (t_awake + t_sleep) / wakes;
+    if (interval < t_wake)
+        interval = t_wake;
+
+    i_avg = (q_wake + i_sleep * (interval - t_wake)) / interval;
+    uj_report = i_avg * interval * volts * 1e6 / reports_per_wake;
+
+    printf("Wake-ups              %10d\n", wakes);
+    printf("Reports               %10d   TX at PA_TABLE0 0x%02X, %+g dBm\n",
+           reports, pa, tx_currents[tx_entry(pa)].dbm);
+    printf("Awake per wake-up     %10.3f ms   (radio idle %.3f)\n", t_wake * 1e3, t_quiet * 1e3 / wakes);
+    printf("Charge per wake-up    %10.3f uC   (radio on %.3f, on HS XOSC %.3f, ADC %.3f)\n",
+           q_wake * 1e6, q_radio * 1e6 / wakes, q_cpu_xosc * 1e6 / wakes, q_adc * 1e6 / wakes);
+    printf("Sleep current         %10.3f uA\n", i_sleep * 1e6);
+    printf("Awake energy/report   %10.3f uJ\n", q_awake * volts * 1e6 / reports);
+    printf("Interval              %10.3f s\n", interval);
+    printf("Energy per report     %10.3f uJ   (awake and sleep)\n", uj_report);
+    printf("Average current       %10.3f uA\n", i_avg * 1e6);
+    printf("Battery life          %10.1f days on %g mAh\n", capacity * 1e-3 / i_avg / 24, capacity);
+
+    if (max_uj > 0 && uj_report > max_uj)
+    {
+        fprintf(stderr, "sensor-energy: %.3f uJ per report exceeds the %.3f uJ budget\n", uj_report, max_uj);
+        return 1;
+    }
+    if (max_ms > 0 && t_quiet * 1e3 / wakes > max_ms)
+    {
+        fprintf(stderr, "sensor-energy: %.3f ms awake with the radio idle per wake-up exceeds the %.3f ms budget\n",
+                t_quiet * 1e3 / wakes, max_ms);
+        return 1;
+    }
+    return 0;
+}
+
+/*==== END OF FILE ==========================================================*/
@@ -0,0 +1,121 @@
+#ifndef SIM_H
+#define SIM_H
+
+/***********************************************************************************
+* HOST SIMULATION - CONTROL INTERFACE
+*
+* Used by the simulator front end (sim_main.cpp), not by the firmware. The
+* firmware only sees the register file through sim_hal.h.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*==== CONSTS ================================================================*/
+
+// Analog inputs that can be scripted (millivolts)
+enum SimInput {
+    SIM_IN_AIN0 = 0,        // AIN0..AIN7 = 0..7
+    SIM_IN_VDD  = 8,        // Supply voltage
+    SIM_IN_TEMP = 9,        // Internal temperature sensor output
+    SIM_IN_COUNT
+};
+
+// CPU power state, as accounted in the state log
+enum SimCpuState {
+    SIM_CPU_ACTIVE = 0,
+    SIM_CPU_IDLE,
+    SIM_CPU_PM1,
+    SIM_CPU_PM2,
+    SIM_CPU_PM3,
+    SIM_CPU_STATES
+};
+
+// Radio state, as accounted in the state log
+enum SimRadioState {
+    SIM_RADIO_IDLE = 0,
+    SIM_RADIO_FS,           // Calibration / synthesizer settling
+    SIM_RADIO_TX,
+    SIM_RADIO_RX,
+    SIM_RADIO_STATES
+};
+
+
+/*==== TYPES =================================================================*/
+
+struct SimConfig {
+    double      duration;       // Simulated seconds to run
+    const char *state_log;      // CSV of power state intervals, or NULL
+    bool        verbose;        // Print one line per wake-up
+    uint32_t    seed;           // Noise generator seed
+};
+
+// Thrown from the simulator to end the firmware's main loop
+struct SimStop {
+    std::string why;
+    bool        error;
+};
+
+// A packet as it went on air
+struct SimPacket {
+    double               t;         // Start of transmission
+    double               airtime;   // Preamble to CRC
+    std::vector<uint8_t> data;      // Length byte (if any) and payload, no CRC
+};
+
+// Time spent per state, totals or per wake-up
+struct SimStats {
+    double   cpu[SIM_CPU_STATES];
+    double   cpu_xosc;              // Active or idle with the HS XOSC as clock
+    double   xosc_on;               // HS XOSC powered (running or starting up)
+    double   radio[SIM_RADIO_STATES];
+    double   adc;                   // ADC converting
+    uint32_t accesses;              // CPU register accesses
+    uint32_t packets;
+    uint32_t wakes;
+};
+
+
+/*==== FUNCTIONS =============================================================*/
+
+// The firmware's main() (see sim_hal.h)
+void   sim_firmware_main(void);
+
+void   sim_init(const SimConfig &cfg);
+double sim_now(void);
+
+// Run 'fn' at simulated time 't' (seconds since reset)
+void   sim_at(double t, std::function<void()> fn);
+
+// Scripted inputs
+void   sim_set_input(int input, double mv);
+void   sim_set_noise(double mv);
+void   sim_pir_edge(void);
+void   sim_pir_motion(double seconds);  // AIN0 swings as a PIR output does
+
+// Program flash, erased (0xFF) by sim_init(); e.g. a device identity record
+void   sim_flash_write(uint16_t addr, const uint8_t *data, size_t len);
+
+// A frame from another radio (length byte first, no CRC) starts on air now.
+// The firmware receives it if the radio is in RX when its sync word is
+// complete and the address check passes.
+void   sim_air_frame(const std::vector<uint8_t> &frame);
+
+// Another radio transmits for 'seconds' from now, to someone else: the
+// channel is busy for clear channel assessment (MCSM1.CCA_MODE)
+void   sim_air_busy(double seconds);
+
+// Called for every transmitted packet
+void   sim_on_packet(std::function<void(const SimPacket &)> fn);
+
+// Totals so far, and the final report
+const SimStats &sim_totals(void);
+void   sim_report(FILE *out);
+
+
+#endif /* SIM_H */
+
+/*==== END OF FILE ==========================================================*/
@@ -0,0 +1,1879 @@
+/***********************************************************************************
+* HOST SIMULATION - SIMULATED CC1110
+*
+* The register file behind sim_hal.h. Time advances with every register access
+* the firmware makes (SIM_CYCLES_PER_ACCESS cycles at the current system
+* clock) and jumps ahead while the CPU is in idle mode or a power mode. C code
+* between register accesses takes no simulated time, so figures are a lower
+* bound on CPU time but exact for everything the peripherals do: oscillator
+* start-up, ADC conversions, DMA, Timer 3, the sleep timer and radio air time.
+*
+* Modelled:
+*   - CPU power states (active, idle, PM1-PM3) and the interrupt controller,
+*     including the one instruction hold-off after a write to IEN0
+*   - HS RCOSC / HS XOSC power-up, stability flags and clock source switching
+*   - Sleep timer (WORTIME, EVENT0 with WOR_RES prescaling, reset on EVENT0)
+*   - ADC extra conversions and sequences (ST triggered or full speed), with
+*     scripted inputs in millivolts and optional Gaussian noise
+*   - DMA channels 0-4: VLEN, single/block/repeated modes, word transfers,
+*     manual, radio, ADC, AES and flash triggers, DMAIRQ and DMAIF
+*   - Timer 3 free-running/modulo overflow
+*   - Port 0 edge interrupts (PIR on P0_0)
+*   - Flash contents, as read by the firmware, and word writes through
+*     FCTL.WRITE with their data from FWDATA (one FLASH DMA trigger per
+*     byte), SIM_FLASH_WORD_TIME each, clearing bits only. FWT must match
+*     the system clock. Page erase is not modelled.
+*   - Radio state machine: calibration, settling, preamble and sync, one
+*     byte request per byte time through RFTXRXIF/DMA, TX underflow, CRC and
+*     TXOFF_MODE, with every transmitted packet handed to sim_on_packet()
+*   - Radio reception of frames put on air by the front end (sim_air_frame()):
+*     sync word (RFIF.IRQ_SFD), address check, bytes through RFD and
+*     RFTXRXIF/DMA, appended status bytes and RXOFF_MODE (no RX overflow)
+*   - Clear channel assessment: the channel is busy while a frame from the
+*     front end or another radio (sim_air_busy()) is on air, which gates STX
+*     in RX as MCSM1.CCA_MODE says and shows in PKTSTATUS (CS, CCA, SFD).
+*     The RSSI is taken as valid as soon as the radio is in RX, and reads as
+*     noise around SIM_RADIO_NOISE_RSSI there.
+*   - AES coprocessor: key and IV loads, then one block per ENCCS.ST in ECB,
+*     CBC, CBC-MAC (no output) or CTR mode, SIM_AES_CYCLES per block, with
+*     ENC_DW/ENC_UP DMA triggers of one byte each, ENCCS.RDY and ENCIF. The
+*     CTR counter is the whole IV, counted up big-endian.
+*
+* Anything the firmware does that would not work on the chip (radio strobed
+* without the HS XOSC, enabled interrupt without an ISR, never sleeping)
+* ends the run with an error.
+*/
+
+#include "sim.h"
+#include "sim_hal.h"
+#include "ioCCxx10_bitdef.h"
+
+#define CRYPT_HOST
+#include "sensor_crypt.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <string.h>
+#include <algorithm>
+#include <queue>
+#include <random>
+
+/*==== CONSTS ================================================================*/
+
+#define SIM_XOSC_HZ             26000000.0
+#define SIM_RCOSC_HZ            13000000.0
+#define SIM_32K_HZ              32768.0
+
+#define SIM_FLASH_SIZE          0x8000      // CC1110F32
+#define SIM_FLASH_WORD_TIME     20e-6       // Programming one 16 bit word
+
+#define SIM_XOSC_STARTUP        300e-6      // HS XOSC power-up to XOSC_STB
+#define SIM_RCOSC_STARTUP       10e-6       // HS RCOSC power-up to HFRC_STB
+#define SIM_CLK_SWITCH_CYCLES   64          // CLKCON.OSC change, once stable
+
+#define SIM_CYCLES_PER_ACCESS   3           // One MOV to/from an SFR or xdata register
+#define SIM_ISR_CYCLES          12          // Vectoring, context save and RETI
+#define SIM_DMA_CYCLES          2           // Per byte/word moved by the DMA
+
+#define SIM_RADIO_CAL           721e-6      // FS calibration (MCSM0.FS_AUTOCAL)
+#define SIM_RADIO_SETTLE        88e-6       // Synthesizer settling, IDLE to TX/RX
+#define SIM_RADIO_RX_RSSI       0x40        // Status bytes appended to received frames
+#define SIM_RADIO_RX_LQI        0x10
+#define SIM_RADIO_NOISE_RSSI    0xC8        // RSSI on a quiet channel, about -102 dBm
+
+#define SIM_AES_CYCLES          128         // One block through the AES core, assumed
+
+#define SIM_PIR_PULSE           0.1         // Width of a scripted PIR pulse
+#define SIM_PIR_SWING_MV        300.0       // Scripted PIR motion on AIN0: amplitude,
+#define SIM_PIR_SWING_HZ        1.0         // frequency
+#define SIM_PIR_SWING_STEP      1e-3        // and update interval
+
+// The CPU must enter a power mode at least this often, otherwise it is stuck
+#define SIM_AWAKE_LIMIT         5.0
+
+// Firmware objects given to the DMA are mapped into xdata windows
+#define SIM_XWIN_BASE           0x1000
+#define SIM_XWIN_SIZE           0x0400
+#define SIM_XWIN_END            0xDF00
+
+// SFRs with side effects
+#define R_P0        0x80
+#define R_PCON      0x87
+#define R_TCON      0x88
+#define R_P0IFG     0x89
+#define R_PICTL     0x8C
+#define R_RFIM      0x91
+#define R_S0CON     0x98
+#define R_IEN2      0x9A
+#define R_S1CON     0x9B
+#define R_WORIRQ    0xA1
+#define R_WORCTRL   0xA2
+#define R_WOREVT0   0xA3
+#define R_WOREVT1   0xA4
+#define R_WORTIME0  0xA5
+#define R_WORTIME1  0xA6
+#define R_IEN0      0xA8
+#define R_FWT       0xAB
+#define R_FADDRL    0xAC
+#define R_FADDRH    0xAD
+#define R_FCTL      0xAE
+#define R_FWDATA    0xAF
+#define R_ENCDI     0xB1
+#define R_ENCDO     0xB2
+#define R_ENCCS     0xB3
+#define R_ADCCON1   0xB4
+#define R_ADCCON2   0xB5
+#define R_ADCCON3   0xB6
+#define R_IEN1      0xB8
+#define R_ADCL      0xBA
+#define R_ADCH      0xBB
+#define R_RNDL      0xBC
+#define R_RNDH      0xBD
+#define R_SLEEP     0xBE
+#define R_IRCON     0xC0
+#define R_CLKCON    0xC6
+#define R_T3CNT     0xCA
+#define R_T3CTL     0xCB
+#define R_T3CC0     0xCD
+#define R_DMAIRQ    0xD1
+#define R_DMA1CFGL  0xD2
+#define R_DMA1CFGH  0xD3
+#define R_DMA0CFGL  0xD4
+#define R_DMA0CFGH  0xD5
+#define R_DMAARM    0xD6
+#define R_DMAREQ    0xD7
+#define R_TIMIF     0xD8
+#define R_RFD       0xD9
+#define R_RFST      0xE1
+#define R_IRCON2    0xE8
+#define R_RFIF      0xE9
+#define R_ADCCFG    0xF2
+
+// Radio registers in xdata (offset from 0xDF00)
+#define X_PKTLEN    0x02
+#define X_PKTCTRL1  0x03
+#define X_PKTCTRL0  0x04
+#define X_ADDR      0x05
+#define X_MDMCFG4   0x0C
+#define X_MDMCFG3   0x0D
+#define X_MDMCFG2   0x0E
+#define X_MDMCFG1   0x0F
+#define X_MCSM1     0x13
+#define X_MCSM0     0x14
+#define X_PA_TABLE0 0x2E
+#define X_RSSI      0x3A
+#define X_MARCSTATE 0x3B
+#define X_PKTSTATUS 0x3C
+
+#define SIM_VECTORS             18
+#define SIM_DMA_CHANNELS        5
+
+
+/*==== TYPES =================================================================*/
+
+// Where an interrupt vector's flag and enable bits are
+struct SimIrq {
+    uint8_t flag_reg, flag_bm;
+    uint8_t en_reg, en_bm;
+    bool    auto_clear;         // TCON flags are cleared when the CPU vectors
+    bool    wakes_pm;           // Can end PM1-PM3
+};
+
+struct SimEvent {
+    double                t;
+    uint32_t              seq;
+    std::function<void()> fn;
+    bool operator<(const SimEvent &e) const
+    {
+        return t != e.t ? t > e.t : seq > e.seq;     // Earliest first, FIFO at equal times
+    }
+};
+
+struct SimDmaCh {
+    bool     armed;
+    uint16_t src, dest;
+    uint16_t len;               // LEN, or the maximum with VLEN
+    uint8_t  vlen, tmode, trig;
+    bool     word;
+    int8_t   srcinc, destinc;   // In bytes/words
+    bool     irqmask;
+    uint16_t total;             // Transfers in this run, 0 until known (VLEN)
+    uint16_t done;
+};
+
+struct SimXWin {
+    uint8_t  *host;
+    uint16_t  base;
+};
+
+
+/*==== LOCAL VARIABLES =======================================================*/
+
+static SimConfig  cfg;
+static double     now;
+static uint32_t   event_seq;
+static std::priority_queue<SimEvent> events;
+
+static uint8_t    sfr[256];
+static uint8_t    xreg[0x80];               // 0xDF00-0xDF7F
+static void     (*isr[SIM_VECTORS])(void);
+
+static const SimIrq irq[SIM_VECTORS] = {
+    { R_TCON,   0x02, R_IEN0, 0x01, true,  false },    //  0 RFTXRX
+    { R_TCON,   0x20, R_IEN0, 0x02, true,  false },    //  1 ADC
+    { R_TCON,   0x08, R_IEN0, 0x04, true,  false },    //  2 URX0
+    { R_TCON,   0x80, R_IEN0, 0x08, true,  false },    //  3 URX1
+    { R_S0CON,  0x03, R_IEN0, 0x10, false, false },    //  4 ENC
+    { R_IRCON,  0x80, R_IEN0, 0x20, false, true  },    //  5 ST
+    { R_IRCON2, 0x01, R_IEN2, 0x02, false, true  },    //  6 P2INT
+    { R_IRCON2, 0x02, R_IEN2, 0x04, false, false },    //  7 UTX0
+    { R_IRCON,  0x01, R_IEN1, 0x01, false, false },    //  8 DMA
+    { R_IRCON,  0x02, R_IEN1, 0x02, false, false },    //  9 T1
+    { R_IRCON,  0x04, R_IEN1, 0x04, false, false },    // 10 T2
+    { R_IRCON,  0x08, R_IEN1, 0x08, false, false },    // 11 T3
+    { R_IRCON,  0x10, R_IEN1, 0x10, false, false },    // 12 T4
+    { R_IRCON,  0x20, R_IEN1, 0x20, false, true  },    // 13 P0INT
+    { R_IRCON2, 0x04, R_IEN2, 0x08, false, false },    // 14 UTX1
+    { R_IRCON2, 0x08, R_IEN2, 0x10, false, true  },    // 15 P1INT
+    { R_S1CON,  0x03, R_IEN2, 0x01, false, false },    // 16 RF
+    { R_IRCON2, 0x10, R_IEN2, 0x20, false, true  },    // 17 WDT
+};
+
+static const char *const vector_name[SIM_VECTORS] = {
+    "RFTXRX", "ADC", "URX0", "URX1", "ENC", "ST", "P2INT", "UTX0", "DMA",
+    "T1", "T2", "T3", "T4", "P0INT", "UTX1", "P1INT", "RF", "WDT"
+};
+
+// CPU
+static int        cpu_state;
+static bool       in_isr;
+static int        irq_holdoff;              // Accesses before interrupts are taken
+static double     awake_since;
+static int        wake_vector;
+
+// Clocks
+static bool       xosc_on, rcosc_on;
+static double     xosc_stable_at, rcosc_stable_at;
+static bool       src_xosc;                 // System clock is the HS XOSC
+static bool       switch_pending;
+static double     switch_requested;
+
+// Sleep timer
+static double     st_epoch;                 // Last counter reset
+static uint32_t   st_gen;
+
+// ADC
+static bool       adc_busy;
+static bool       adc_seq_active;
+static int        adc_seq_ch;
+static bool       adc_extra_pending;
+static uint32_t   adc_gen;
+static double     input_mv[SIM_IN_COUNT];
+static double     noise_mv;
+static std::mt19937 rng;
+
+// DMA
+static SimDmaCh   dma[SIM_DMA_CHANNELS];
+static double     dma_free_at;
+static std::vector<SimXWin> xwin;
+
+// AES coprocessor
+static uint8_t    enc_key[CRYPT_KEY_SIZE];
+static uint8_t    enc_iv[CRYPT_BLOCK_SIZE];     // IV, chaining value or counter
+static uint8_t    enc_in[CRYPT_BLOCK_SIZE];
+static uint8_t    enc_out[CRYPT_BLOCK_SIZE];
+static int        enc_in_n;
+static int        enc_out_n = CRYPT_BLOCK_SIZE; // Output bytes read
+static uint8_t    enc_cmd;                      // ENCCS of the command running
+static bool       enc_busy;
+
+// Timer 3
+static double     t3_base;
+static uint32_t   t3_gen;
+
+// Port 0
+static uint8_t    p0_pins;
+
+// Flash
+static uint8_t    flash[SIM_FLASH_SIZE];
+static uint8_t    flash_data[2];            // Word being written
+static int        flash_n;
+
+// Radio
+static uint8_t    marc;
+static uint32_t   radio_gen;
+static bool       rfd_full;
+static uint8_t    rfd_tx;
+static double     tx_start;
+static double     byte_time;
+static uint16_t   tx_total;
+static SimPacket  tx_packet;
+static std::vector<uint8_t> rx_bytes;       // Frame being received, with status bytes
+static size_t     rx_len;                   // and its length on air
+static double     rx_until;                 // End of the frame being received
+static double     air_busy_until;           // Another radio is on air until then
+static std::function<void(const SimPacket &)> packet_cb;
+
+// Accounting
+static SimStats   totals;
+static SimStats   wake_start;
+static double     acct_at;
+static FILE      *state_log;
+static double     log_since;                // Start of the open interval
+static int        log_key = -1;             // and its state
+static double     log_row_since;            // Interval not written yet
+static int        log_row_key = -1;
+
+
+/*==== LOCAL FUNCTIONS =======================================================*/
+
+static uint8_t reg_read(uint16_t addr);
+static void    reg_write(uint16_t addr, uint8_t v);
+static void    dma_trigger(uint8_t trig);
+static void    adc_start_next(void);
+
+static void stop(bool error, const char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    throw SimStop{ buf, error };
+}
+
+static void at(double t, std::function<void()> fn)
+{
+    events.push(SimEvent{ t, event_seq++, fn });
+}
+
+static double sysclk(void)
+{
+    uint8_t spd = sfr[R_CLKCON] & CLKCON_CLKSPD;
+
+    if (src_xosc)
+        return SIM_XOSC_HZ / (1 << spd);
+    return SIM_XOSC_HZ / (1 << (spd ? spd : 1));
+}
+
+static bool xosc_stable(void)   { return xosc_on && now >= xosc_stable_at; }
+static bool rcosc_stable(void)  { return rcosc_on && now >= rcosc_stable_at; }
+
+static int radio_class(void)
+{
+    switch (marc)
+    {
+    case MARC_STATE_SLEEP:
+    case MARC_STATE_IDLE:           return SIM_RADIO_IDLE;
+    case MARC_STATE_TX:
+    case MARC_STATE_TX_END:
+    case MARC_STATE_TX_UNDERFLOW:   return SIM_RADIO_TX;
+    case MARC_STATE_RX:
+    case MARC_STATE_RX_END:
+    case MARC_STATE_RX_OVERFLOW:    return SIM_RADIO_RX;
+    default:                        return SIM_RADIO_FS;
+    }
+}
+
+static void log_write(void)
+{
+    if (log_row_key >= 0)
+        fprintf(state_log, "%.9f,%.9f,%d,%d,%d,%d,%d,%d\n", log_row_since, log_since - log_row_since,
+                log_row_key & 7, (log_row_key >> 3) & 3, (log_row_key >> 5) & 1,
+                (log_row_key >> 6) & 1, (log_row_key >> 7) & 1, log_row_key >> 8);
+}
+
+// Close the state log interval that ends now when the state changes. 'key'
+// packs the CPU, radio, HS XOSC, ADC and clock source states and the PA
+// setting while transmitting; -1 flushes.
+// Zero length states are dropped and equal neighbours merged, so one row is
+// held back until the next differing interval is known.
+static void log_state(int key)
+{
+    if (!state_log || key == log_key)
+        return;
+
+    if (acct_at > log_since)
+    {
+        if (log_key != log_row_key)
+        {
+            log_write();
+            log_row_key = log_key;
+            log_row_since = log_since;
+        }
+        log_since = acct_at;
+    }
+    log_key = key;
+
+    if (key < 0)
+        log_write();
+}
+
+// Add the time since the last call to the state totals
+static void account(void)
+{
+    double dt = now - acct_at;
+    bool   cpu_on = cpu_state == SIM_CPU_ACTIVE || cpu_state == SIM_CPU_IDLE;
+
+    log_state(cpu_state | (radio_class() << 3) | (xosc_on << 5) | (adc_busy << 6) |
+              ((cpu_on && src_xosc) << 7) |
+              (radio_class() == SIM_RADIO_TX ? xreg[X_PA_TABLE0] << 8 : 0));
+
+    if (dt <= 0)
+        return;
+
+    totals.cpu[cpu_state] += dt;
+    totals.radio[radio_class()] += dt;
+    if (cpu_on && src_xosc)
+        totals.cpu_xosc += dt;
+    if (xosc_on)
+        totals.xosc_on += dt;
+    if (adc_busy)
+        totals.adc += dt;
+    acct_at = now;
+}
+
+// Run due events up to time 't'
+static void advance_to(double t)
+{
+    while (!events.empty() && events.top().t <= t)
+    {
+        SimEvent e = events.top();
+        events.pop();
+        if (e.t > now)
+        {
+            account();
+            now = e.t;
+        }
+        account();
+        e.fn();
+    }
+    if (t > now)
+    {
+        account();
+        now = t;
+        account();
+    }
+}
+
+static void clock_update(void)
+{
+    bool target_xosc;
+    bool target_stable;
+
+    if (!switch_pending)
+        return;
+
+    target_xosc = !(sfr[R_CLKCON] & CLKCON_OSC);
+    target_stable = target_xosc ? xosc_stable() : rcosc_stable();
+    if (!target_stable)
+    {
+        switch_requested = now;     // Only counts from stability
+        return;
+    }
+    if (now - switch_requested < SIM_CLK_SWITCH_CYCLES / sysclk())
+        return;
+
+    account();
+    src_xosc = target_xosc;
+    switch_pending = false;
+}
+
+static void cpu_cycles(uint32_t n)
+{
+    advance_to(now + n / sysclk());
+    clock_update();
+
+    if (now - awake_since > SIM_AWAKE_LIMIT)
+        stop(true, "CPU awake for %.1f s without entering a power mode", now - awake_since);
+}
+
+static bool irq_pending(int v)
+{
+    return (sfr[irq[v].flag_reg] & irq[v].flag_bm) && (sfr[irq[v].en_reg] & irq[v].en_bm);
+}
+
+static void run_isr(int v)
+{
+    if (!isr[v])
+        stop(true, "interrupt %s enabled and pending, but the firmware has no ISR for it", vector_name[v]);
+
+    cpu_cycles(SIM_ISR_CYCLES);
+    if (irq[v].auto_clear)
+        sfr[irq[v].flag_reg] &= ~irq[v].flag_bm;
+
+    in_isr = true;
+    isr[v]();
+    in_isr = false;
+}
+
+// Take pending interrupts, lowest vector first
+static void irq_dispatch(void)
+{
+    int v;
+
+    if (in_isr || irq_holdoff)
+        return;
+
+    for (v = 0; v < SIM_VECTORS && (sfr[R_IEN0] & 0x80); )
+    {
+        if (irq_pending(v))
+        {
+            run_isr(v);
+            v = 0;
+        }
+        else
+            v++;
+    }
+}
+
+static bool wake_pending(int mode)
+{
+    int v;
+
+    if (!(sfr[R_IEN0] & 0x80))
+        return false;
+    for (v = 0; v < SIM_VECTORS; v++)
+    {
+        if (!irq_pending(v))
+            continue;
+        if (mode == 0)
+            return true;
+        if (irq[v].wakes_pm && !(mode == 3 && v == 5))
+        {
+            wake_vector = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/*==== SLEEP TIMER ===========================================================*/
+
+static double st_tick(void)
+{
+    return (1 << (5 * (sfr[R_WORCTRL] & WORCTRL_WOR_RES))) / SIM_32K_HZ;
+}
+
+static uint16_t st_counter(void)
+{
+    return (uint16_t)(uint32_t)floor((now - st_epoch) / st_tick() + 1e-9);
+}
+
+static void st_schedule(void)
+{
+    uint32_t gen = ++st_gen;
+    uint32_t event0 = ((uint32_t)sfr[R_WOREVT1] << 8) | sfr[R_WOREVT0];
+    double   t;
+
+    if (event0 == 0)
+        event0 = 0x10000;
+    t = st_epoch + event0 * st_tick();
+    if (t <= now)
+        t = st_epoch + (0x10000 + event0) * st_tick();
+
+    at(t, [gen, t]() {
+        if (gen != st_gen)
+            return;
+
+        // The 32 kHz clocks are off in PM3
+        if (cpu_state != SIM_CPU_PM3)
+        {
+            sfr[R_WORIRQ] |= WORIRQ_EVENT0_FLAG;
+            if (sfr[R_WORIRQ] & WORIRQ_EVENT0_MASK)
+                sfr[R_IRCON] |= 0x80;
+        }
+        st_epoch = t;
+        st_schedule();
+    });
+}
+
+
+/*==== ADC ===================================================================*/
+
+static double adc_input(uint8_t ch)
+{
+    switch (ch)
+    {
+    case 0: case 1: case 2: case 3: case 4: case 5: case 6: case 7:
+        return input_mv[ch];
+    case 8:  return input_mv[0] - input_mv[1];
+    case 9:  return input_mv[2] - input_mv[3];
+    case 10: return input_mv[4] - input_mv[5];
+    case 11: return input_mv[6] - input_mv[7];
+    case 12: return 0;
+    case 13: return 1250;
+    case 14: return input_mv[SIM_IN_TEMP];
+    default: return input_mv[SIM_IN_VDD] / 3;
+    }
+}
+
+static double adc_reference(uint8_t ref)
+{
+    switch (ref >> 6)
+    {
+    case 0:  return 1250;
+    case 1:  return input_mv[7];
+    case 2:  return input_mv[SIM_IN_VDD];
+    default: return input_mv[6] - input_mv[7];
+    }
+}
+
+// One conversion of 'ch' with the given reference/decimation settings
+static void adc_convert(uint8_t settings, bool extra)
+{
+    static const int bits[4] = { 7, 9, 10, 12 };
+    uint32_t gen = ++adc_gen;
+    uint8_t  ch = settings & 0x0F;
+    int      decim = 64 << ((settings >> 4) & 3);
+    int      nbits = bits[(settings >> 4) & 3];
+
+    account();
+    adc_busy = true;
+
+    at(now + (decim + 16) * 0.25e-6, [=]() {
+        double  ref = adc_reference(settings);
+        double  v = adc_input(ch);
+        int32_t full = 1 << (nbits - 1);
+        int32_t code;
+        uint16_t left;
+
+        if (gen != adc_gen)
+            return;
+
+        if (noise_mv > 0)
+            v += std::normal_distribution<double>(0, noise_mv)(rng);
+        code = ref > 0 ? (int32_t)lround(v / ref * full) : 0;
+        if (code >= full)
+            code = full - 1;
+        if (code < -full)
+            code = -full;
+        left = (uint16_t)(code << (16 - nbits));
+
+        account();
+        adc_busy = false;
+        sfr[R_ADCL] = (uint8_t)left;
+        sfr[R_ADCH] = (uint8_t)(left >> 8);
+        sfr[R_ADCCON1] |= ADCCON1_EOC;
+
+        if (extra)
+            sfr[R_TCON] |= 0x20;                // ADCIF
+        else
+        {
+            dma_trigger(20);                    // ADC_CHALL
+            if (ch < 8)
+                dma_trigger(21 + ch);           // ADC_CHn
+        }
+        adc_start_next();
+    });
+}
+
+// Next channel of the running sequence, -1 at its end
+static int adc_seq_next(int ch)
+{
+    uint8_t last = sfr[R_ADCCON2] & 0x0F;
+
+    if (last >= 8)
+        return ch < 0 ? last : -1;
+    for (ch++; ch <= last; ch++)
+        if (sfr[R_ADCCFG] & (1 << ch))
+            return ch;
+    return -1;
+}
+
+static void adc_start_next(void)
+{
+    if (adc_busy)
+        return;
+
+    if (adc_extra_pending)
+    {
+        adc_extra_pending = false;
+        adc_convert(sfr[R_ADCCON3], true);
+        return;
+    }
+
+    if (!adc_seq_active)
+        return;
+
+    adc_seq_ch = adc_seq_next(adc_seq_ch);
+    if (adc_seq_ch < 0)
+    {
+        // Full speed mode starts over until STSEL is changed
+        if ((sfr[R_ADCCON1] & ADCCON1_STSEL) != ADCCON1_STSEL0)
+        {
+            adc_seq_active = false;
+            return;
+        }
+        adc_seq_ch = adc_seq_next(-1);
+        if (adc_seq_ch < 0)
+        {
+            adc_seq_active = false;
+            return;
+        }
+    }
+    adc_convert((sfr[R_ADCCON2] & 0xF0) | adc_seq_ch, false);
+}
+
+static void adc_seq_start(void)
+{
+    if (adc_seq_active)
+        return;
+    adc_seq_active = true;
+    adc_seq_ch = -1;
+    adc_start_next();
+}
+
+
+/*==== DMA ===================================================================*/
+
+static uint8_t *xmem(uint16_t a)
+{
+    for (const SimXWin &w : xwin)
+        if (a >= w.base && a < w.base + SIM_XWIN_SIZE)
+            return w.host + (a - w.base);
+    return NULL;
+}
+
+uint16_t sim_xaddr(const volatile void *p)
+{
+    uint8_t *host = (uint8_t *)p;
+    uint16_t base;
+
+    for (const SimXWin &w : xwin)
+        if (host >= w.host && host < w.host + SIM_XWIN_SIZE)
+            return (uint16_t)(w.base + (host - w.host));
+
+    base = (uint16_t)(SIM_XWIN_BASE + xwin.size() * SIM_XWIN_SIZE);
+    if (base >= SIM_XWIN_END)
+        stop(true, "out of simulated xdata windows for DMA");
+    xwin.push_back(SimXWin{ host, base });
+    return base;
+}
+
+static uint8_t xdata_read(uint16_t a)
+{
+    uint8_t *m;
+
+    if (a >= 0xDF00 && a <= 0xDFFF)
+        return reg_read(a);
+    m = xmem(a);
+    return m ? *m : 0;
+}
+
+static void xdata_write(uint16_t a, uint8_t v)
+{
+    uint8_t *m;
+
+    if (a >= 0xDF00 && a <= 0xDFFF)
+    {
+        reg_write(a, v);
+        return;
+    }
+    m = xmem(a);
+    if (m)
+        *m = v;
+}
+
+static void dma_load(int ch)
+{
+    SimDmaCh &c = dma[ch];
+    uint8_t   reg = ch ? R_DMA1CFGL : R_DMA0CFGL;
+    uint16_t  a = (uint16_t)((sfr[reg + 1] << 8) | sfr[reg]) + (ch ? 8 * (ch - 1) : 0);
+    uint8_t   d[8];
+    static const int8_t inc[4] = { 0, 1, 2, -1 };
+    int       i;
+
+    for (i = 0; i < 8; i++)
+        d[i] = xdata_read(a + i);
+
+    c.src      = (uint16_t)((d[0] << 8) | d[1]);
+    c.dest     = (uint16_t)((d[2] << 8) | d[3]);
+    c.vlen     = d[4] >> 5;
+    c.len      = (uint16_t)(((d[4] & 0x1F) << 8) | d[5]);
+    c.word     = d[6] & 0x80;
+    c.tmode    = (d[6] >> 5) & 3;
+    c.trig     = d[6] & 0x1F;
+    c.srcinc   = inc[d[7] >> 6];
+    c.destinc  = inc[(d[7] >> 4) & 3];
+    c.irqmask  = d[7] & 0x08;
+    c.total    = c.vlen ? 0 : c.len;
+    c.done     = 0;
+}
+
+static void dma_unit(int ch)
+{
+    SimDmaCh &c = dma[ch];
+    uint8_t   lo, hi = 0;
+    uint16_t  n;
+    int       size = c.word ? 2 : 1;
+
+    if (!c.armed)
+        return;
+
+    lo = xdata_read(c.src);
+    if (c.word)
+        hi = xdata_read(c.src + 1);
+
+    // The first byte/word gives the length in VLEN modes
+    if (!c.total)
+    {
+        n = c.word ? (uint16_t)((hi << 8) | lo) : lo;
+        switch (c.vlen)
+        {
+        case 1:  n += 1; break;
+        case 3:  n += 2; break;
+        case 4:  n += 3; break;
+        default: break;
+        }
+        c.total = n < c.len ? n : c.len;
+        if (!c.total)
+            c.total = 1;
+    }
+
+    xdata_write(c.dest, lo);
+    if (c.word)
+        xdata_write(c.dest + 1, hi);
+
+    c.src  += c.srcinc * size;
+    c.dest += c.destinc * size;
+
+    if (++c.done < c.total)
+        return;
+
+    sfr[R_DMAIRQ] |= 1 << ch;
+    if (c.irqmask)
+        sfr[R_IRCON] |= 0x01;                   // DMAIF
+
+    if (c.tmode >= 2)
+        dma_load(ch);                           // Repeated modes re-arm
+    else
+    {
+        c.armed = false;
+        sfr[R_DMAARM] &= ~(1 << ch);
+    }
+}
+
+static void dma_start(int ch)
+{
+    SimDmaCh &c = dma[ch];
+    int       units = (c.tmode & 1) ? (c.total ? c.total - c.done : c.len) : 1;
+    int       i;
+
+    for (i = 0; i < units; i++)
+    {
+        if (dma_free_at < now)
+            dma_free_at = now;
+        dma_free_at += SIM_DMA_CYCLES / sysclk();
+        at(dma_free_at, [ch]() { dma_unit(ch); });
+    }
+}
+
+static void dma_trigger(uint8_t trig)
+{
+    int ch;
+
+    for (ch = 0; ch < SIM_DMA_CHANNELS; ch++)
+        if (dma[ch].armed && dma[ch].trig == trig)
+            dma_start(ch);
+}
+
+
+/*==== TIMER 3 ===============================================================*/
+
+// Counts per overflow
+static uint32_t t3_top(void)
+{
+    return (sfr[R_T3CTL] & T3CTL_MODE) == T3CTL_MODE_FREERUN ? 256 : sfr[R_T3CC0] + 1;
+}
+
+static double t3_period(void)
+{
+    // TICKSPD divides 26 MHz like CLKSPD, capped by the system clock
+    double tick = SIM_XOSC_HZ / (1 << ((sfr[R_CLKCON] & CLKCON_TICKSPD) >> 3));
+
+    if (tick > sysclk())
+        tick = sysclk();
+    return t3_top() * (1 << (sfr[R_T3CTL] >> 5)) / tick;
+}
+
+static void t3_schedule(void)
+{
+    uint32_t gen = ++t3_gen;
+    double   t = t3_base + t3_period();
+
+    at(t, [gen, t]() {
+        if (gen != t3_gen)
+            return;
+        sfr[R_TIMIF] |= 0x01;                   // T3OVFIF
+        if (sfr[R_T3CTL] & T3CTL_OVFIM)
+            sfr[R_IRCON] |= 0x08;               // T3IF
+        t3_base = t;
+        t3_schedule();
+    });
+}
+
+static uint8_t t3_count(void)
+{
+    if (!(sfr[R_T3CTL] & T3CTL_START))
+        return sfr[R_T3CNT];
+    return (uint8_t)floor((now - t3_base) / t3_period() * t3_top());
+}
+
+
+/*==== AES COPROCESSOR =======================================================*/
+
+static void enc_done(void)
+{
+    enc_busy = false;
+    sfr[R_S0CON] |= 0x03;                       // ENCIF_1, ENCIF_0
+}
+
+// A block has been through the AES core; its output is fetched by ENC_UP
+static void enc_block(void)
+{
+    uint8_t x[CRYPT_BLOCK_SIZE];
+    int     i;
+
+    switch (enc_cmd & ENCCS_MODE)
+    {
+    case ENCCS_MODE_ECB:
+        crypt_aes(enc_key, enc_in, enc_out);
+        break;
+    case ENCCS_MODE_CBC:
+    case ENCCS_MODE_CBCMAC:
+        for (i = 0; i < CRYPT_BLOCK_SIZE; i++)
+            x[i] = enc_in[i] ^ enc_iv[i];
+        crypt_aes(enc_key, x, enc_iv);
+        memcpy(enc_out, enc_iv, CRYPT_BLOCK_SIZE);
+        break;
+    case ENCCS_MODE_CTR:
+        crypt_aes(enc_key, enc_iv, x);
+        for (i = 0; i < CRYPT_BLOCK_SIZE; i++)
+            enc_out[i] = enc_in[i] ^ x[i];
+        for (i = CRYPT_BLOCK_SIZE - 1; i >= 0 && ++enc_iv[i] == 0; i--)
+            ;
+        break;
+    }
+
+    if ((enc_cmd & ENCCS_MODE) == ENCCS_MODE_CBCMAC)
+    {
+        enc_done();
+        return;
+    }
+    enc_out_n = 0;
+    for (i = 0; i < CRYPT_BLOCK_SIZE; i++)
+        dma_trigger(30);                        // ENC_UP
+}
+
+// ENCCS written with ST set
+static void enc_start(uint8_t v)
+{
+    uint8_t cmd = v & ENCCS_CMD;
+    uint8_t mode = v & ENCCS_MODE;
+    int     i;
+
+    if (enc_busy)
+        stop(true, "ENCCS.ST with the AES coprocessor busy");
+    if (cmd == ENCCS_CMD_ENC || cmd == ENCCS_CMD_DEC)
+    {
+        if (mode != ENCCS_MODE_ECB && mode != ENCCS_MODE_CBC &&
+            mode != ENCCS_MODE_CBCMAC && mode != ENCCS_MODE_CTR)
+            stop(true, "AES mode %u is not modelled", mode >> 4);
+        if (cmd == ENCCS_CMD_DEC && mode != ENCCS_MODE_CTR)
+            stop(true, "AES decryption is only modelled in CTR mode");
+    }
+
+    enc_cmd = v;
+    enc_busy = true;
+    enc_in_n = 0;
+    enc_out_n = CRYPT_BLOCK_SIZE;
+    if (cmd == ENCCS_CMD_ENC || cmd == ENCCS_CMD_DEC)
+        for (i = 0; i < CRYPT_BLOCK_SIZE; i++)
+            dma_trigger(29);                    // ENC_DW
+}
+
+// A byte written to ENCDI, by the CPU or DMA
+static void enc_input(uint8_t v)
+{
+    if (!enc_busy || enc_in_n >= CRYPT_BLOCK_SIZE)
+        return;
+    enc_in[enc_in_n++] = v;
+    if (enc_in_n < CRYPT_BLOCK_SIZE)
+        return;
+
+    switch (enc_cmd & ENCCS_CMD)
+    {
+    case ENCCS_CMD_LDKEY:
+        memcpy(enc_key, enc_in, CRYPT_KEY_SIZE);
+        enc_done();
+        break;
+    case ENCCS_CMD_LDIV:
+        memcpy(enc_iv, enc_in, CRYPT_BLOCK_SIZE);
+        enc_done();
+        break;
+    default:
+        at(now + SIM_AES_CYCLES / sysclk(), []() { enc_block(); });
+        break;
+    }
+}
+
+// A byte read from ENCDO; the block is done once all of it has been read
+static uint8_t enc_output(void)
+{
+    uint8_t v;
+
+    if (enc_out_n >= CRYPT_BLOCK_SIZE)
+        return 0;
+    v = enc_out[enc_out_n++];
+    if (enc_out_n == CRYPT_BLOCK_SIZE)
+        enc_done();
+    return v;
+}
+
+
+/*==== FLASH CONTROLLER ======================================================*/
+
+static void flash_word_done(void)
+{
+    uint16_t w = (uint16_t)(((sfr[R_FADDRH] << 8) | sfr[R_FADDRL]) + 1);
+    int      ch;
+
+    sfr[R_FADDRH] = (uint8_t)((w >> 8) & 0x3F);
+    sfr[R_FADDRL] = (uint8_t)w;
+    sfr[R_FCTL] &= ~FCTL_SWBSY;
+    flash_n = 0;
+
+    // The write goes on for as long as the DMA has data for it
+    for (ch = 0; ch < SIM_DMA_CHANNELS; ch++)
+        if (dma[ch].armed && dma[ch].trig == 18)     // FLASH
+        {
+            dma_trigger(18);
+            return;
+        }
+    sfr[R_FCTL] &= ~(FCTL_BUSY | FCTL_WRITE);
+}
+
+static void flash_write_start(void)
+{
+    uint8_t fwt = (uint8_t)(21000.0 * sysclk() / 16e9);
+
+    if ((sfr[R_FWT] & 0x3F) != fwt)
+        stop(true, "flash write with FWT 0x%02X, the %.0f MHz clock needs 0x%02X",
+             sfr[R_FWT] & 0x3F, sysclk() / 1e6, fwt);
+    sfr[R_FCTL] |= FCTL_BUSY | FCTL_WRITE;
+    flash_n = 0;
+    dma_trigger(18);                            // FLASH
+}
+
+static void flash_write_data(uint8_t v)
+{
+    uint32_t a;
+
+    if (!(sfr[R_FCTL] & FCTL_WRITE))
+        stop(true, "FWDATA written outside a flash write");
+    flash_data[flash_n++] = v;
+    if (flash_n < 2)
+    {
+        dma_trigger(18);                        // FLASH
+        return;
+    }
+
+    // Programming only clears bits
+    a = (uint32_t)(((sfr[R_FADDRH] & 0x3F) << 8) | sfr[R_FADDRL]) * 2;
+    flash[a]     &= flash_data[0];
+    flash[a + 1] &= flash_data[1];
+    sfr[R_FCTL] |= FCTL_SWBSY;
+    at(now + SIM_FLASH_WORD_TIME, []() { flash_word_done(); });
+}
+
+
+/*==== PORT 0 ================================================================*/
+
+static void p0_set(uint8_t pins)
+{
+    uint8_t rising = pins & ~p0_pins;
+    uint8_t falling = p0_pins & ~pins;
+    uint8_t edges = (sfr[R_PICTL] & PICTL_P0ICON) ? falling : rising;
+
+    p0_pins = pins;
+    sfr[R_P0IFG] |= edges;
+    if ((sfr[R_P0IFG] & 0x0F && sfr[R_PICTL] & PICTL_P0IENL) ||
+        (sfr[R_P0IFG] & 0xF0 && sfr[R_PICTL] & PICTL_P0IENH))
+        sfr[R_IRCON] |= 0x20;                   // P0IF
+}
+
+
+/*==== RADIO =================================================================*/
+
+static void radio_set(uint8_t state)
+{
+    account();
+    marc = state;
+}
+
+static double radio_byte_time(void)
+{
+    uint8_t e = xreg[X_MDMCFG4] & 0x0F;
+    uint8_t m = xreg[X_MDMCFG3];
+    double  rate = (256.0 + m) * (1 << e) / (1 << 28) * SIM_XOSC_HZ;
+
+    return ((xreg[X_MDMCFG2] & 0x08) ? 16 : 8) / rate;      // Manchester doubles it
+}
+
+static void radio_request_byte(void)
+{
+    sfr[R_TCON] |= 0x02;                        // RFTXRXIF
+    dma_trigger(19);                            // RADIO
+}
+
+static void radio_flag(uint8_t flag)
+{
+    sfr[R_RFIF] |= flag;
+    if (sfr[R_RFIM] & flag)
+        sfr[R_S1CON] |= 0x03;
+}
+
+static void radio_tx_end(uint32_t gen)
+{
+    uint8_t txoff = xreg[X_MCSM1] & 0x03;
+
+    if (gen != radio_gen)
+        return;
+
+    tx_packet.airtime = now - tx_start;
+    radio_flag(RFIF_IRQ_DONE);
+    radio_set(txoff == 1 ? MARC_STATE_FSTXON : txoff == 3 ? MARC_STATE_RX : MARC_STATE_IDLE);
+
+    totals.packets++;
+    if (packet_cb)
+        packet_cb(tx_packet);
+}
+
+// Byte 'n' of the packet is due at the modulator
+static void radio_tx_slot(uint32_t gen, uint16_t n)
+{
+    uint8_t crc = (xreg[X_PKTCTRL0] & 0x04) ? 2 : 0;
+
+    if (gen != radio_gen || marc != MARC_STATE_TX)
+        return;
+
+    if (!rfd_full)
+    {
+        radio_set(MARC_STATE_TX_UNDERFLOW);
+        radio_flag(RFIF_IRQ_TXUNF);
+        fprintf(stderr, "sim: %.6f s: radio TX underflow at byte %u\n", now, n);
+        return;
+    }
+
+    tx_packet.data.push_back(rfd_tx);
+    rfd_full = false;
+
+    if (n == 0)
+        tx_total = (xreg[X_PKTCTRL0] & 0x03) == 1 ? rfd_tx + 1 : xreg[X_PKTLEN];
+
+    if (n + 1 < tx_total)
+    {
+        radio_request_byte();
+        at(now + byte_time, [gen, n]() { radio_tx_slot(gen, n + 1); });
+        return;
+    }
+
+    // Last byte and the CRC are shifted out, then TXOFF_MODE
+    at(now + (1 + crc) * byte_time, [gen]() {
+        if (gen == radio_gen)
+            radio_set(MARC_STATE_TX_END);
+    });
+    at(now + (1 + crc) * byte_time + 1e-6, [gen]() { radio_tx_end(gen); });
+}
+
+// Preamble and sync word, in bytes
+static int radio_head_bytes(void)
+{
+    static const uint8_t preamble[8] = { 2, 3, 4, 6, 8, 12, 16, 24 };
+    uint8_t sync_mode = xreg[X_MDMCFG2] & 0x07;
+    int     head = preamble[(xreg[X_MDMCFG1] >> 4) & 7];
+
+    if (sync_mode == 3 || sync_mode == 7)
+        head += 4;
+    else if (sync_mode & 3)
+        head += 2;
+    return head;
+}
+
+static void radio_tx_begin(uint32_t gen)
+{
+    if (gen != radio_gen)
+        return;
+
+    radio_set(MARC_STATE_TX);
+    byte_time = radio_byte_time();
+    tx_start = now;
+    tx_packet.t = now;
+    tx_packet.data.clear();
+    rfd_full = false;
+    tx_total = 1;
+
+    radio_request_byte();
+    at(now + radio_head_bytes() * byte_time, [gen]() { radio_tx_slot(gen, 0); });
+}
+
+// Byte 'n' of the frame being received is in RFD
+static void radio_rx_slot(uint32_t gen, uint16_t n)
+{
+    uint8_t rxoff = (xreg[X_MCSM1] >> 2) & 0x03;
+
+    if (gen != radio_gen || marc != MARC_STATE_RX)
+        return;
+
+    if (n < rx_bytes.size())
+    {
+        uint8_t crc = (xreg[X_PKTCTRL0] & 0x04) ? 2 : 0;
+        double  next = n + 1u < rx_len ? byte_time :        // Next byte on air
+                       n + 1u == rx_len ? (1 + crc) * byte_time : // CRC checked
+                       byte_time / 8;                       // Status bytes
+
+        sfr[R_RFD] = rx_bytes[n];
+        radio_request_byte();
+        at(now + next, [gen, n]() { radio_rx_slot(gen, n + 1); });
+        return;
+    }
+
+    radio_flag(RFIF_IRQ_DONE);
+    if (rxoff == 2)
+        radio_tx_begin(++radio_gen);
+    else
+        radio_set(rxoff == 1 ? MARC_STATE_FSTXON : rxoff == 3 ? MARC_STATE_RX : MARC_STATE_IDLE);
+}
+
+// Sync word of a frame from another radio is complete
+static void radio_rx_sync(void)
+{
+    uint8_t  adr_chk = xreg[X_PKTCTRL1] & 0x03;
+    uint8_t  addr;
+    uint32_t gen = radio_gen;
+
+    if (marc != MARC_STATE_RX || rx_bytes.size() < 2)
+        return;
+    radio_flag(RFIF_IRQ_SFD);
+
+    // The address follows the length byte in variable length mode. A frame
+    // for another address is dropped whole and the radio keeps searching.
+    addr = rx_bytes[(xreg[X_PKTCTRL0] & 0x03) == 1 ? 1 : 0];
+    if (adr_chk && addr != xreg[X_ADDR] && !(adr_chk >= 2 && addr == 0) &&
+        !(adr_chk == 3 && addr == 0xFF))
+        return;
+
+    // The CRC is checked, not delivered; the status bytes (CRC_OK) follow it
+    byte_time = radio_byte_time();
+    rx_len = rx_bytes.size();
+    rx_until = now + (rx_len + 3) * byte_time;     // Frame, CRC, status bytes
+    if (xreg[X_PKTCTRL1] & 0x04)
+    {
+        rx_bytes.push_back(SIM_RADIO_RX_RSSI);
+        rx_bytes.push_back(SIM_RADIO_RX_LQI | 0x80);
+    }
+    at(now + byte_time, [gen]() { radio_rx_slot(gen, 0); });
+}
+
+// A frame is being received (PKTSTATUS.SFD)
+static bool radio_receiving(void)
+{
+    return marc == MARC_STATE_RX && now < rx_until;
+}
+
+// PKTSTATUS.CCA, as MCSM1.CCA_MODE defines a clear channel
+static bool radio_cca(void)
+{
+    bool rssi_low = now >= air_busy_until;
+
+    switch ((xreg[X_MCSM1] >> 4) & 0x03)
+    {
+    case 0:  return true;
+    case 1:  return rssi_low;
+    case 2:  return !radio_receiving();
+    default: return rssi_low && !radio_receiving();
+    }
+}
+
+// Calibrate (if due) and settle, then enter 'target'
+static void radio_settle(uint8_t target)
+{
+    uint32_t gen = ++radio_gen;
+    bool     cal = marc == MARC_STATE_IDLE && ((xreg[X_MCSM0] >> 4) & 3) == 1;
+    double   t = now + SIM_RADIO_SETTLE + (cal ? SIM_RADIO_CAL : 0);
+
+    radio_set(cal ? MARC_STATE_STARTCAL : MARC_STATE_FS_LOCK);
+    if (target == MARC_STATE_TX)
+        at(t, [gen]() { radio_tx_begin(gen); });
+    else
+        at(t, [gen, target]() {
+            if (gen == radio_gen)
+                radio_set(target);
+        });
+}
+
+static void radio_strobe(uint8_t cmd)
+{
+    if (cmd != RFST_SIDLE && cmd != RFST_SNOP && !(src_xosc && xosc_stable()))
+        stop(true, "radio strobe 0x%02X without the HS XOSC as system clock", cmd);
+
+    switch (cmd)
+    {
+    case RFST_SIDLE:
+        ++radio_gen;
+        radio_set(MARC_STATE_IDLE);
+        break;
+    case RFST_STX:
+        if (marc == MARC_STATE_FSTXON)
+        {
+            uint32_t gen = ++radio_gen;
+            radio_tx_begin(gen);
+        }
+        else if (marc == MARC_STATE_RX && !radio_cca())
+            break;                              // Busy channel, stays in RX
+        else if (marc != MARC_STATE_TX)
+            radio_settle(MARC_STATE_TX);
+        break;
+    case RFST_SRX:
+        radio_settle(MARC_STATE_RX);
+        break;
+    case RFST_SFSTXON:
+        radio_settle(MARC_STATE_FSTXON);
+        break;
+    case RFST_SCAL:
+        if (marc == MARC_STATE_IDLE)
+        {
+            uint32_t gen = ++radio_gen;
+            radio_set(MARC_STATE_STARTCAL);
+            at(now + SIM_RADIO_CAL, [gen]() {
+                if (gen == radio_gen)
+                    radio_set(MARC_STATE_IDLE);
+            });
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+
+/*==== POWER MODES ===========================================================*/
+
+static void power_down(int mode)
+{
+    SimStats awake;
+    int      i;
+
+    if (mode >= 2 && marc != MARC_STATE_IDLE)
+        stop(true, "PM%d entered with the radio in MARCSTATE 0x%02X", mode, marc);
+
+    account();
+    if (cfg.verbose)
+    {
+        awake = totals;
+        for (i = 0; i < SIM_CPU_STATES; i++)
+            awake.cpu[i] -= wake_start.cpu[i];
+        for (i = 0; i < SIM_RADIO_STATES; i++)
+            awake.radio[i] -= wake_start.radio[i];
+        printf("%12.6f  wake %-6s awake %8.3f ms  active %8.3f ms  xosc %7.3f ms  tx %7.3f ms  %5u accesses\n",
+               now, wake_vector >= 0 ? vector_name[wake_vector] : "reset",
+               (awake.cpu[SIM_CPU_ACTIVE] + awake.cpu[SIM_CPU_IDLE]) * 1e3,
+               awake.cpu[SIM_CPU_ACTIVE] * 1e3,
+               (totals.xosc_on - wake_start.xosc_on) * 1e3,
+               awake.radio[SIM_RADIO_TX] * 1e3,
+               totals.accesses - wake_start.accesses);
+    }
+
+    cpu_state = SIM_CPU_PM1 + mode - 1;
+    xosc_on = false;
+    rcosc_on = false;
+}
+
+static void wake_up(void)
+{
+    account();
+    cpu_state = SIM_CPU_ACTIVE;
+    awake_since = now;
+    totals.wakes++;
+
+    // Always back on the HS RCOSC, the HS XOSC is off
+    rcosc_on = true;
+    rcosc_stable_at = now + SIM_RCOSC_STARTUP;
+    src_xosc = false;
+    switch_pending = false;
+    sfr[R_CLKCON] |= CLKCON_OSC;
+
+    wake_start = totals;
+}
+
+// PCON.IDLE was set: idle mode or the power mode in SLEEP.MODE
+static void enter_power_mode(void)
+{
+    int mode = sfr[R_SLEEP] & SLEEP_MODE;
+
+    sfr[R_PCON] &= ~PCON_IDLE;
+
+    if (mode)
+        power_down(mode);
+    else
+    {
+        account();
+        cpu_state = SIM_CPU_IDLE;
+    }
+
+    while (!wake_pending(mode))
+    {
+        if (events.empty())
+            stop(false, "asleep with no wake-up source left");
+        advance_to(events.top().t);
+    }
+
+    if (mode)
+        wake_up();
+    else
+    {
+        account();
+        cpu_state = SIM_CPU_ACTIVE;
+    }
+    irq_holdoff = 0;
+}
+
+
+/*==== REGISTER FILE =========================================================*/
+
+static uint8_t reg_read(uint16_t addr)
+{
+    uint8_t v;
+
+    if (addr >= 0xDF00 && addr < 0xDF80)
+    {
+        if (addr == 0xDF00 + X_MARCSTATE)
+            return marc;
+        if (addr == 0xDF00 + X_RSSI && marc == MARC_STATE_RX)
+            return (uint8_t)(SIM_RADIO_NOISE_RSSI + (rng() & 0x07));
+        if (addr == 0xDF00 + X_PKTSTATUS)
+            return (now < air_busy_until ? 0x40 : 0) |     // CS
+                   (radio_cca() ? 0x10 : 0) |              // CCA
+                   (radio_receiving() ? 0x08 : 0);         // SFD
+        return xreg[addr - 0xDF00];
+    }
+    addr &= 0xFF;
+
+    switch (addr)
+    {
+    case R_P0:
+        return p0_pins;
+    case R_WORTIME0:
+        return (uint8_t)st_counter();
+    case R_WORTIME1:
+        return (uint8_t)(st_counter() >> 8);
+    case R_SLEEP:
+        v = sfr[R_SLEEP] & ~(SLEEP_XOSC_S | SLEEP_HFRC_S);
+        if (xosc_stable())
+            v |= SLEEP_XOSC_S;
+        if (rcosc_stable())
+            v |= SLEEP_HFRC_S;
+        return v;
+    case R_CLKCON:
+        clock_update();
+        return (sfr[R_CLKCON] & ~CLKCON_OSC) | (src_xosc ? 0 : CLKCON_OSC);
+    case R_ADCH:
+        sfr[R_ADCCON1] &= ~ADCCON1_EOC;
+        return sfr[R_ADCH];
+    case R_RNDL:
+    case R_RNDH:
+        return (uint8_t)rng();
+    case R_ENCCS:
+        return (sfr[R_ENCCS] & ~ENCCS_RDY) | (enc_busy ? 0 : ENCCS_RDY);
+    case R_ENCDO:
+        return enc_output();
+    case R_T3CNT:
+        return t3_count();
+    default:
+        return sfr[addr];
+    }
+}
+
+static void reg_write(uint16_t addr, uint8_t v)
+{
+    uint8_t old;
+
+    if (addr >= 0xDF00 && addr < 0xDF80)
+    {
+        if (addr != 0xDF00 + X_MARCSTATE)
+            xreg[addr - 0xDF00] = v;
+        return;
+    }
+    addr &= 0xFF;
+    old = sfr[addr];
+
+    switch (addr)
+    {
+    case R_PCON:
+        sfr[R_PCON] = v;
+        if (v & PCON_IDLE)
+            enter_power_mode();
+        break;
+    case R_IEN0:
+        sfr[R_IEN0] = v;
+        irq_holdoff = 1;            // One more instruction runs after IEN0 is written
+        break;
+    case R_P0IFG:
+    case R_DMAIRQ:
+    case R_RFIF:
+        sfr[addr] = old & v;        // Writing 1 has no effect
+        break;
+    case R_SLEEP:
+        account();
+        sfr[R_SLEEP] = (old & (SLEEP_XOSC_S | SLEEP_HFRC_S | SLEEP_RST)) |
+                       (v & ~(SLEEP_XOSC_S | SLEEP_HFRC_S | SLEEP_RST));
+        if (v & SLEEP_OSC_PD)
+        {
+            // Powers down the oscillator that is not the system clock
+            if (src_xosc)
+                rcosc_on = false;
+            else
+                xosc_on = false;
+        }
+        else
+        {
+            if (!xosc_on)
+            {
+                xosc_on = true;
+                xosc_stable_at = now + SIM_XOSC_STARTUP;
+            }
+            if (!rcosc_on)
+            {
+                rcosc_on = true;
+                rcosc_stable_at = now + SIM_RCOSC_STARTUP;
+            }
+        }
+        break;
+    case R_CLKCON:
+        clock_update();
+        sfr[R_CLKCON] = v;
+        if (!(v & CLKCON_OSC) != src_xosc)
+        {
+            if (!switch_pending)
+                switch_requested = now;
+            switch_pending = true;
+        }
+        else
+            switch_pending = false;
+        break;
+    case R_WORCTRL:
+        sfr[R_WORCTRL] = v & ~WORCTRL_WOR_RESET;
+        if (v & WORCTRL_WOR_RESET)
+            st_epoch = now;
+        st_schedule();
+        break;
+    case R_WOREVT0:
+    case R_WOREVT1:
+        sfr[addr] = v;
+        st_schedule();
+        break;
+    case R_ADCCON1:
+        sfr[R_ADCCON1] = (old & ADCCON1_EOC) | (v & (ADCCON1_STSEL | ADCCON1_RCTRL | 0x03));
+        if ((v & ADCCON1_STSEL) == ADCCON1_STSEL0)
+            adc_seq_start();
+        else if ((v & ADCCON1_ST) && (v & ADCCON1_STSEL) == ADCCON1_STSEL)
+            adc_seq_start();
+        break;
+    case R_ADCCON3:
+        sfr[R_ADCCON3] = v;
+        adc_extra_pending = true;
+        adc_start_next();
+        break;
+    case R_DMAARM:
+        {
+            int ch;
+            for (ch = 0; ch < SIM_DMA_CHANNELS; ch++)
+            {
+                if (!(v & (1 << ch)))
+                    continue;
+                if (v & DMAARM_ABORT)
+                {
+                    dma[ch].armed = false;
+                    sfr[R_DMAARM] &= ~(1 << ch);
+                }
+                else
+                {
+                    dma_load(ch);
+                    dma[ch].armed = true;
+                    sfr[R_DMAARM] |= 1 << ch;
+                }
+            }
+        }
+        break;
+    case R_DMAREQ:
+        {
+            int ch;
+            for (ch = 0; ch < SIM_DMA_CHANNELS; ch++)
+                if ((v & (1 << ch)) && dma[ch].armed)
+                    dma_start(ch);
+        }
+        break;
+    case R_T3CTL:
+        if (v & T3CTL_CLR)
+            sfr[R_T3CNT] = 0;
+        sfr[R_T3CTL] = v & ~T3CTL_CLR;
+        if ((v & T3CTL_START) && (!(old & T3CTL_START) || (v & T3CTL_CLR)))
+        {
+            t3_base = now;
+            t3_schedule();
+        }
+        else if (!(v & T3CTL_START))
+        {
+            if (old & T3CTL_START)
+                sfr[R_T3CNT] = t3_count();
+            ++t3_gen;
+        }
+        break;
+    case R_ENCCS:
+        sfr[R_ENCCS] = v & ~ENCCS_ST;
+        if (v & ENCCS_ST)
+            enc_start(v);
+        break;
+    case R_ENCDI:
+        enc_input(v);
+        break;
+    case R_FCTL:
+        sfr[R_FCTL] = (old & (FCTL_BUSY | FCTL_SWBSY | FCTL_WRITE)) | (v & FCTL_CONTRD);
+        if (v & FCTL_ERASE)
+            stop(true, "flash page erase is not simulated");
+        if ((v & FCTL_WRITE) && !(old & FCTL_BUSY))
+            flash_write_start();
+        break;
+    case R_FWDATA:
+        flash_write_data(v);
+        break;
+    case R_RFD:
+        sfr[R_RFD] = v;
+        rfd_tx = v;
+        rfd_full = true;
+        break;
+    case R_RFST:
+        radio_strobe(v);
+        break;
+    default:
+        sfr[addr] = v;
+        break;
+    }
+}
+
+
+/*==== FUNCTIONS =============================================================*/
+
+// Every CPU access: time passes, the instruction runs, then pending
+// interrupts are taken (unless held off by an IEN0 write just before)
+static void access_begin(uint32_t cycles)
+{
+    cpu_cycles(cycles);
+    totals.accesses++;
+    if (irq_holdoff)
+        irq_holdoff--;
+}
+
+uint8_t sim_reg_read(uint16_t addr)
+{
+    uint8_t v;
+
+    access_begin(SIM_CYCLES_PER_ACCESS);
+    v = reg_read(addr);
+    irq_dispatch();
+    return v;
+}
+
+void sim_reg_write(uint16_t addr, uint8_t value)
+{
+    access_begin(SIM_CYCLES_PER_ACCESS);
+    reg_write(addr, value);
+    irq_dispatch();
+}
+
+void sim_reg_update(uint16_t addr, uint8_t and_mask, uint8_t or_mask, uint8_t xor_mask)
+{
+    access_begin(SIM_CYCLES_PER_ACCESS);
+    reg_write(addr, (uint8_t)(((reg_read(addr) & and_mask) | or_mask) ^ xor_mask));
+    irq_dispatch();
+}
+
+void sim_nop(void)
+{
+    access_begin(1);
+    totals.accesses--;
+    irq_dispatch();
+}
+
+void sim_register_isr(uint8_t vector, void (*fn)(void))
+{
+    if (vector < SIM_VECTORS)
+        isr[vector] = fn;
+}
+
+void sim_init(const SimConfig &c)
+{
+    cfg = c;
+    rng.seed(c.seed);
+
+    // Reset values of the registers the firmware relies on
+    sfr[R_P0]       = 0xFF;
+    sfr[0x90]       = 0xFF;     // P1
+    sfr[0xA0]       = 0xFF;     // P2
+    sfr[R_CLKCON]   = 0xC1;
+    sfr[R_WOREVT1]  = 0x87;
+    sfr[R_WOREVT0]  = 0x6B;
+    sfr[R_ADCCON1]  = 0x33;
+    sfr[R_SLEEP]    = 0x00;
+    xreg[X_PKTLEN]  = 0xFF;
+    xreg[X_PKTCTRL0]= 0x45;
+    xreg[X_MDMCFG4] = 0x8C;
+    xreg[X_MDMCFG3] = 0x22;
+    xreg[X_MDMCFG2] = 0x02;
+    xreg[X_MDMCFG1] = 0x22;
+    xreg[X_MCSM1]   = 0x30;
+    xreg[X_MCSM0]   = 0x04;
+    marc            = MARC_STATE_IDLE;
+    p0_pins         = 0x00;
+    memset(flash, 0xFF, sizeof(flash));
+
+    rcosc_on        = true;
+    rcosc_stable_at = SIM_RCOSC_STARTUP;
+    xosc_on         = true;     // SLEEP.OSC_PD = 0 after reset
+    xosc_stable_at  = SIM_XOSC_STARTUP;
+
+    cpu_state       = SIM_CPU_ACTIVE;
+    wake_vector     = -1;
+
+    input_mv[SIM_IN_VDD]  = 3000;
+    input_mv[SIM_IN_TEMP] = 750;
+
+    if (c.state_log)
+    {
+        state_log = fopen(c.state_log, "w");
+        if (!state_log)
+            stop(true, "cannot write %s", c.state_log);
+        fprintf(state_log, "t,duration,cpu,radio,xosc,adc,cpu_xosc,pa\n");
+    }
+
+    st_schedule();
+    at(c.duration, []() { stop(false, "end of simulated time"); });
+}
+
+double sim_now(void)
+{
+    return now;
+}
+
+void sim_at(double t, std::function<void()> fn)
+{
+    at(t, fn);
+}
+
+void sim_set_input(int input, double mv)
+{
+    if (input >= 0 && input < SIM_IN_COUNT)
+        input_mv[input] = mv;
+}
+
+void sim_set_noise(double mv)
+{
+    noise_mv = mv;
+}
+
+void sim_pir_edge(void)
+{
+    p0_set(p0_pins | 0x01);
+    at(now + SIM_PIR_PULSE, []() { p0_set(p0_pins & ~0x01); });
+}
+
+// AIN0 swinging around 'mid' from 'start' until 'end'
+static void pir_swing(double start, double end, double mid)
+{
+    if (now >= end)
+    {
+        input_mv[SIM_IN_AIN0] = mid;
+        return;
+    }
+    input_mv[SIM_IN_AIN0] = mid + SIM_PIR_SWING_MV * sin(2 * M_PI * SIM_PIR_SWING_HZ * (now - start));
+    at(now + SIM_PIR_SWING_STEP, [=]() { pir_swing(start, end, mid); });
+}
+
+void sim_pir_motion(double seconds)
+{
+    pir_swing(now, now + seconds, input_mv[SIM_IN_AIN0]);
+}
+
+const uint8_t *sim_flash(uint16_t addr)
+{
+    return flash + (addr % SIM_FLASH_SIZE);
+}
+
+void sim_flash_write(uint16_t addr, const uint8_t *data, size_t len)
+{
+    if ((size_t)addr + len > SIM_FLASH_SIZE)
+        stop(true, "flash write past 0x%04X", SIM_FLASH_SIZE);
+    memcpy(flash + addr, data, len);
+}
+
+void sim_air_busy(double seconds)
+{
+    air_busy_until = std::max(air_busy_until, now + seconds);
+}
+
+void sim_air_frame(const std::vector<uint8_t> &frame)
+{
+    uint8_t crc = (xreg[X_PKTCTRL0] & 0x04) ? 2 : 0;
+
+    sim_air_busy((radio_head_bytes() + frame.size() + crc) * radio_byte_time());
+    rx_bytes = frame;
+    at(now + radio_head_bytes() * radio_byte_time(), []() { radio_rx_sync(); });
+}
+
+void sim_on_packet(std::function<void(const SimPacket &)> fn)
+{
+    packet_cb = fn;
+}
+
+const SimStats &sim_totals(void)
+{
+    account();
+    return totals;
+}
+
+void sim_report(FILE *out)
+{
+    static const char *const cpu_name[SIM_CPU_STATES] = { "active", "idle", "PM1", "PM2", "PM3" };
+    static const char *const radio_name[SIM_RADIO_STATES] = { "idle", "cal/settle", "TX", "RX" };
+    double t = now > 0 ? now : 1;
+    int    i;
+
+    account();
+    if (state_log)
+    {
+        log_state(-1);
+        fclose(state_log);
+        state_log = NULL;
+    }
+
+    fprintf(out, "Simulated time      %12.6f s\n", now);
+    fprintf(out, "Wake-ups            %12u\n", totals.wakes);
+    fprintf(out, "Packets sent        %12u\n", totals.packets);
+    fprintf(out, "Register accesses   %12u\n", totals.accesses);
+    for (i = 0; i < SIM_CPU_STATES; i++)
+        fprintf(out, "CPU %-15s %12.6f s  %7.3f %%\n", cpu_name[i], totals.cpu[i], 100 * totals.cpu[i] / t);
+    fprintf(out, "CPU on HS XOSC      %12.6f s  %7.3f %%\n", totals.cpu_xosc, 100 * totals.cpu_xosc / t);
+    fprintf(out, "HS XOSC powered     %12.6f s  %7.3f %%\n", totals.xosc_on, 100 * totals.xosc_on / t);
+    for (i = 0; i < SIM_RADIO_STATES; i++)
+        fprintf(out, "Radio %-13s %12.6f s  %7.3f %%\n", radio_name[i], totals.radio[i], 100 * totals.radio[i] / t);
+    fprintf(out, "ADC converting      %12.6f s  %7.3f %%\n", totals.adc, 100 * totals.adc / t);
+    if (totals.wakes)
+        fprintf(out, "Awake per wake-up   %12.3f ms\n",
+                (totals.cpu[SIM_CPU_ACTIVE] + totals.cpu[SIM_CPU_IDLE]) * 1e3 / totals.wakes);
+}
+
+/*==== END OF FILE ==========================================================*/
@@ -0,0 +1,141 @@
+#ifndef SIM_HAL_H
+#define SIM_HAL_H
+
+/***********************************************************************************
+* HOST SIMULATION HAL
+*
+* Included by compiler.h when the firmware is built with -DHOST_SIM. Every SFR,
+* SBIT and xdata register declared in cc1110.h becomes an object whose reads
+* and writes go to the simulated CC1110 in sim_hal.cpp, so the firmware sources
+* compile unchanged with g++ (as C++, see 'make sim') and run on Linux against
+* a register file with a sleep timer, clock oscillators, ADC, DMA, Timer 3,
+* Port 0 interrupt, AES coprocessor and a radio state machine behind it.
+*/
+
+#ifndef __cplusplus
+#error "The host simulation HAL needs a C++ compiler, build the firmware with g++ -x c++"
+#endif
+
+#include <stdint.h>
+
+/*==== FUNCTIONS =============================================================*/
+
+// Register file access (SFR 0x80-0xFF, xdata registers 0xDF00-0xDFFF).
+// Each CPU access costs simulated time and may run due peripheral events and
+// pending interrupts.
+uint8_t  sim_reg_read(uint16_t addr);
+void     sim_reg_write(uint16_t addr, uint8_t value);
+
+// Read-modify-write as one access: ((reg & and_mask) | or_mask) ^ xor_mask.
+// ORL/ANL/XRL and SETB/CLR/CPL are single instructions on the 8051, so
+// hardware cannot set a flag between the read and the write.
+void     sim_reg_update(uint16_t addr, uint8_t and_mask, uint8_t or_mask, uint8_t xor_mask);
+
+// One NOP worth of CPU time
+void     sim_nop(void);
+
+// Install the firmware ISR for an interrupt vector (see INTERRUPT())
+void     sim_register_isr(uint8_t vector, void (*isr)(void));
+
+// 16 bit xdata address of a firmware object as seen by the simulated DMA
+// controller. Firmware variables live in host memory, so each object handed
+// to the DMA gets an xdata window of its own; the DMA maps it back.
+uint16_t sim_xaddr(const volatile void *p);
+
+// The firmware's main(), renamed below so the simulator can provide its own
+void     sim_firmware_main(void);
+
+// Flash (code memory) at 'addr', for data the firmware reads out of flash
+// (see device_identity.h). Erased flash reads 0xFF.
+const uint8_t *sim_flash(uint16_t addr);
+
+
+/*==== TYPES =================================================================*/
+
+// 8 bit register at an SFR or xdata address
+class SimReg
+{
+public:
+    explicit SimReg(uint16_t addr) : addr_(addr) {}
+
+    operator uint8_t() const                { return sim_reg_read(addr_); }
+
+    SimReg &operator=(const SimReg &r)      { return *this = (unsigned)(uint8_t)r; }
+    SimReg &operator=(unsigned v)           { sim_reg_write(addr_, (uint8_t)v); return *this; }
+    SimReg &operator|=(unsigned v)          { sim_reg_update(addr_, 0xFF, (uint8_t)v, 0); return *this; }
+    SimReg &operator&=(unsigned v)          { sim_reg_update(addr_, (uint8_t)v, 0, 0); return *this; }
+    SimReg &operator^=(unsigned v)          { sim_reg_update(addr_, 0xFF, 0, (uint8_t)v); return *this; }
+    SimReg &operator+=(unsigned v)          { return *this = sim_reg_read(addr_) + v; }
+    SimReg &operator-=(unsigned v)          { return *this = sim_reg_read(addr_) - v; }
+    SimReg &operator++()                    { return *this += 1; }
+    SimReg &operator--()                    { return *this -= 1; }
+    uint8_t operator++(int)                 { uint8_t v = *this; *this = v + 1; return v; }
+    uint8_t operator--(int)                 { uint8_t v = *this; *this = v - 1; return v; }
+
+    uint16_t addr() const                   { return addr_; }
+
+private:
+    uint16_t addr_;
+};
+
+// Bit addressable SFR bit
+class SimBit
+{
+public:
+    SimBit(uint8_t addr, uint8_t bit) : addr_(addr), mask_((uint8_t)(1 << bit)) {}
+
+    operator uint8_t() const                { return (sim_reg_read(addr_) & mask_) ? 1 : 0; }
+
+    SimBit &operator=(const SimBit &b)      { return *this = (unsigned)(uint8_t)b; }
+    SimBit &operator=(unsigned v)
+    {
+        sim_reg_update(addr_, (uint8_t)~mask_, (v & 1) ? mask_ : 0, 0);
+        return *this;
+    }
+    SimBit &operator^=(unsigned v)          { sim_reg_update(addr_, 0xFF, 0, (v & 1) ? mask_ : 0); return *this; }
+    SimBit &operator|=(unsigned v)          { sim_reg_update(addr_, 0xFF, (v & 1) ? mask_ : 0, 0); return *this; }
+    SimBit &operator&=(unsigned v)          { sim_reg_update(addr_, (v & 1) ? 0xFF : (uint8_t)~mask_, 0, 0); return *this; }
+
+private:
+    uint8_t addr_;
+    uint8_t mask_;
+};
+
+// Registers an ISR with the simulator at static initialisation time
+struct SimIsr
+{
+    SimIsr(uint8_t vector, void (*isr)(void)) { sim_register_isr(vector, isr); }
+};
+
+inline uint16_t sim_xaddr(const SimReg *r) { return r->addr(); }
+
+
+/*==== MACROS=================================================================*/
+
+# define SBIT(name, addr, bit)  SimBit name(addr, bit)
+# define SFR(name, addr)        SimReg name(addr)
+# define SFRX(name, addr)       SimReg name(addr)
+# define SFR16(name, addr)      /* not supported */
+# define SFR16E(name, fulladdr) /* not supported */
+# define SFR16LEX(name, addr)   /* not supported */
+# define SFR32(name, fulladdr)  /* not supported */
+# define SFR32E(name, fulladdr) /* not supported */
+
+# define INTERRUPT(name, vector) \
+    void name(void); \
+    static SimIsr name##_sim_isr(vector, name); \
+    void name(void)
+# define INTERRUPT_USING(name, vector, regnum) INTERRUPT(name, vector)
+
+#define NOP() sim_nop()
+
+// See hal_dma.h
+#define XDATA_ADDR(p)   sim_xaddr(p)
+
+// 'void main(void)' is not valid C++, and the simulator has a main() of its own
+#define main            sim_firmware_main
+
+
+#endif /* SIM_HAL_H */
+
+/*==== END OF FILE ==========================================================*/
@@ -0,0 +1,445 @@
+/***********************************************************************************
+* HOST SIMULATION - FRONT END
+*
+* Runs the firmware against the simulated CC1110 for a given stretch of
+* simulated time and prints where the time went. Built by 'make sim'.
+*
+*   sensor-sim [-t seconds] [-v] [-l states.csv] [-s seed] [-n noise_mv]
+*              [-i INPUT=mV[@t]]... [-p t]... [-P period] [-m t[:seconds]]...
+*              [-w capture] [-a address[:destination]] [-k key] [-e sessions]
+*              [-A] [-L loss_pct] [-C rate]
+*
+*   -t  Simulated seconds to run (default 60)
+*   -v  One line per wake-up and per packet
+*   -l  Write the power state intervals to a CSV file
+*   -s  Seed for the ADC noise
+*   -n  ADC input noise, standard deviation in mV (default 0)
+*   -i  Set an input (AIN0..AIN7, VDD, TEMP) to mV, at time t if given
+*   -p  PIR pulse at time t
+*   -P  PIR pulse every 'period' seconds
+*   -m  PIR motion from time t: AIN0 swings around its level for 'seconds'
+*       (default 5), for the PIR_DSP motion detector
+*   -w  Write the packets sent to a capture file for the gateway's
+*       sensor-replay (source 0, see gateway/sensor_replay.cpp)
+*   -a  Provision the device: put an identity record for 'address' (and
+*       'destination', default 0, and the radio profile of the site by
+*       name, e.g. 12:0:robust) in the identity flash page
+*   -k  Provision the device's AES key (RADIO_AES builds), 32 hex digits
+*   -e  Sessions the device has started before (RADIO_AES builds): that many
+*       bits of the session counter in the identity page are already
+*       cleared, so the run's first session is number 'sessions' + 1
+*   -A  Gateway that acknowledges every packet asking for it (RADIO_ACK
+*       builds), SIM_GATEWAY_TURNAROUND after the end of the packet. It
+*       opens secured packets (RADIO_AES) with the -k key, or RADIO_AES_KEY,
+*       and ignores those that fail the check.
+*   -L  Loss on the link in percent, applied to every packet and every ACK
+*       on its own. Packets lost do not go to the capture file.
+*   -C  Other sensors on the channel: 'rate' packets per second on average,
+*       at random (Poisson) times, each SIM_OTHER_AIRTIME long. They keep
+*       the channel busy for RADIO_CCA builds, and a packet that overlaps
+*       one of them is lost in the collision.
+*
+* The exit status is 1 if the firmware did something the chip would not
+* allow (see sim_hal.cpp), 2 for bad arguments.
+*/
+
+#include "sim.h"
+
+#define IDENTITY_HOST
+#include "device_identity.h"
+#define CRYPT_HOST
+#include "sensor_crypt.h"
+#define RADIO_HOST
+#include "cc1110_radio_tables.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <deque>
+#include <random>
+
+/*==== CONSTS ================================================================*/
+
+// Inputs at reset: 3.0 V supply, PIR at rest around mid-supply, thermopile
+// and thermistor at a room temperature reading
+static const struct {
+    const char *name;
+    int         input;
+    double      mv;
+} sim_inputs[] = {
+    { "AIN0", SIM_IN_AIN0 + 0, 1500 },
+    { "AIN1", SIM_IN_AIN0 + 1,  400 },
+    { "AIN2", SIM_IN_AIN0 + 2,    0 },
+    { "AIN3", SIM_IN_AIN0 + 3,    0 },
+    { "AIN4", SIM_IN_AIN0 + 4,    0 },
+    { "AIN5", SIM_IN_AIN0 + 5,    0 },
+    { "AIN6", SIM_IN_AIN0 + 6, 1200 },
+    { "AIN7", SIM_IN_AIN0 + 7,    0 },
+    { "VDD",  SIM_IN_VDD,      3000 },
+    { "TEMP", SIM_IN_TEMP,      750 },
+};
+
+#define SIM_INPUT_NAMES (sizeof(sim_inputs) / sizeof(sim_inputs[0]))
+
+// Simulated gateway (-A): end of a packet to the start of its ACK
+#define SIM_GATEWAY_TURNAROUND  150e-6
+
+// Air time of another sensor's packet (-C), about that of one of ours
+#define SIM_OTHER_AIRTIME       0.9e-3
+
+// Frame layout the gateway looks at, see cc1110_radio.h and payload.h
+#define SIM_FRAME_DEST          1
+#define SIM_FRAME_DEVICE        2
+#define SIM_FRAME_SEQ           3
+#define SIM_FRAME_VERSION       4
+#define SIM_PAYLOAD_VERSION     0x01
+#define SIM_PAYLOAD_FLAG_ACK    0x08
+
+
+/*==== TYPES =================================================================*/
+
+// What the simulated link and gateway did
+struct SimLink {
+    double        loss;         // Probability of losing a packet or an ACK
+    bool          ack;          // Gateway sends ACKs
+    uint8_t       key[CRYPT_KEY_SIZE];  // Gateway's key for secured packets
+    double        load;         // Other sensors' packets per second
+    std::mt19937  rng;
+    std::deque<double> others;  // Start of other sensors' recent packets
+    unsigned long others_sent;
+    unsigned long received;
+    unsigned long lost;
+    unsigned long collided;
+    unsigned long acks;
+    unsigned long acks_lost;
+};
+
+
+/*==== LOCAL FUNCTIONS =======================================================*/
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: sensor-sim [-t seconds] [-v] [-l states.csv] [-s seed] [-n noise_mv]\n"
+        "                  [-i INPUT=mV[@t]]... [-p t]... [-P period] [-m t[:seconds]]...\n"
+        "                  [-w capture] [-a address[:destination[:profile]]] [-k key]\n"
+        "                  [-e sessions] [-A] [-L loss_pct] [-C rate]\n"
+        "INPUT is one of AIN0..AIN7, VDD, TEMP\n");
+    exit(2);
+}
+
+// "AIN1=650" or "AIN1=650@30"
+static void parse_input(const char *arg)
+{
+    const char *eq = strchr(arg, '=');
+    const char *when;
+    double      mv, t = 0;
+    size_t      i;
+
+    if (!eq)
+        usage();
+    for (i = 0; i < SIM_INPUT_NAMES; i++)
+        if (strlen(sim_inputs[i].name) == (size_t)(eq - arg) &&
+            !strncmp(arg, sim_inputs[i].name, eq - arg))
+            break;
+    if (i == SIM_INPUT_NAMES)
+        usage();
+
+    mv = atof(eq + 1);
+    when = strchr(eq, '@');
+    if (when)
+        t = atof(when + 1);
+
+    int input = sim_inputs[i].input;
+    if (t > 0)
+        sim_at(t, [input, mv]() { sim_set_input(input, mv); });
+    else
+        sim_set_input(input, mv);
+}
+
+// "12" or "12:3"
+static void parse_motion(const char *arg)
+{
+    const char *colon = strchr(arg, ':');
+    double      t = atof(arg);
+    double      seconds = colon ? atof(colon + 1) : 5.0;
+
+    if (t < 0 || seconds <= 0)
+        usage();
+    sim_at(t, [seconds]() { sim_pir_motion(seconds); });
+}
+
+// "12", "12:200" or "12:200:robust"
+static void provision(const char *arg)
+{
+    const char *colon = strchr(arg, ':');
+    const char *colon2 = colon ? strchr(colon + 1, ':') : NULL;
+    long        address = strtol(arg, NULL, 0);
+    long        destination = colon ? strtol(colon + 1, NULL, 0) : 0;
+    uint8       profile = IDENTITY_PROFILE_NONE;
+    uint8       rec[IDENTITY_SIZE];
+
+    if (address < IDENTITY_ADDRESS_MIN || address > IDENTITY_ADDRESS_MAX ||
+        destination < 0 || destination > 255)
+        usage();
+    if (colon2)
+    {
+        for (profile = 0; profile < RADIO_PROFILES; profile++)
+            if (!strcmp(colon2 + 1, radio_profile_names[profile]))
+                break;
+        if (profile == RADIO_PROFILES)
+            usage();
+    }
+    identity_make(rec, (uint8)address, (uint8)destination, profile);
+    sim_flash_write(IDENTITY_PAGE_ADDR, rec, sizeof(rec));
+}
+
+static void provision_key(const uint8_t *key)
+{
+    uint8 rec[IDENTITY_KEY_SIZE];
+
+    identity_key_make(rec, key);
+    sim_flash_write(IDENTITY_KEY_ADDR, rec, sizeof(rec));
+}
+
+// The counter words as the firmware leaves them (deviceSessionNext())
+static void provision_sessions(long sessions)
+{
+    uint8 word[2];
+    long  n, used;
+
+    for (n = 0; n * IDENTITY_SESSION_BITS < sessions; n++)
+    {
+        used = sessions - n * IDENTITY_SESSION_BITS;
+        if (used > IDENTITY_SESSION_BITS)
+            used = IDENTITY_SESSION_BITS;
+        word[0] = (uint8)(0xFF << used);
+        word[1] = 0xFF;
+        sim_flash_write((uint16_t)(IDENTITY_SESSIONS_ADDR + 2 * n), word, sizeof(word));
+    }
+}
+
+static void pir_every(double period)
+{
+    sim_pir_edge();
+    sim_at(sim_now() + period, [period]() { pir_every(period); });
+}
+
+static void print_packet(const SimPacket &p, const char *note)
+{
+    size_t i;
+
+    printf("%12.6f  packet %3u bytes  air %7.3f ms ", p.t, (unsigned)p.data.size(), p.airtime * 1e3);
+    for (i = 0; i < p.data.size(); i++)
+        printf(" %02X", p.data[i]);
+    printf("%s%s\n", note ? "  " : "", note ? note : "");
+}
+
+// Capture record: source (LE 32 bit), frame length, frame
+static void capture_packet(FILE *f, const SimPacket &p)
+{
+    uint8_t hdr[5] = { 0, 0, 0, 0, (uint8_t)p.data.size() };
+
+    fwrite(hdr, 1, sizeof(hdr), f);
+    fwrite(p.data.data(), 1, p.data.size(), f);
+}
+
+
+static bool link_lost(SimLink &link)
+{
+    return link.loss > 0 && std::uniform_real_distribution<double>(0, 1)(link.rng) < link.loss;
+}
+
+// Another sensor's packet goes on air now; the next one follows after an
+// exponentially distributed gap
+static void other_sensor(SimLink &link)
+{
+    double t = sim_now();
+
+    sim_air_busy(SIM_OTHER_AIRTIME);
+    link.others.push_back(t);
+    while (link.others.front() < t - 1.0)
+        link.others.pop_front();
+    link.others_sent++;
+    sim_at(t + std::exponential_distribution<double>(link.load)(link.rng),
+           [&link]() { other_sensor(link); });
+}
+
+// The packet overlapped one from another sensor
+static bool link_collided(const SimLink &link, const SimPacket &p)
+{
+    for (double t : link.others)
+        if (t < p.t + p.airtime && t + SIM_OTHER_AIRTIME > p.t)
+            return true;
+    return false;
+}
+
+// A packet reached the gateway: acknowledge it if it asks for that, as the
+// address it was sent to. Secured packets are opened first.
+static void gateway_receive(SimLink &link, const SimPacket &p)
+{
+    std::vector<uint8_t> d = p.data;
+    size_t               at = SIM_FRAME_VERSION;
+
+    if (!link.ack)
+        return;
+    if (d.size() >= (size_t)CRYPT_PAYLOAD_INDEX + CRYPT_MIC_SIZE && d[CRYPT_MARKER_INDEX] == CRYPT_MARKER)
+    {
+        if (!crypt_ccm_open(link.key, d.data(), d.size() - CRYPT_PAYLOAD_INDEX - CRYPT_MIC_SIZE))
+            return;
+        at = CRYPT_PAYLOAD_INDEX;
+    }
+    if (d.size() <= at + 1 || d[at] != SIM_PAYLOAD_VERSION || !(d[at + 1] & SIM_PAYLOAD_FLAG_ACK))
+        return;
+
+    std::vector<uint8_t> ack = { 3, d[SIM_FRAME_DEVICE], d[SIM_FRAME_DEST], d[SIM_FRAME_SEQ] };
+
+    link.acks++;
+    if (link_lost(link))
+    {
+        link.acks_lost++;
+        return;
+    }
+    sim_at(sim_now() + SIM_GATEWAY_TURNAROUND, [ack]() { sim_air_frame(ack); });
+}
+
+
+/*==== FUNCTIONS =============================================================*/
+
+int main(int argc, char **argv)
+{
+    SimConfig            cfg = { 60.0, NULL, false, 1 };
+    std::vector<double>  pir;
+    std::vector<char *>  inputs;
+    std::vector<char *>  motion;
+    double               pir_period = 0;
+    double               noise = 0;
+    FILE                *capture = NULL;
+    const char          *identity = NULL;
+    bool                 has_key = false;
+    long                 sessions = 0;
+    SimLink              link = SimLink();
+    size_t               i;
+    int                  opt;
+    int                  status = 0;
+
+    memcpy(link.key, crypt_default_key, sizeof(link.key));
+    while ((opt = getopt(argc, argv, "t:vl:s:n:i:p:P:m:w:a:k:e:AL:C:")) != -1)
+    {
+        switch (opt)
+        {
+        case 't': cfg.duration = atof(optarg);              break;
+        case 'v': cfg.verbose = true;                       break;
+        case 'l': cfg.state_log = optarg;                   break;
+        case 's': cfg.seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'n': noise = atof(optarg);                     break;
+        case 'i': inputs.push_back(optarg);                 break;
+        case 'p': pir.push_back(atof(optarg));              break;
+        case 'P': pir_period = atof(optarg);                break;
+        case 'm': motion.push_back(optarg);                 break;
+        case 'w':
+            capture = fopen(optarg, "wb");
+            if (!capture)
+            {
+                fprintf(stderr, "sim: cannot write %s\n", optarg);
+                exit(2);
+            }
+            break;
+        case 'a': identity = optarg;                        break;
+        case 'k':
+            if (!crypt_parse_key(optarg, link.key))
+                usage();
+            has_key = true;
+            break;
+        case 'e': sessions = strtol(optarg, NULL, 0);       break;
+        case 'A': link.ack = true;                          break;
+        case 'L': link.loss = atof(optarg) / 100;           break;
+        case 'C': link.load = atof(optarg);                 break;
+        default:  usage();
+        }
+    }
+    if (optind != argc || cfg.duration <= 0 || link.loss < 0 || link.loss > 1 || link.load < 0 ||
+        sessions < 0 || sessions > IDENTITY_SESSIONS_MAX)
+        usage();
+    link.rng.seed(cfg.seed);
+
+    try
+    {
+        sim_init(cfg);
+        for (i = 0; i < SIM_INPUT_NAMES; i++)
+            sim_set_input(sim_inputs[i].input, sim_inputs[i].mv);
+        for (char *arg : inputs)
+            parse_input(arg);
+        sim_set_noise(noise);
+        if (identity)
+            provision(identity);
+        if (has_key)
+            provision_key(link.key);
+        provision_sessions(sessions);
+
+        for (double t : pir)
+            sim_at(t, []() { sim_pir_edge(); });
+        for (char *arg : motion)
+            parse_motion(arg);
+        if (pir_period > 0)
+            sim_at(pir_period, [pir_period]() { pir_every(pir_period); });
+        if (link.load > 0)
+            sim_at(std::exponential_distribution<double>(link.load)(link.rng),
+                   [&link]() { other_sensor(link); });
+
+        if (cfg.verbose || capture || link.ack || link.loss > 0 || link.load > 0)
+            sim_on_packet([&cfg, capture, &link](const SimPacket &p) {
+                bool lost = link_lost(link);
+                bool collided = link_collided(link, p);
+
+                if (cfg.verbose)
+                    print_packet(p, collided ? "(collided)" : lost ? "(lost)" : NULL);
+                if (collided)
+                {
+                    link.collided++;
+                    return;
+                }
+                if (lost)
+                {
+                    link.lost++;
+                    return;
+                }
+                link.received++;
+                if (capture)
+                    capture_packet(capture, p);
+                gateway_receive(link, p);
+            });
+
+        sim_firmware_main();
+    }
+    catch (const SimStop &s)
+    {
+        if (s.error)
+        {
+            fprintf(stderr, "sim: %.6f s: %s\n", sim_now(), s.why.c_str());
+            status = 1;
+        }
+    }
+
+    if (capture)
+        fclose(capture);
+    sim_report(stdout);
+    if (link.ack || link.loss > 0 || link.load > 0)
+    {
+        printf("Packets received    %12lu\n", link.received);
+        printf("Packets lost        %12lu\n", link.lost);
+    }
+    if (link.load > 0)
+    {
+        printf("Packets collided    %12lu\n", link.collided);
+        printf("Other sensors' pkts %12lu\n", link.others_sent);
+    }
+    if (link.ack)
+    {
+        printf("ACKs sent           %12lu\n", link.acks);
+        printf("ACKs lost           %12lu\n", link.acks_lost);
+    }
+    return status;
+}
+
+/*==== END OF FILE ==========================================================*/
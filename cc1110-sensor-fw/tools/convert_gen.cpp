@@ -0,0 +1,163 @@
+/***********************************************************************************
+* CONVERSION TABLE GENERATOR
+*
+* Writes sensor_convert_tables.h, the fixed-point tables used by
+* sensor_convert.h, to stdout. The sensor parameters come from
+* sensor_config.h and any -D overrides this is compiled with, so the tables
+* always match the build options. Run by 'make' when they change.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sensor_config.h"
+
+/*==== CONSTS ================================================================*/
+
+#define KELVIN                  273.15
+
+// Thermistor: one entry every 2^STEP_BITS counts of the 10 bit reading, whose
+// full scale (AVDD) is 512 counts
+#define THERMISTOR_STEP_BITS    4
+#define THERMISTOR_ENTRIES      ((512 >> THERMISTOR_STEP_BITS) + 1)
+#define THERMISTOR_MIN_C        (-40.0)
+#define THERMISTOR_MAX_C        125.0
+
+// Thermopile radiance: one entry every 2^STEP_BITS hundredths of a degree
+// (5.12 C) from -20.48 C to 122.88 C, so no division is needed to look up
+// the ambient temperature
+#define RADIANCE_MIN_C100       (-2048)
+#define RADIANCE_STEP_BITS      9
+#define RADIANCE_ENTRIES        29
+#define RADIANCE_MAX_FRAC_BITS  8
+
+// Battery: VDD/3 at 12 bits against 1.25 V, reported as VDD * 10
+#define BATTERY_FULL_SCALE      2047
+#define BATTERY_NUM             375     // 3 * 1.25 V * 10 * 10
+#define BATTERY_DEN             (BATTERY_FULL_SCALE * 10)
+
+
+/*==== LOCAL FUNCTIONS =======================================================*/
+
+static void fail(const char *why)
+{
+    fprintf(stderr, "convert_gen: %s\n", why);
+    exit(1);
+}
+
+// NTC temperature at a 10 bit reading, C
+static double thermistor_c(int counts)
+{
+    double r = counts / 512.0;
+    double rt;
+
+    if (counts <= 0)
+        return THERMISTOR_MAX_C;
+    if (counts >= 512)
+        return THERMISTOR_MIN_C;
+
+    rt = THERMISTOR_R_SERIES * r / (1 - r);
+    double t = 1 / (1 / (25 + KELVIN) + log(rt / THERMISTOR_R25) / THERMISTOR_BETA) - KELVIN;
+    if (t < THERMISTOR_MIN_C)
+        t = THERMISTOR_MIN_C;
+    if (t > THERMISTOR_MAX_C)
+        t = THERMISTOR_MAX_C;
+    return t;
+}
+
+// Battery multiplier for a shift that matches the exact quotient for every
+// reading, 0 if there is none
+static long battery_mul(int shift)
+{
+    long m = (long)floor((double)BATTERY_NUM * (1L << shift) / BATTERY_DEN);
+    long c;
+    int  v;
+
+    for (c = m; c <= m + 1; c++)
+    {
+        for (v = 0; v <= BATTERY_FULL_SCALE; v++)
+            if (((long)v * c) >> shift != (long)v * BATTERY_NUM / BATTERY_DEN)
+                break;
+        if (v > BATTERY_FULL_SCALE)
+            return c;
+    }
+    return 0;
+}
+
+// Thermopile counts of a target at table entry 'i' against one at the
+// first entry
+static double radiance(int i)
+{
+    double t25 = 25 + KELVIN;
+    double k = THERMOPILE_COUNTS_PER_C / (4 * t25 * t25 * t25);
+    double t0 = RADIANCE_MIN_C100 / 100.0 + KELVIN;
+    double t = (RADIANCE_MIN_C100 + (i << RADIANCE_STEP_BITS)) / 100.0 + KELVIN;
+
+    return k * (t * t * t * t - t0 * t0 * t0 * t0);
+}
+
+
+/*==== FUNCTIONS =============================================================*/
+
+int main(void)
+{
+    int    i, shift, frac_bits;
+    long   mul = 0;
+    double top;
+
+    // Smallest shift with an exact multiplier
+    for (shift = 8; shift <= 24 && !mul; shift++)
+        mul = battery_mul(shift);
+    shift--;
+    if (!mul)
+        fail("no fixed-point battery scale found");
+
+    top = radiance(RADIANCE_ENTRIES - 1);
+    for (frac_bits = RADIANCE_MAX_FRAC_BITS; frac_bits > 0 && top * (1 << frac_bits) > 32767; frac_bits--)
+        ;
+    if (top * (1 << frac_bits) > 32767)
+        fail("THERMOPILE_COUNTS_PER_C too large for the radiance table");
+
+    printf("#ifndef SENSOR_CONVERT_TABLES_H\n");
+    printf("#define SENSOR_CONVERT_TABLES_H\n\n");
+    printf("/***********************************************************************************\n");
+    printf("* Generated by tools/convert_gen.cpp from sensor_config.h - do not edit.\n");
+    printf("*\n");
+    printf("* THERMISTOR_R25 %.1f, THERMISTOR_BETA %.1f, THERMISTOR_R_SERIES %.1f\n",
+           (double)THERMISTOR_R25, (double)THERMISTOR_BETA, (double)THERMISTOR_R_SERIES);
+    printf("* THERMOPILE_COUNTS_PER_C %.3f\n", (double)THERMOPILE_COUNTS_PER_C);
+    printf("*/\n\n");
+
+    printf("// Battery: VDD * 10 = (raw * MUL) >> SHIFT, exact for 0..%d\n", BATTERY_FULL_SCALE);
+    printf("#define CONVERT_BATTERY_MUL         %ldUL\n", mul);
+    printf("#define CONVERT_BATTERY_SHIFT       %d\n\n", shift);
+
+    printf("// Temperature tables, only built with CONVERT_TEMPERATURE (sensor_convert.h)\n");
+    printf("#ifdef CONVERT_TEMPERATURE\n\n");
+
+    printf("// Thermistor: C * 100 every %d counts of the 10 bit reading\n", 1 << THERMISTOR_STEP_BITS);
+    printf("#define CONVERT_THERMISTOR_STEP_BITS  %d\n", THERMISTOR_STEP_BITS);
+    printf("#define CONVERT_THERMISTOR_ENTRIES    %d\n", THERMISTOR_ENTRIES);
+    printf("static const int16 CONVERT_TABLE convert_thermistor_table[CONVERT_THERMISTOR_ENTRIES] = {");
+    for (i = 0; i < THERMISTOR_ENTRIES; i++)
+        printf("%s%6ld,", i % 8 ? " " : "\n   ", lround(thermistor_c(i << THERMISTOR_STEP_BITS) * 100));
+    printf("\n};\n\n");
+
+    printf("// Thermopile: counts * 2^FRAC_BITS of a target at C * 100 = MIN_C + (i << STEP_BITS)\n");
+    printf("#define CONVERT_RADIANCE_MIN_C      (%d)\n", RADIANCE_MIN_C100);
+    printf("#define CONVERT_RADIANCE_STEP_BITS  %d\n", RADIANCE_STEP_BITS);
+    printf("#define CONVERT_RADIANCE_ENTRIES    %d\n", RADIANCE_ENTRIES);
+    printf("#define CONVERT_RADIANCE_FRAC_BITS  %d\n", frac_bits);
+    printf("static const int16 CONVERT_TABLE convert_radiance_table[CONVERT_RADIANCE_ENTRIES] = {");
+    for (i = 0; i < RADIANCE_ENTRIES; i++)
+        printf("%s%6ld,", i % 8 ? " " : "\n   ",
+               lround(radiance(i) * (1 << frac_bits)));
+    printf("\n};\n\n");
+    printf("#endif /* CONVERT_TEMPERATURE */\n\n");
+
+    printf("#endif /* SENSOR_CONVERT_TABLES_H */\n");
+    return 0;
+}
+
+/*==== END OF FILE ==========================================================*/
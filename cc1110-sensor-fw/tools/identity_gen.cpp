@@ -0,0 +1,152 @@
+/***********************************************************************************
+* DEVICE IDENTITY PROVISIONING
+*
+* Adds a device identity record (device_identity.h) to a firmware image and
+* writes the result to stdout, for 'make provision'.
+*
+*   identity-gen -a address [-d destination] [-p profile] [-k key] image.hex
+*
+*   -a  Device address, 1 to 254
+*   -d  Destination address, 0 (broadcast, default) to 255
+*   -p  Radio profile of the site by name (profiles/name.rf), default the
+*       build's RADIO_PROFILE
+*   -k  AES-128 key for RADIO_AES builds, 32 hex digits (sensor_crypt.h)
+*
+* The image is an Intel HEX file as written by packihx. It must not have data
+* in the identity page, which the linker keeps free (--code-size).
+*/
+
+#define IDENTITY_HOST
+#define CRYPT_HOST
+#define RADIO_HOST
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "device_identity.h"
+#include "sensor_crypt.h"
+#include "cc1110_radio_tables.h"
+
+/*==== CONSTS ================================================================*/
+
+#define HEX_LINE_MAX            600
+#define HEX_TYPE_DATA           0x00
+#define HEX_TYPE_EOF            0x01
+
+
+/*==== LOCAL FUNCTIONS =======================================================*/
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: identity-gen -a address [-d destination] [-p profile] [-k key] image.hex\n");
+    exit(2);
+}
+
+static void fail(const char *why, const char *what)
+{
+    fprintf(stderr, "identity-gen: %s%s\n", why, what);
+    exit(1);
+}
+
+static unsigned hex_byte(const char *p)
+{
+    char byte[3] = { p[0], p[1], 0 };
+
+    return (unsigned)strtoul(byte, NULL, 16);
+}
+
+// One Intel HEX record, checksum included
+static void hex_record(unsigned addr, unsigned type, const uint8 *data, unsigned len)
+{
+    unsigned sum = len + (addr >> 8) + (addr & 0xFF) + type;
+    unsigned i;
+
+    printf(":%02X%04X%02X", len, addr, type);
+    for (i = 0; i < len; i++)
+    {
+        printf("%02X", data[i]);
+        sum += data[i];
+    }
+    printf("%02X\n", (0x100 - (sum & 0xFF)) & 0xFF);
+}
+
+
+/*==== FUNCTIONS =============================================================*/
+
+int main(int argc, char **argv)
+{
+    uint8  rec[IDENTITY_SIZE];
+    uint8  key_rec[IDENTITY_KEY_SIZE];
+    uint8  key[CRYPT_KEY_SIZE];
+    char   line[HEX_LINE_MAX];
+    long   address = -1, destination = 0;
+    uint8  profile = IDENTITY_PROFILE_NONE;
+    bool   has_key = false;
+    FILE  *f;
+    int    opt;
+
+    while ((opt = getopt(argc, argv, "a:d:p:k:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a': address = strtol(optarg, NULL, 0);        break;
+        case 'd': destination = strtol(optarg, NULL, 0);    break;
+        case 'p':
+            for (profile = 0; profile < RADIO_PROFILES; profile++)
+                if (!strcmp(optarg, radio_profile_names[profile]))
+                    break;
+            if (profile == RADIO_PROFILES)
+                fail("no such radio profile: ", optarg);
+            break;
+        case 'k':
+            if (!crypt_parse_key(optarg, key))
+                fail("key must be 32 hex digits", "");
+            has_key = true;
+            break;
+        default:  usage();
+        }
+    }
+    if (optind != argc - 1)
+        usage();
+    if (address < IDENTITY_ADDRESS_MIN || address > IDENTITY_ADDRESS_MAX)
+        fail("address must be 1 to 254", "");
+    if (destination < 0 || destination > 255)
+        fail("destination must be 0 to 255", "");
+
+    f = fopen(argv[optind], "r");
+    if (!f)
+        fail("cannot read ", argv[optind]);
+
+    // Copy every record but the end of file record
+    while (fgets(line, sizeof(line), f))
+    {
+        unsigned len, addr, type;
+
+        if (line[0] != ':' || strlen(line) < 11)
+            continue;
+        len  = hex_byte(line + 1);
+        addr = (hex_byte(line + 3) << 8) | hex_byte(line + 5);
+        type = hex_byte(line + 7);
+        if (type == HEX_TYPE_EOF)
+            break;
+        if (type == HEX_TYPE_DATA && addr + len > IDENTITY_PAGE_ADDR &&
+            addr < IDENTITY_PAGE_ADDR + IDENTITY_PAGE_SIZE)
+            fail("image has code in the identity page: ", argv[optind]);
+        fputs(line, stdout);
+    }
+    fclose(f);
+
+    identity_make(rec, (uint8)address, (uint8)destination, profile);
+    hex_record(IDENTITY_PAGE_ADDR, HEX_TYPE_DATA, rec, IDENTITY_SIZE);
+    if (has_key)
+    {
+        identity_key_make(key_rec, key);
+        hex_record(IDENTITY_KEY_ADDR, HEX_TYPE_DATA, key_rec, IDENTITY_KEY_SIZE);
+    }
+    hex_record(0, HEX_TYPE_EOF, NULL, 0);
+    return 0;
+}
+
+/*==== END OF FILE ==========================================================*/
@@ -0,0 +1,563 @@
+/***********************************************************************************
+* RADIO PROFILE GENERATOR
+*
+* Writes cc1110_radio_tables.h, the radio profiles radio_start() loads into
+* the radio registers (cc1110_radio.h), to stdout.
+*
+*   radio-gen profile.rf...
+*
+* A profile file gives the link's physical parameters, and register values
+* as SmartRF Studio exports them for anything else, one 'NAME value' per
+* line, '#' starts a comment:
+*
+*   FREQUENCY_MHZ        Base frequency (channel 0)           FREQ2/1/0
+*   CHANNEL              Channel number                       CHANNR
+*   CHANNEL_SPACING_KHZ  Channel spacing                      MDMCFG1/0
+*   DATA_RATE_KBPS       Data rate                            MDMCFG4/3
+*   MODULATION           2-FSK, GFSK, OOK or MSK              MDMCFG2
+*   SYNC_MODE            MDMCFG2.SYNC_MODE, 3 is 30/32 bits   MDMCFG2
+*   DEVIATION_KHZ        Frequency deviation                  DEVIATN
+*   FILTER_BW_KHZ        RX filter bandwidth, at least        MDMCFG4
+*   PREAMBLE_BYTES       2, 3, 4, 6, 8, 12, 16 or 24          MDMCFG1
+*
+* Each parameter becomes the nearest setting the radio has, the filter
+* bandwidth the nearest one that is not narrower; a register can be given
+* directly or through its parameters, not both. Registers not given keep
+* their reset value. The link layer registers are left to the firmware
+* (RADIO_LINK_*), which sets them from the build options; of AGCCTRL1 only
+* the carrier sense threshold is, the profile gives the other bits.
+*
+* The profiles go into radio_profiles[] in the order given, 'name.rf' as
+* RADIO_PROFILE_NAME. Run by 'make' when one of them changes.
+*/
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*==== CONSTS ================================================================*/
+
+#define LINE_MAX_LEN            200
+#define NAME_MAX_LEN            40
+#define PROFILES_MAX            16
+
+// CC1110 crystal
+#define XOSC_HZ                 26e6
+
+// Radio registers SYNC1 (0xDF00) to FSCAL0 (0xDF1F) are the block the
+// firmware copies by DMA; it writes the others in regs[] itself
+#define IMAGE_SIZE              32
+#define REG_SPACE               0x2F    // Up to PA_TABLE0
+
+// Bits set by the firmware, not the profile: whole registers, and the
+// carrier sense threshold of AGCCTRL1 (RADIO_CCA)
+#define REG_LINK                0xFF
+#define AGCCTRL1_LINK           0x0F    // CARRIER_SENSE_ABS_THR
+
+// Registers the parameters go to (offset from 0xDF00)
+#define R_CHANNR                0x06
+#define R_FREQ2                 0x09
+#define R_FREQ1                 0x0A
+#define R_FREQ0                 0x0B
+#define R_MDMCFG4               0x0C
+#define R_MDMCFG3               0x0D
+#define R_MDMCFG2               0x0E
+#define R_MDMCFG1               0x0F
+#define R_MDMCFG0               0x10
+#define R_DEVIATN               0x11
+
+// The 30/32 sync modes send the sync word twice
+#define SYNC_MODE_MASK          0x07
+#define SYNC_MODE_DOUBLE(mode)  (((mode) & 3) == 3)
+#define MDMCFG2_MANCHESTER      0x08
+
+
+/*==== TYPES =================================================================*/
+
+typedef struct {
+    const char *name;
+    unsigned    addr;       // Offset from 0xDF00
+    unsigned    reset;      // CC1110 data sheet reset value
+    unsigned    link;       // Bits set by the firmware (RADIO_LINK_<name>)
+} RadioReg;
+
+typedef enum {
+    P_FREQUENCY, P_CHANNEL, P_SPACING, P_DATA_RATE, P_MODULATION,
+    P_SYNC_MODE, P_DEVIATION, P_FILTER_BW, P_PREAMBLE, P_COUNT
+} ParamId;
+
+typedef struct {
+    const char *name;
+    unsigned    regs[2];    // Registers it sets, 0 ends the list early
+} Param;
+
+typedef struct {
+    char        name[NAME_MAX_LEN];
+    char        title[LINE_MAX_LEN];
+    unsigned    value[REG_SPACE];
+} Profile;
+
+
+/*==== LOCAL VARIABLES =======================================================*/
+
+static const RadioReg regs[] = {
+    { "SYNC1",     0x00, 0xD3 },     { "SYNC0",     0x01, 0x91 },
+    { "PKTLEN",    0x02, 0xFF, REG_LINK },
+    { "PKTCTRL1",  0x03, 0x04, REG_LINK },
+    { "PKTCTRL0",  0x04, 0x45, REG_LINK },
+    { "ADDR",      0x05, 0x00, REG_LINK },
+    { "CHANNR",    0x06, 0x00 },     { "FSCTRL1",   0x07, 0x0F },
+    { "FSCTRL0",   0x08, 0x00 },     { "FREQ2",     0x09, 0x1E },
+    { "FREQ1",     0x0A, 0xC4 },     { "FREQ0",     0x0B, 0xEC },
+    { "MDMCFG4",   0x0C, 0x8C },     { "MDMCFG3",   0x0D, 0x22 },
+    { "MDMCFG2",   0x0E, 0x02 },     { "MDMCFG1",   0x0F, 0x22 },
+    { "MDMCFG0",   0x10, 0xF8 },     { "DEVIATN",   0x11, 0x47 },
+    { "MCSM2",     0x12, 0x07 },
+    { "MCSM1",     0x13, 0x30, REG_LINK },
+    { "MCSM0",     0x14, 0x04 },     { "FOCCFG",    0x15, 0x36 },
+    { "BSCFG",     0x16, 0x6C },     { "AGCCTRL2",  0x17, 0x03 },
+    { "AGCCTRL1",  0x18, 0x40, AGCCTRL1_LINK },
+    { "AGCCTRL0",  0x19, 0x91 },
+    { "FREND1",    0x1A, 0x56 },     { "FREND0",    0x1B, 0x10 },
+    { "FSCAL3",    0x1C, 0xA9 },     { "FSCAL2",    0x1D, 0x0A },
+    { "FSCAL1",    0x1E, 0x20 },     { "FSCAL0",    0x1F, 0x0D },
+    { "TEST2",     0x23, 0x88 },     { "TEST1",     0x24, 0x31 },
+    { "TEST0",     0x25, 0x0B },     { "PA_TABLE0", 0x2E, 0x00 },
+};
+
+#define REG_COUNT               (sizeof(regs) / sizeof(regs[0]))
+
+// FREQ2-0 are one register here, for the conflict check
+static const Param params[P_COUNT] = {
+    { "FREQUENCY_MHZ",       { R_FREQ2 } },
+    { "CHANNEL",             { R_CHANNR } },
+    { "CHANNEL_SPACING_KHZ", { R_MDMCFG1, R_MDMCFG0 } },
+    { "DATA_RATE_KBPS",      { R_MDMCFG4, R_MDMCFG3 } },
+    { "MODULATION",          { R_MDMCFG2 } },
+    { "SYNC_MODE",           { R_MDMCFG2 } },
+    { "DEVIATION_KHZ",       { R_DEVIATN } },
+    { "FILTER_BW_KHZ",       { R_MDMCFG4 } },
+    { "PREAMBLE_BYTES",      { R_MDMCFG1 } },
+};
+
+// MDMCFG2.MOD_FORMAT
+static const char *const modulations[8] = {
+    "2-FSK", "GFSK", NULL, "OOK", NULL, NULL, NULL, "MSK"
+};
+
+// MDMCFG1.NUM_PREAMBLE
+static const unsigned preambles[8] = { 2, 3, 4, 6, 8, 12, 16, 24 };
+
+static Profile     profiles[PROFILES_MAX];
+static const char *profile_file;
+static unsigned    line_no;
+
+
+/*==== LOCAL FUNCTIONS =======================================================*/
+
+static void fail(const char *why, const char *what)
+{
+    if (line_no)
+        fprintf(stderr, "radio-gen: %s:%u: %s%s\n", profile_file, line_no, why, what);
+    else
+        fprintf(stderr, "radio-gen: %s%s\n", why, what);
+    exit(1);
+}
+
+static const RadioReg *find_reg(const char *name)
+{
+    unsigned i;
+
+    for (i = 0; i < REG_COUNT; i++)
+        if (!strcmp(regs[i].name, name))
+            return &regs[i];
+    return NULL;
+}
+
+static int find_param(const char *name)
+{
+    int i;
+
+    for (i = 0; i < P_COUNT; i++)
+        if (!strcmp(params[i].name, name))
+            return i;
+    return -1;
+}
+
+// A register taken from the profile as a whole also counts as FREQ2 for
+// FREQ1 and FREQ0
+static unsigned conflict_reg(unsigned addr)
+{
+    return addr == R_FREQ1 || addr == R_FREQ0 ? R_FREQ2 : addr;
+}
+
+static double number(const char *p, const char *name)
+{
+    char  *end;
+    double v = strtod(p, &end);
+
+    if (end == p || (*end && *end != '#' && !isspace((unsigned char)*end)))
+        fail("value must be a number: ", name);
+    return v;
+}
+
+static unsigned field(unsigned reg, unsigned mask, unsigned shift, unsigned v)
+{
+    return (reg & ~(mask << shift)) | ((v & mask) << shift);
+}
+
+// Register settings from a physical parameter. Each picks the setting
+// nearest to the value asked for (the filter: the narrowest one at least
+// as wide) and fails if the radio has none in range.
+static void set_param(Profile *p, int id, const char *arg)
+{
+    unsigned *v = p->value;
+    double    x, best = 0, got;
+    unsigned  e, m, be = 0, bm = 0;
+    bool      found = false;
+
+    switch (id)
+    {
+    case P_FREQUENCY:
+        x = floor(number(arg, params[id].name) * 1e6 * 65536 / XOSC_HZ + 0.5);
+        got = x * XOSC_HZ / 65536 / 1e6;
+        if (!((got >= 300 && got <= 348) || (got >= 391 && got <= 464) ||
+              (got >= 782 && got <= 928)))
+            fail("frequency out of the CC1110 bands: ", arg);
+        v[R_FREQ2] = ((unsigned long)x >> 16) & 0xFF;
+        v[R_FREQ1] = ((unsigned long)x >> 8) & 0xFF;
+        v[R_FREQ0] = (unsigned long)x & 0xFF;
+        break;
+
+    case P_CHANNEL:
+        x = number(arg, params[id].name);
+        if (x < 0 || x > 255 || x != floor(x))
+            fail("channel must be 0 to 255: ", arg);
+        v[R_CHANNR] = (unsigned)x;
+        break;
+
+    case P_SPACING:
+        x = number(arg, params[id].name) * 1e3;
+        for (e = 0; e <= 3; e++)
+            for (m = 0; m <= 255; m++)
+            {
+                got = XOSC_HZ / (1 << 18) * (256 + m) * (1 << e);
+                if (!found || fabs(got - x) < fabs(best - x))
+                    found = true, best = got, be = e, bm = m;
+            }
+        if (fabs(best - x) > x * 0.01)
+            fail("channel spacing out of range: ", arg);
+        v[R_MDMCFG1] = field(v[R_MDMCFG1], 0x03, 0, be);
+        v[R_MDMCFG0] = bm;
+        break;
+
+    case P_DATA_RATE:
+        x = number(arg, params[id].name) * 1e3;
+        if (x < 1000 || x > 500e3)
+            fail("data rate must be 1 to 500 kbps: ", arg);
+        for (e = 0; e <= 15; e++)
+            for (m = 0; m <= 255; m++)
+            {
+                got = (256.0 + m) * (1 << e) / (1 << 28) * XOSC_HZ;
+                if (!found || fabs(got - x) < fabs(best - x))
+                    found = true, best = got, be = e, bm = m;
+            }
+        v[R_MDMCFG4] = field(v[R_MDMCFG4], 0x0F, 0, be);
+        v[R_MDMCFG3] = bm;
+        break;
+
+    case P_MODULATION:
+        for (m = 0; m < 8; m++)
+            if (modulations[m] && !strcmp(arg, modulations[m]))
+                break;
+        if (m == 8)
+            fail("modulation must be 2-FSK, GFSK, OOK or MSK: ", arg);
+        v[R_MDMCFG2] = field(v[R_MDMCFG2], 0x07, 4, m);
+        break;
+
+    case P_SYNC_MODE:
+        x = number(arg, params[id].name);
+        if (x < 0 || x > 7 || x != floor(x))
+            fail("sync mode must be 0 to 7: ", arg);
+        v[R_MDMCFG2] = field(v[R_MDMCFG2], SYNC_MODE_MASK, 0, (unsigned)x);
+        break;
+
+    case P_DEVIATION:
+        x = number(arg, params[id].name) * 1e3;
+        for (e = 0; e <= 7; e++)
+            for (m = 0; m <= 7; m++)
+            {
+                got = XOSC_HZ / (1 << 17) * (8 + m) * (1 << e);
+                if (!found || fabs(got - x) < fabs(best - x))
+                    found = true, best = got, be = e, bm = m;
+            }
+        if (fabs(best - x) > x * 0.1)
+            fail("deviation out of range: ", arg);
+        v[R_DEVIATN] = (be << 4) | bm;
+        break;
+
+    case P_FILTER_BW:
+        x = number(arg, params[id].name) * 1e3;
+        for (e = 0; e <= 3; e++)
+            for (m = 0; m <= 3; m++)
+            {
+                got = XOSC_HZ / (8.0 * (4 + m) * (1 << e));
+                if (got >= x * (1 - 1e-6) && (!found || got < best))
+                    found = true, best = got, be = e, bm = m;
+            }
+        if (!found)
+            fail("filter bandwidth must be at most 812.5 kHz: ", arg);
+        v[R_MDMCFG4] = field(v[R_MDMCFG4], 0x0F, 4, (be << 2) | bm);
+        break;
+
+    case P_PREAMBLE:
+        x = number(arg, params[id].name);
+        for (m = 0; m < 8; m++)
+            if (preambles[m] == x)
+                break;
+        if (m == 8)
+            fail("preamble must be 2, 3, 4, 6, 8, 12, 16 or 24 bytes: ", arg);
+        v[R_MDMCFG1] = field(v[R_MDMCFG1], 0x07, 4, m);
+        break;
+    }
+}
+
+static double data_rate(const unsigned *v)
+{
+    return (256.0 + v[R_MDMCFG3]) * (1 << (v[R_MDMCFG4] & 0x0F)) / (1 << 28) * XOSC_HZ;
+}
+
+// Time on air of the preamble and sync word, us rounded up: how much later
+// than at once an ACK's sync word can be expected
+static unsigned sync_us(const unsigned *v)
+{
+    unsigned mode = v[R_MDMCFG2] & SYNC_MODE_MASK;
+    unsigned bytes = preambles[(v[R_MDMCFG1] >> 4) & 7] +
+                     (mode ? (SYNC_MODE_DOUBLE(mode) ? 4 : 2) : 0);
+    unsigned bits = bytes * 8 * ((v[R_MDMCFG2] & MDMCFG2_MANCHESTER) ? 2 : 1);
+
+    return (unsigned)ceil(bits * 1e6 / data_rate(v));
+}
+
+static void read_profile(Profile *p, const char *file)
+{
+    bool  set[REG_SPACE] = { false };
+    unsigned param_line[P_COUNT] = { 0 };
+    const char *args[P_COUNT];
+    char  line[P_COUNT][LINE_MAX_LEN];
+    char  buf[LINE_MAX_LEN];
+    char  name[NAME_MAX_LEN];
+    const char *base, *dot;
+    FILE *f;
+    unsigned i, j;
+
+    profile_file = file;
+    line_no = 0;
+    for (i = 0; i < REG_COUNT; i++)
+        p->value[regs[i].addr] = regs[i].reset;
+
+    f = fopen(file, "r");
+    if (!f)
+        fail("cannot read ", file);
+    while (fgets(buf, sizeof(buf), f))
+    {
+        const RadioReg *r;
+        char           *s = buf, *end;
+        unsigned long   v;
+        int             id;
+
+        line_no++;
+        while (isspace((unsigned char)*s))
+            s++;
+
+        // The first comment line names the profile in the generated header
+        if (*s == '#')
+        {
+            if (line_no == 1)
+            {
+                for (s++; isspace((unsigned char)*s); s++)
+                    ;
+                strcpy(p->title, s);
+                p->title[strcspn(p->title, "\r\n")] = 0;
+            }
+            continue;
+        }
+        if (!*s)
+            continue;
+
+        for (i = 0; i < NAME_MAX_LEN - 1 && (isalnum((unsigned char)*s) || *s == '_'); i++)
+            name[i] = *s++;
+        name[i] = 0;
+        while (isspace((unsigned char)*s))
+            s++;
+
+        // Parameters are applied once the registers are in, see below
+        id = find_param(name);
+        if (id >= 0)
+        {
+            if (param_line[id])
+                fail("set twice: ", name);
+            param_line[id] = line_no;
+            strcpy(line[id], s);
+            line[id][strcspn(line[id], "#\r\n")] = 0;
+            for (i = strlen(line[id]); i && isspace((unsigned char)line[id][i - 1]); i--)
+                line[id][i - 1] = 0;
+            args[id] = line[id];
+            continue;
+        }
+
+        r = find_reg(name);
+        if (!r)
+            fail("not a parameter or a register of the radio image: ", name);
+        if (r->link == REG_LINK)
+            fail("set by the firmware from the build options: ", name);
+        if (set[r->addr])
+            fail("set twice: ", name);
+
+        v = strtoul(s, &end, 0);
+        if (end == s || v > 0xFF)
+            fail("value must be 0x00 to 0xFF: ", name);
+        if (v & r->link)
+            fail("carrier sense threshold set by the firmware (RADIO_CCA) must be 0 in ", name);
+        for (s = end; isspace((unsigned char)*s); s++)
+            ;
+        if (*s && *s != '#')
+            fail("unexpected text after the value of ", name);
+
+        p->value[r->addr] = (unsigned)v;
+        set[conflict_reg(r->addr)] = true;
+    }
+    fclose(f);
+
+    for (i = 0; i < P_COUNT; i++)
+    {
+        if (!param_line[i])
+            continue;
+        line_no = param_line[i];
+        for (j = 0; j < 2 && params[i].regs[j]; j++)
+            if (set[params[i].regs[j]])
+                fail("register given directly as well: ", params[i].name);
+        set_param(p, i, args[i]);
+    }
+    line_no = 0;
+
+    // RADIO_PROFILE_<file name without directory and extension>
+    base = strrchr(file, '/');
+    base = base ? base + 1 : file;
+    dot = strrchr(base, '.');
+    snprintf(p->name, sizeof(p->name), "%.*s", dot ? (int)(dot - base) : (int)strlen(base), base);
+    for (i = 0; p->name[i]; i++)
+        if (!isalnum((unsigned char)p->name[i]) && p->name[i] != '_')
+            fail("profile file name must be a C identifier: ", base);
+    if (sync_us(p->value) > 2500)
+        fail("preamble and sync word must take at most 2500 us: ", file);
+}
+
+// One register value, the firmware's RADIO_LINK_* macro, or the profile's
+// bits ORed with it
+static void print_reg(const unsigned *value, const RadioReg *r, const char *indent)
+{
+    char v[NAME_MAX_LEN];
+
+    if (r->link == REG_LINK)
+        snprintf(v, sizeof(v), "RADIO_LINK_%s,", r->name);
+    else if (r->link)
+        snprintf(v, sizeof(v), "0x%02X | RADIO_LINK_%s,", value[r->addr], r->name);
+    else
+        snprintf(v, sizeof(v), "0x%02X,", value[r->addr]);
+    printf("%s%-24s%s// %s\n", indent, v, strlen(v) < 24 ? "" : " ", r->name);
+}
+
+// What the registers of a profile come to
+static void print_summary(const Profile *p)
+{
+    const unsigned *v = p->value;
+    unsigned long   freq = ((unsigned long)v[R_FREQ2] << 16) | (v[R_FREQ1] << 8) | v[R_FREQ0];
+    double          base = freq * XOSC_HZ / 65536 / 1e6;
+    double          spacing = XOSC_HZ / (1 << 18) * (256 + v[R_MDMCFG0]) * (1 << (v[R_MDMCFG1] & 3)) / 1e3;
+    double          deviation = XOSC_HZ / (1 << 17) * (8 + (v[R_DEVIATN] & 7)) * (1 << ((v[R_DEVIATN] >> 4) & 7)) / 1e3;
+    double          bw = XOSC_HZ / (8.0 * (4 + ((v[R_MDMCFG4] >> 4) & 3)) * (1 << (v[R_MDMCFG4] >> 6))) / 1e3;
+    const char     *mod = modulations[(v[R_MDMCFG2] >> 4) & 7];
+
+    printf("    // %s\n", p->title[0] ? p->title : p->name);
+    printf("    // %.6f MHz (%.6f MHz + %u x %.3f kHz), %s %.3f kbps,\n",
+           base + v[R_CHANNR] * spacing / 1e3, base, v[R_CHANNR], spacing,
+           mod ? mod : "(reserved)", data_rate(v) / 1e3);
+    printf("    // deviation %.3f kHz, RX filter %.3f kHz, %u byte preamble\n",
+           deviation, bw, preambles[(v[R_MDMCFG1] >> 4) & 7]);
+}
+
+
+/*==== FUNCTIONS =============================================================*/
+
+int main(int argc, char **argv)
+{
+    int      n = argc - 1;
+    int      i;
+    unsigned r;
+    char     upper[NAME_MAX_LEN];
+
+    if (n < 1 || n > PROFILES_MAX)
+    {
+        fprintf(stderr, "usage: radio-gen profile.rf...\n");
+        return 2;
+    }
+    for (i = 0; i < n; i++)
+    {
+        read_profile(&profiles[i], argv[i + 1]);
+        for (int j = 0; j < i; j++)
+            if (!strcmp(profiles[i].name, profiles[j].name))
+                fail("profile given twice: ", profiles[i].name);
+    }
+
+    printf("#ifndef CC1110_RADIO_TABLES_H\n");
+    printf("#define CC1110_RADIO_TABLES_H\n\n");
+    printf("/***********************************************************************************\n");
+    printf("* Generated by tools/radio_gen.cpp from");
+    for (i = 0; i < n; i++)
+        printf(" %s", argv[i + 1]);
+    printf(" - do not edit.\n*/\n\n");
+
+    printf("// Profiles, by their index in radio_profiles[]\n");
+    for (i = 0; i < n; i++)
+    {
+        for (r = 0; profiles[i].name[r]; r++)
+            upper[r] = (char)toupper((unsigned char)profiles[i].name[r]);
+        upper[r] = 0;
+        printf("#define RADIO_PROFILE_%-22s%d\n", upper, i);
+    }
+    printf("#define %-36s%d\n\n", "RADIO_PROFILES", n);
+
+    printf("#ifdef RADIO_HOST\n");
+    printf("static const char *const radio_profile_names[RADIO_PROFILES] = {");
+    for (i = 0; i < n; i++)
+        printf("%s \"%s\"", i ? "," : "", profiles[i].name);
+    printf(" };\n");
+    printf("#else\n");
+    printf("static const RADIO_SETTINGS RADIO_TABLE radio_profiles[RADIO_PROFILES] = {\n");
+    for (i = 0; i < n; i++)
+    {
+        const Profile *p = &profiles[i];
+
+        print_summary(p);
+        printf("    {\n");
+        printf("        {\n");
+        for (r = 0; r < IMAGE_SIZE; r++)
+            print_reg(p->value, &regs[r], "            ");
+        printf("        },\n");
+        for (; r < REG_COUNT; r++)
+            print_reg(p->value, &regs[r], "        ");
+        snprintf(upper, sizeof(upper), "%u,", sync_us(p->value));
+        printf("        %-24s// Preamble and sync word, us\n", upper);
+        printf("    },\n");
+    }
+    printf("};\n");
+    printf("#endif\n\n");
+
+    printf("#endif /* CC1110_RADIO_TABLES_H */\n");
+    return 0;
+}
+
+/*==== END OF FILE ==========================================================*/
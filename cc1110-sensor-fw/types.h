@@ -52,7 +52,9 @@ extern "C"
 
 /* Boolean */
 typedef unsigned char       BOOL;
+#ifndef __cplusplus
 typedef unsigned char       bool;
+#endif
 /* Data */
 typedef unsigned char       byte;
 typedef unsigned short      WORD;
@@ -71,17 +73,25 @@ typedef unsigned short uint16;
 /** A signed 16-bit integer.  The range of this data type is -32,768 to 32,767. **/
 typedef signed   short int16;
 
+#if defined (HOST_SIM)
+/* long is 64 bits on the simulation host, int has the 8051 long's width */
+typedef unsigned int   uint32;
+typedef signed   int   int32;
+#else
 /** An unsigned 32-bit integer.  The range of this data type is 0 to 4,294,967,295. **/
 typedef unsigned long  uint32;
 
 /** A signed 32-bit integer.  The range of this data type is -2,147,483,648 to 2,147,483,647. **/
 typedef signed   long  int32;
+#endif
 
 typedef unsigned char BIT;	
 
 
 #if defined (SDCC) || defined (__SDCC)
 	#define xdata __xdata
+#elif defined (HOST_SIM)
+	#define xdata
 #endif
 
 
@@ -1,2 +1,4 @@
-sdcc --out-fmt-ihx --code-loc 0x000 --code-size 0x8000 --xram-loc 0xf000 --xram-size 0x300 --iram-size 0x100 --model-small --opt-code-speed sensor-main.c
+set CODE_SIZE=0x7C00
+set XRAM_SIZE=0x300
+sdcc --out-fmt-ihx --code-loc 0x000 --code-size %CODE_SIZE% --xram-loc 0xf000 --xram-size %XRAM_SIZE% --iram-size 0x100 --model-small --opt-code-speed -DMEMORY_CODE_SIZE=%CODE_SIZE% -DMEMORY_XRAM_SIZE=%XRAM_SIZE% sensor-main.c
 packihx sensor-main.ihx > sensor-main.hex
\ No newline at end of file
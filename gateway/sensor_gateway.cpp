@@ -0,0 +1,412 @@
+/***********************************************************************************
+* GATEWAY - SENSOR PACKET DECODER
+*
+* See sensor_gateway.h.
+*/
+
+#include "sensor_gateway.h"
+
+#include <string.h>
+
+#define CONVERT_HOST
+#include "sensor_convert.h"
+
+#define CRYPT_HOST
+#include "sensor_crypt.h"
+
+/*==== CONSTS ================================================================*/
+
+#define SENSOR_FIXED_PAYLOAD_SIZE   (SENSOR_MAX_PACKET_SIZE - SENSOR_PACKET_HEADER_SIZE)
+#define SENSOR_STATUS_CRC_OK        0x80
+
+
+/*==== LOCAL FUNCTIONS =======================================================*/
+
+// Parse a decimal number, optionally negative, as printed by "%06d"
+static const uint8_t *parse_int(const uint8_t *p, const uint8_t *end, int16_t &value)
+{
+    bool neg = false;
+    int  v = 0;
+    int  digits = 0;
+
+    if (p < end && *p == '-')
+    {
+        neg = true;
+        p++;
+    }
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+        v = v * 10 + (*p - '0');
+        if (++digits > 6)
+            return NULL;
+    }
+    if (!digits || v > 32767)
+        return NULL;
+
+    value = (int16_t)(neg ? -v : v);
+    return p;
+}
+
+static const uint8_t *expect(const uint8_t *p, const uint8_t *end, char c)
+{
+    return p && p < end && *p == (uint8_t)c ? p + 1 : NULL;
+}
+
+// "V|33|D|000203|000134|000406", up to the end or a NUL
+static SensorStatus decode_ascii(const uint8_t *p, const uint8_t *end, SensorReport &out)
+{
+    SensorRecord &rec = out.ascii;
+    const uint8_t *nul = (const uint8_t *)memchr(p, 0, end - p);
+
+    if (nul)
+        end = nul;
+
+    p = expect(p, end, 'V');
+    p = expect(p, end, '|');
+    if (p) p = parse_int(p, end, rec.battery);
+    p = expect(p, end, '|');
+    p = expect(p, end, 'D');
+    p = expect(p, end, '|');
+    if (p) p = parse_int(p, end, rec.pir);
+    p = expect(p, end, '|');
+    if (p) p = parse_int(p, end, rec.thermopile);
+    p = expect(p, end, '|');
+    if (p) p = parse_int(p, end, rec.thermistor);
+    if (p != end)
+        return SENSOR_ERR_FORMAT;
+
+    out.format  = SENSOR_FORMAT_ASCII;
+    out.flags   = 0;
+    out.has_seq = 0;
+    out.seq     = 0;
+    out.count   = 1;
+    out.records = NULL;
+    return SENSOR_OK;
+}
+
+// Length, header and receiver status of a frame; on success the payload
+// (as sent, secured or not) is 'payload_size' bytes from the header on
+static SensorStatus decode_header(const uint8_t *frame, size_t len, unsigned mode,
+                                  uint32_t source, SensorReport &out, size_t &payload_size)
+{
+    size_t status_size = (mode & SENSOR_FRAME_STATUS) ? SENSOR_FRAME_STATUS_SIZE : 0;
+    size_t frame_size;
+
+    out.source  = source;
+    out.rssi    = 0;
+    out.lqi     = 0;
+    out.secured = 0;
+    out.session = 0;
+    out.counter = 0;
+
+    if (mode & SENSOR_FRAME_FIXED)
+    {
+        // destination, size, device, seq, then the zero padded payload
+        frame_size = SENSOR_MAX_PACKET_SIZE;
+        payload_size = SENSOR_FIXED_PAYLOAD_SIZE;
+        if (len < frame_size + status_size)
+            return SENSOR_ERR_SHORT;
+    }
+    else
+    {
+        // length, destination, device, seq; the length counts what follows it
+        if (len < SENSOR_PACKET_HEADER_SIZE)
+            return SENSOR_ERR_SHORT;
+        frame_size = 1 + (size_t)frame[0];
+        if (frame_size < SENSOR_PACKET_HEADER_SIZE || len < frame_size + status_size)
+            return SENSOR_ERR_LENGTH;
+        payload_size = frame_size - SENSOR_PACKET_HEADER_SIZE;
+    }
+
+    out.frame_seq = frame[SENSOR_PACKET_SEQ_INDEX];
+    out.device    = frame[SENSOR_PACKET_DEVICE_INDEX];
+
+    if (status_size)
+    {
+        out.rssi = (int8_t)frame[frame_size];
+        out.lqi  = frame[frame_size + 1] & ~SENSOR_STATUS_CRC_OK;
+        if (!(frame[frame_size + 1] & SENSOR_STATUS_CRC_OK))
+            return SENSOR_ERR_CRC;
+    }
+    return SENSOR_OK;
+}
+
+
+// The notice of a RADIO_AES sensor out of session counts: marker, then
+// session and counter all 0, no payload (cryptSeal())
+static bool spent_notice(const uint8_t *frame, size_t payload_size)
+{
+    size_t i;
+
+    if (payload_size < CRYPT_HEADER_SIZE || frame[CRYPT_MARKER_INDEX] != CRYPT_MARKER)
+        return false;
+    for (i = CRYPT_SESSION_INDEX; i < CRYPT_PAYLOAD_INDEX; i++)
+        if (frame[i])
+            return false;
+    return true;
+}
+
+
+/*==== FUNCTIONS =============================================================*/
+
+SensorStatus sensor_decode_payload(const uint8_t *payload, size_t len,
+                                   uint32_t source, SensorReport &out)
+{
+    size_t count;
+
+    out.source = source;
+    out.has_frame_seq = 0;
+    out.device = 0;
+    out.secured = 0;
+    if (len < 1)
+        return SENSOR_ERR_SHORT;
+
+    if (payload[0] == 'V')
+        return decode_ascii(payload, payload + len, out);
+    if (payload[0] != SENSOR_PAYLOAD_VERSION)
+        return SENSOR_ERR_VERSION;
+    if (len < SENSOR_PAYLOAD_HEADER_SIZE)
+        return SENSOR_ERR_SHORT;
+
+    count = payload[4];
+    if (SENSOR_PAYLOAD_HEADER_SIZE + count * SENSOR_PAYLOAD_RECORD_SIZE > len)
+        return SENSOR_ERR_LENGTH;
+
+    out.format  = SENSOR_FORMAT_BINARY;
+    out.flags   = payload[1];
+    out.has_seq = 1;
+    out.seq     = (uint16_t)(payload[2] | (payload[3] << 8));
+    out.count   = (uint8_t)count;
+    out.records = payload + SENSOR_PAYLOAD_HEADER_SIZE;
+    return SENSOR_OK;
+}
+
+SensorStatus sensor_decode_frame(const uint8_t *frame, size_t len, unsigned mode,
+                                 uint32_t source, SensorReport &out)
+{
+    size_t payload_size;
+    SensorStatus status;
+
+    status = decode_header(frame, len, mode, source, out, payload_size);
+    if (status != SENSOR_OK)
+        return status;
+    if (spent_notice(frame, payload_size))
+        return SENSOR_ERR_SPENT;
+    if (payload_size && frame[CRYPT_MARKER_INDEX] == CRYPT_MARKER)
+        return SENSOR_ERR_SECURED;
+
+    status = sensor_decode_payload(frame + SENSOR_PACKET_HEADER_SIZE, payload_size, source, out);
+    out.has_frame_seq = 1;
+    out.frame_seq     = frame[SENSOR_PACKET_SEQ_INDEX];
+    out.device        = frame[SENSOR_PACKET_DEVICE_INDEX];
+    return status;
+}
+
+SensorStatus sensor_decode_secure_frame(uint8_t *frame, size_t len, unsigned mode,
+                                        uint32_t source, const uint8_t *key,
+                                        SensorReport &out)
+{
+    size_t payload_size;
+    SensorStatus status;
+
+    status = decode_header(frame, len, mode, source, out, payload_size);
+    if (status != SENSOR_OK)
+        return status;
+    if (spent_notice(frame, payload_size))
+        return SENSOR_ERR_SPENT;
+    if (!payload_size || frame[CRYPT_MARKER_INDEX] != CRYPT_MARKER)
+        return SENSOR_ERR_AUTH;
+    if (payload_size < CRYPT_OVERHEAD)
+        return SENSOR_ERR_SHORT;
+
+    // Marker, session and counter, then the payload and the MIC. Fixed length
+    // frames seal the whole of what the header leaves, padding included.
+    payload_size -= CRYPT_OVERHEAD;
+    if (!crypt_ccm_open(key, frame, payload_size))
+        return SENSOR_ERR_AUTH;
+
+    status = sensor_decode_payload(frame + CRYPT_PAYLOAD_INDEX, payload_size, source, out);
+    out.has_frame_seq = 1;
+    out.frame_seq     = frame[SENSOR_PACKET_SEQ_INDEX];
+    out.device        = frame[SENSOR_PACKET_DEVICE_INDEX];
+    out.secured       = 1;
+    out.session = ((uint32_t)frame[CRYPT_SESSION_INDEX] << 24) |
+                  ((uint32_t)frame[CRYPT_SESSION_INDEX + 1] << 16) |
+                  ((uint32_t)frame[CRYPT_SESSION_INDEX + 2] << 8) |
+                  frame[CRYPT_SESSION_INDEX + 3];
+    out.counter = ((uint32_t)frame[CRYPT_COUNTER_INDEX] << 16) |
+                  ((uint32_t)frame[CRYPT_COUNTER_INDEX + 1] << 8) |
+                  out.frame_seq;
+    return status;
+}
+
+SensorUnits sensor_units(const SensorReport &r, const SensorRecord &rec)
+{
+    SensorUnits u;
+    uint8_t     extra_bits = SENSOR_FLAG_OVERSAMPLE(r.flags);
+
+    u.battery_dv   = rec.battery;
+    u.ambient_c100 = convert_thermistor(rec.thermistor, extra_bits);
+    u.object_c100  = convert_thermopile(rec.thermopile, extra_bits, u.ambient_c100);
+
+    u.has_motion    = (r.flags & SENSOR_FLAG_PIR_DSP) != 0;
+    u.motion        = u.has_motion && (rec.pir & SENSOR_PIR_MOTION);
+    u.motion_events = u.has_motion ? (uint16_t)(rec.pir & SENSOR_PIR_EVENTS_MASK) : 0;
+    return u;
+}
+
+size_t sensor_ack_frame(const SensorReport &r, uint8_t gateway, uint8_t *frame)
+{
+    if (!r.has_frame_seq || r.format != SENSOR_FORMAT_BINARY || !(r.flags & SENSOR_FLAG_ACK))
+        return 0;
+
+    // length, destination (the sensor), source, the frame's sequence number
+    frame[0] = SENSOR_ACK_SIZE - 1;
+    frame[1] = r.device;
+    frame[SENSOR_PACKET_DEVICE_INDEX] = gateway;
+    frame[SENSOR_PACKET_SEQ_INDEX] = r.frame_seq;
+    return SENSOR_ACK_SIZE;
+}
+
+const char *sensor_status_name(SensorStatus s)
+{
+    switch (s)
+    {
+    case SENSOR_OK:          return "ok";
+    case SENSOR_ERR_SHORT:   return "short";
+    case SENSOR_ERR_LENGTH:  return "bad length";
+    case SENSOR_ERR_VERSION: return "unknown version";
+    case SENSOR_ERR_FORMAT:  return "bad format";
+    case SENSOR_ERR_CRC:     return "CRC error";
+    case SENSOR_ERR_SECURED: return "encrypted";
+    case SENSOR_ERR_AUTH:    return "not authentic";
+    case SENSOR_ERR_SPENT:   return "sessions used up";
+    }
+    return "?";
+}
+
+
+/*==== SensorSources =========================================================*/
+
+SensorSources::SensorSources(size_t max_sources)
+    : slots(NULL), capacity(16), used(0), limit(max_sources)
+{
+    // At most half full, so probe sequences stay short
+    while (capacity < 2 * max_sources)
+        capacity <<= 1;
+    slots = new SensorSource[capacity];
+    memset(slots, 0, capacity * sizeof(*slots));
+}
+
+SensorSources::~SensorSources()
+{
+    delete[] slots;
+}
+
+// The sensor's slot, or the free slot where it would go
+SensorSource *SensorSources::slot(uint32_t source, uint8_t device) const
+{
+    size_t i = (size_t)(((source ^ ((uint32_t)device << 24)) * 2654435761u) & (capacity - 1));
+
+    while (slots[i].used && (slots[i].source != source || slots[i].device != device))
+        i = (i + 1) & (capacity - 1);
+    return &slots[i];
+}
+
+const SensorSource *SensorSources::find(uint32_t source, uint8_t device) const
+{
+    const SensorSource *s = slot(source, device);
+
+    return s->used ? s : NULL;
+}
+
+SensorAccept SensorSources::add(const SensorReport &r)
+{
+    SensorSource *s = slot(r.source, r.device);
+
+    if (!s->used)
+    {
+        if (used >= limit)
+            return SENSOR_TABLE_FULL;
+        s->used = 1;
+        s->source = r.source;
+        s->device = r.device;
+        used++;
+    }
+
+    if (r.secured)
+    {
+        // Session counts only go up, the sensor keeps them in flash and
+        // never uses one twice, and within a session so does the counter; a
+        // retransmission repeats it and is left to the duplicate check. A
+        // newer session is a sensor reset.
+        uint16_t count = SENSOR_SESSION_COUNT(r.session);
+        uint16_t last  = SENSOR_SESSION_COUNT(s->session);
+
+        if (s->has_counter && (count < last ||
+                               (count == last && (r.session != s->session ||
+                                                  r.counter < s->last_counter))))
+        {
+            s->replays++;
+            return SENSOR_REPLAY;
+        }
+        s->session = r.session;
+        s->last_counter = r.counter;
+        s->has_counter = 1;
+    }
+
+    if (r.has_frame_seq)
+    {
+        uint8_t ahead = (uint8_t)(r.frame_seq - s->last_frame_seq);
+
+        s->frames++;
+        if (s->has_frame_seq && ahead == 0 && (!r.has_seq || !s->has_seq || r.seq == s->last_seq))
+        {
+            s->dup_frames++;
+            s->duplicates++;
+            return SENSOR_DUPLICATE;
+        }
+
+        if (r.format == SENSOR_FORMAT_BINARY && (r.flags & SENSOR_FLAG_FIRST))
+        {
+            // The sensor started over, and its frame sequence with it
+            if (s->has_frame_seq || s->has_seq)
+                s->restarts++;
+            s->has_seq = 0;
+            ahead = 1;
+        }
+        else if (s->has_frame_seq && ahead >= 0x80)
+        {
+            // Behind the last frame: one counted as lost turned up late
+            s->late++;
+            if (s->lost)
+                s->lost--;
+            ahead = 0;
+        }
+        else if (s->has_frame_seq)
+            s->lost += ahead - 1;
+
+        if (ahead || !s->has_frame_seq)
+        {
+            s->last_frame_seq = r.frame_seq;
+            s->has_frame_seq = 1;
+        }
+    }
+
+    if (r.has_seq && s->has_seq && r.seq == s->last_seq)
+    {
+        s->duplicates++;
+        return SENSOR_DUPLICATE;
+    }
+
+    if (r.has_seq)
+    {
+        s->last_seq = r.seq;
+        s->has_seq = 1;
+    }
+    s->reports++;
+    s->records += r.count;
+    return SENSOR_NEW;
+}
+
+/*==== END OF FILE ==========================================================*/
@@ -0,0 +1,278 @@
+#ifndef SENSOR_GATEWAY_H
+#define SENSOR_GATEWAY_H
+
+/***********************************************************************************
+* GATEWAY - SENSOR PACKET DECODER
+*
+* Decodes the packets sent by the sensor firmware (cc1110-sensor-fw) as they
+* come out of a CC1110/CC1101 receiver. Both payload formats are understood:
+*
+*   binary  version 1, see payload.h in the firmware
+*   ASCII   the legacy "V|33|D|000203|000134|000406" (PAYLOAD_ASCII builds)
+*
+* Decoding works in place: a SensorReport points into the caller's buffer
+* and records are read from it on demand, so nothing is allocated or copied
+* per packet. The buffer must outlive the report.
+*
+* Every frame carries the sending device's address (its provisioned
+* identity, see device_identity.h in the firmware), and the caller names
+* where the packet came from (receiver, channel, capture file, ...). Sensors
+* are keyed by both; SensorSources keeps the per-sensor state in a table
+* sized once at start-up.
+*
+* Every frame also carries an 8 bit frame sequence number, counted up by the
+* sensor for each frame it transmits. Reports skipped on the sensor (report
+* on change) do not use one, so gaps in it are frames lost on the way; the
+* per-source loss and duplicate counts are kept from it.
+*
+* Sensors built with RADIO_ACK set SENSOR_FLAG_ACK and listen for an
+* acknowledgement right after each frame, for a few hundred microseconds
+* (RADIO_ACK_TIMEOUT_US). Send the frame from sensor_ack_frame() for every
+* such frame received with a good CRC, duplicates included (a retransmission
+* means the last ACK was lost), as soon as possible.
+*
+* Sensors built with RADIO_AES encrypt and authenticate their payloads
+* (sensor_crypt.h in the firmware). sensor_decode_frame() reports such frames
+* as SENSOR_ERR_SECURED; sensor_decode_secure_frame() checks and decrypts
+* them with the sensor's key. Their session and frame counter let
+* SensorSources turn away a frame replayed from an older session or from
+* earlier in the current one. Sessions are numbered in the sensor's flash,
+* in their high 16 bits, and start over when the sensor is reflashed; only
+* that count orders them, the low 16 bits are noise. The table only lives in
+* memory: start it over then, otherwise everything the sensor sends is taken
+* for a replay. A sensor that has used up its session counts sends a bare
+* notice instead of readings, reported as SENSOR_ERR_SPENT, until it is
+* given a new key and reflashed.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*==== CONSTS ================================================================*/
+
+// Radio framing, see cc1110_radio.h
+#define SENSOR_PACKET_HEADER_SIZE   4       // [len,] destination, device, seq
+#define SENSOR_PACKET_DEVICE_INDEX  2
+#define SENSOR_PACKET_SEQ_INDEX     3
+#define SENSOR_MAX_PACKET_SIZE      61
+#define SENSOR_FRAME_STATUS_SIZE    2       // RSSI, LQI/CRC_OK (APPEND_STATUS)
+#define SENSOR_ACK_SIZE             SENSOR_PACKET_HEADER_SIZE
+#define SENSOR_KEY_SIZE             16      // AES-128 key (RADIO_AES)
+
+// Binary payload, see payload.h
+#define SENSOR_PAYLOAD_VERSION      0x01
+#define SENSOR_PAYLOAD_HEADER_SIZE  5
+#define SENSOR_PAYLOAD_RECORD_SIZE  8
+#define SENSOR_FLAG_FIRST           0x01
+#define SENSOR_FLAG_MOTION          0x02
+#define SENSOR_FLAG_PIR_DSP         0x04    // PIR field is the motion detector output
+#define SENSOR_FLAG_ACK             0x08    // Sensor waits for an ACK
+#define SENSOR_FLAG_OVERSAMPLE(f)   (((f) >> 4) & 0x03)
+#define SENSOR_PIR_MOTION           0x4000
+#define SENSOR_PIR_EVENTS_MASK      0x3FFF
+
+// The sensor's count in a session; the rest is noise
+#define SENSOR_SESSION_COUNT(s)     ((uint16_t)((s) >> 16))
+
+// Frame options for sensor_decode_frame()
+enum SensorFrameMode {
+    SENSOR_FRAME_VARIABLE = 0x00,   // Length byte first (default firmware build)
+    SENSOR_FRAME_FIXED    = 0x01,   // 61 byte frames (RADIO_FIXED_LENGTH builds)
+    SENSOR_FRAME_STATUS   = 0x02,   // Receiver appended RSSI and LQI
+};
+
+enum SensorFormat {
+    SENSOR_FORMAT_BINARY = 0,
+    SENSOR_FORMAT_ASCII,
+};
+
+enum SensorStatus {
+    SENSOR_OK = 0,
+    SENSOR_ERR_SHORT,               // Fewer bytes than the headers need
+    SENSOR_ERR_LENGTH,              // Length byte or record count past the end
+    SENSOR_ERR_VERSION,             // Unknown binary payload version
+    SENSOR_ERR_FORMAT,              // Neither binary nor a well formed ASCII line
+    SENSOR_ERR_CRC,                 // Receiver status says the CRC failed
+    SENSOR_ERR_SECURED,             // Encrypted frame, see sensor_decode_secure_frame()
+    SENSOR_ERR_AUTH,                // MIC mismatch (wrong key, corrupt or forged),
+                                    // or a plain frame where a secured one was due
+    SENSOR_ERR_SPENT,               // Notice from a sensor out of session counts
+                                    // (not authenticated), no readings
+};
+
+
+/*==== TYPES =================================================================*/
+
+// One set of readings from one wake-up
+struct SensorRecord {
+    int16_t battery;                // Battery voltage * 10
+    int16_t pir;                    // AIN0, 10 bit, or see SENSOR_FLAG_PIR_DSP
+    int16_t thermopile;             // AIN1, 10 + oversample bits
+    int16_t thermistor;             // AIN6, 10 + oversample bits
+};
+
+// A decoded packet. 'records' points into the decoded buffer for binary
+// payloads; an ASCII payload carries its one record in 'ascii'.
+struct SensorReport {
+    uint32_t        source;
+    uint8_t         format;         // SensorFormat
+    uint8_t         flags;          // SENSOR_FLAG_*, 0 for ASCII
+    uint8_t         has_seq;        // ASCII payloads carry no sequence number
+    uint8_t         count;          // Records
+    uint16_t        seq;
+    int8_t          rssi;           // Raw RSSI byte, with SENSOR_FRAME_STATUS
+    uint8_t         lqi;
+    uint8_t         has_frame_seq;  // Decoded from a frame, not a bare payload
+    uint8_t         frame_seq;      // Frame sequence number
+    uint8_t         device;         // Sending device's address, 0 for a bare
+                                    // payload (unprovisioned sensors send 1)
+    uint8_t         secured;        // Decrypted and authenticated (RADIO_AES)
+    uint32_t        session;        // New per sensor reset, if secured: a
+                                    // count kept by the sensor, 16 random bits;
+                                    // SENSOR_SESSION_COUNT() orders them
+    uint32_t        counter;        // 24 bit frame counter in the session; its
+                                    // low byte is frame_seq
+    const uint8_t  *records;
+    SensorRecord    ascii;
+};
+
+// A record in engineering units, see sensor_units()
+struct SensorUnits {
+    int16_t battery_dv;             // Battery voltage * 10
+    int16_t ambient_c100;           // Thermopile temperature, C * 100
+    int16_t object_c100;            // Target temperature, C * 100
+    uint8_t  has_motion;            // Motion detector output (SENSOR_FLAG_PIR_DSP)
+    uint8_t  motion;                // Motion seen at this reading
+    uint16_t motion_events;         // Motion events since the sensor's power-on,
+                                    // modulo SENSOR_PIR_EVENTS_MASK + 1
+};
+
+// State kept per sensor (source and device address)
+struct SensorSource {
+    uint32_t source;
+    uint8_t  device;
+    uint16_t last_seq;
+    uint8_t  has_seq;               // last_seq is valid
+    uint8_t  used;
+    uint8_t  last_frame_seq;
+    uint8_t  has_frame_seq;         // last_frame_seq is valid
+    uint32_t reports;               // Reports accepted
+    uint32_t records;
+    uint32_t duplicates;            // Same frame, or same report as the last one
+    uint32_t frames;                // Frames seen, duplicates included
+    uint32_t dup_frames;            // Frames seen more than once
+    uint32_t lost;                  // Frames missing from the frame sequence
+    uint32_t late;                  // Frames older than the last one (reordered)
+    uint32_t restarts;              // Sensor resets (PAYLOAD_FLAG_FIRST)
+    uint32_t session;               // Session of the last secured frame
+    uint32_t last_counter;          // Its frame counter
+    uint8_t  has_counter;           // session and last_counter are valid
+    uint32_t replays;               // Secured frames from behind last_counter
+};
+
+// Fraction of the frames a source sent that were lost, 0 to 1
+static inline double sensor_loss_rate(const SensorSource &s)
+{
+    uint32_t sent = s.frames - s.dup_frames + s.lost;
+
+    return sent ? (double)s.lost / sent : 0.0;
+}
+
+// Outcome of SensorSources::add()
+enum SensorAccept {
+    SENSOR_NEW = 0,
+    SENSOR_DUPLICATE,               // Repeat of the source's last frame or report
+    SENSOR_TABLE_FULL,              // More sources than the table was sized for
+    SENSOR_REPLAY,                  // Secured frame from an older session, or
+                                    // older than the session's last
+};
+
+// Per-source state for all sources, in an open addressed table allocated
+// once by the constructor. Lookups do not allocate.
+class SensorSources {
+public:
+    explicit SensorSources(size_t max_sources);
+    ~SensorSources();
+
+    // Account for a decoded report: replays, frame sequence gaps,
+    // duplicates and restarts, then the report itself
+    SensorAccept add(const SensorReport &r);
+
+    // State of one sensor, NULL if it was never seen
+    const SensorSource *find(uint32_t source, uint8_t device) const;
+
+    // Every source seen so far, in no particular order
+    template <typename Fn> void each(Fn fn) const
+    {
+        for (size_t i = 0; i < capacity; i++)
+            if (slots[i].used)
+                fn(slots[i]);
+    }
+
+    size_t size() const { return used; }
+
+private:
+    SensorSource *slot(uint32_t source, uint8_t device) const;
+
+    SensorSource *slots;
+    size_t        capacity;         // Power of two
+    size_t        used;
+    size_t        limit;            // Sources accepted before the table is full
+
+    SensorSources(const SensorSources &);
+    SensorSources &operator=(const SensorSources &);
+};
+
+
+/*==== FUNCTIONS =============================================================*/
+
+// Decode a radio frame: the packet header, the payload and, with
+// SENSOR_FRAME_STATUS, the two status bytes the receiver appended.
+SensorStatus sensor_decode_frame(const uint8_t *frame, size_t len, unsigned mode,
+                                 uint32_t source, SensorReport &out);
+
+// Decode a frame from a RADIO_AES sensor: check its MIC with 'key' and
+// decrypt the payload in place, then as sensor_decode_frame(). The frame is
+// left as it was if the MIC does not match.
+SensorStatus sensor_decode_secure_frame(uint8_t *frame, size_t len, unsigned mode,
+                                        uint32_t source, const uint8_t *key,
+                                        SensorReport &out);
+
+// Decode a payload on its own, binary or ASCII
+SensorStatus sensor_decode_payload(const uint8_t *payload, size_t len,
+                                   uint32_t source, SensorReport &out);
+
+// Record 'i' of a report (i < count)
+static inline SensorRecord sensor_record(const SensorReport &r, unsigned i)
+{
+    SensorRecord   rec;
+    const uint8_t *p;
+
+    if (r.format == SENSOR_FORMAT_ASCII)
+        return r.ascii;
+
+    p = r.records + i * SENSOR_PAYLOAD_RECORD_SIZE;
+    rec.battery    = (int16_t)(p[0] | (p[1] << 8));
+    rec.pir        = (int16_t)(p[2] | (p[3] << 8));
+    rec.thermopile = (int16_t)(p[4] | (p[5] << 8));
+    rec.thermistor = (int16_t)(p[6] | (p[7] << 8));
+    return rec;
+}
+
+// Convert a record of a report to engineering units with the firmware's own
+// fixed-point tables (sensor_convert.h), so the results match the sensor
+// parameters of the firmware tree this is built against
+SensorUnits sensor_units(const SensorReport &r, const SensorRecord &rec);
+
+// Acknowledgement of a frame from a RADIO_ACK sensor, to send back as a
+// variable length frame (length byte first) from the address 'gateway', the
+// one the sensor sends to. Returns SENSOR_ACK_SIZE, or 0 if the report does
+// not ask for an ACK.
+size_t sensor_ack_frame(const SensorReport &r, uint8_t gateway, uint8_t *frame);
+
+const char *sensor_status_name(SensorStatus s);
+
+
+#endif /* SENSOR_GATEWAY_H */
+
+/*==== END OF FILE ==========================================================*/
@@ -0,0 +1,269 @@
+/***********************************************************************************
+* GATEWAY - CAPTURE REPLAY
+*
+* Decodes captured sensor traffic and prints what each source sent, and how
+* fast it was decoded. Built by 'make' in this directory.
+*
+*   sensor-replay [-F] [-S] [-K key [-c]] [-v] [-r repeat] capture...
+*
+*   -F  Frames are 61 byte fixed length frames (RADIO_FIXED_LENGTH builds)
+*   -K  Frames are secured (RADIO_AES builds) with this AES-128 key, 32 hex
+*       digits; frames that do not authenticate are counted, not decoded
+*   -c  Check the replay protection: once the captures are decoded, every
+*       frame is fed in again, and each must be turned away as a replay or
+*       a duplicate, otherwise the exit status is 1. Give the captures
+*       oldest first; frames from the older sessions are then replayed too.
+*   -S  Frames end with the receiver's RSSI and LQI status bytes
+*   -v  Print every report
+*   -r  Decode the captures 'repeat' times, to measure the decode rate
+*
+* A capture is a sequence of records, one per received frame:
+*
+*   4 bytes  source, little-endian (receiver, channel, ... as the capturing
+*            side numbers them)
+*   1 byte   frame length
+*   n bytes  frame as read from the radio, length byte first
+*
+* 'sensor-sim -w' writes this format, with every packet from source 0. The
+* sensors within one source are told apart by the device address in the
+* frame header.
+*/
+
+#include "sensor_gateway.h"
+
+#define CRYPT_HOST
+#include "sensor_crypt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+/*==== CONSTS ================================================================*/
+
+#define REPLAY_RECORD_HEADER    5
+#define REPLAY_MAX_SOURCES      4096
+#define REPLAY_STATUS_COUNT     (SENSOR_ERR_SPENT + 1)
+
+
+/*==== LOCAL FUNCTIONS =======================================================*/
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: sensor-replay [-F] [-S] [-K key [-c]] [-v] [-r repeat] capture...\n");
+    exit(2);
+}
+
+static void load(const char *path, std::vector<uint8_t> &buf)
+{
+    FILE  *f = fopen(path, "rb");
+    size_t n;
+    uint8_t chunk[65536];
+
+    if (!f)
+    {
+        fprintf(stderr, "sensor-replay: cannot read %s\n", path);
+        exit(2);
+    }
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        buf.insert(buf.end(), chunk, chunk + n);
+    fclose(f);
+}
+
+// Decode the frame of a capture record, in place in a copy if secured
+// ('key' set)
+static SensorStatus decode(const uint8_t *rec, size_t len, unsigned mode, uint32_t source,
+                           const uint8_t *key, SensorReport &report)
+{
+    static uint8_t frame[256];
+
+    if (!key)
+        return sensor_decode_frame(rec, len, mode, source, report);
+    memcpy(frame, rec, len);
+    return sensor_decode_secure_frame(frame, len, mode, source, key, report);
+}
+
+static void print_report(const SensorReport &r)
+{
+    SensorRecord rec;
+    SensorUnits  u;
+    unsigned     i;
+
+    if (r.has_seq)
+        printf("source %u device %3u seq %5u frame %3u flags 0x%02X",
+               r.source, r.device, r.seq, r.frame_seq, r.flags);
+    else
+        printf("source %u device %3u frame %3u ascii", r.source, r.device, r.frame_seq);
+    if (r.secured)
+        printf(" session %08X counter %u", r.session, r.counter);
+    for (i = 0; i < r.count; i++)
+    {
+        rec = sensor_record(r, i);
+        u = sensor_units(r, rec);
+        printf("  [%d %d %d %d] %d.%d V %.2f C %.2f C", rec.battery, rec.pir, rec.thermopile,
+               rec.thermistor, u.battery_dv / 10, u.battery_dv % 10,
+               u.ambient_c100 / 100.0, u.object_c100 / 100.0);
+        if (u.has_motion)
+            printf(" %s events %u", u.motion ? "motion" : "still", u.motion_events);
+    }
+    printf("\n");
+}
+
+static double seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/*==== FUNCTIONS =============================================================*/
+
+int main(int argc, char **argv)
+{
+    std::vector<uint8_t> capture;
+    SensorSources        sources(REPLAY_MAX_SOURCES);
+    SensorReport         report;
+    SensorStatus         status;
+    unsigned             mode = SENSOR_FRAME_VARIABLE;
+    unsigned long        statuses[REPLAY_STATUS_COUNT] = { 0 };
+    unsigned long        frames = 0, duplicates = 0, dropped = 0, truncated = 0, acks = 0;
+    unsigned long        replays = 0, check_turned = 0, check_taken = 0;
+    uint8_t              ack[SENSOR_ACK_SIZE];
+    uint8_t              key[SENSOR_KEY_SIZE];
+    bool                 verbose = false, secured = false, check = false;
+    long                 repeat = 1, pass;
+    double               t0, t;
+    size_t               pos, len;
+    uint32_t             source;
+    int                  opt, i;
+
+    while ((opt = getopt(argc, argv, "FSK:cvr:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'F': mode |= SENSOR_FRAME_FIXED;   break;
+        case 'S': mode |= SENSOR_FRAME_STATUS;  break;
+        case 'K':
+            if (!crypt_parse_key(optarg, key))
+            {
+                fprintf(stderr, "sensor-replay: key must be 32 hex digits\n");
+                exit(2);
+            }
+            secured = true;
+            break;
+        case 'c': check = true;                 break;
+        case 'v': verbose = true;               break;
+        case 'r': repeat = atol(optarg);        break;
+        default:  usage();
+        }
+    }
+    if (optind == argc || repeat < 1 || (check && !secured))
+        usage();
+    for (i = optind; i < argc; i++)
+        load(argv[i], capture);
+
+    const uint8_t *buf = capture.data();
+    size_t         size = capture.size();
+
+    t0 = seconds();
+    for (pass = 0; pass < repeat; pass++)
+    {
+        for (pos = 0; pos + REPLAY_RECORD_HEADER <= size; pos += REPLAY_RECORD_HEADER + len)
+        {
+            source = buf[pos] | (buf[pos + 1] << 8) | (buf[pos + 2] << 16) | ((uint32_t)buf[pos + 3] << 24);
+            len = buf[pos + 4];
+            if (pos + REPLAY_RECORD_HEADER + len > size)
+            {
+                truncated++;
+                break;
+            }
+
+            frames++;
+            status = decode(buf + pos + REPLAY_RECORD_HEADER, len, mode, source,
+                            secured ? key : NULL, report);
+            statuses[status]++;
+            if (status != SENSOR_OK)
+                continue;
+            if (sensor_ack_frame(report, 0, ack))
+                acks++;
+
+            switch (sources.add(report))
+            {
+            case SENSOR_NEW:
+                if (verbose)
+                    print_report(report);
+                break;
+            case SENSOR_DUPLICATE:  duplicates++;   break;
+            case SENSOR_TABLE_FULL: dropped++;      break;
+            case SENSOR_REPLAY:     replays++;      break;
+            }
+        }
+    }
+    t = seconds() - t0;
+
+    if (check)
+    {
+        // The table has seen every frame now: old sessions, old counters
+        // and the last frame of each session must all be turned away
+        for (pos = 0; pos + REPLAY_RECORD_HEADER <= size; pos += REPLAY_RECORD_HEADER + len)
+        {
+            source = buf[pos] | (buf[pos + 1] << 8) | (buf[pos + 2] << 16) | ((uint32_t)buf[pos + 3] << 24);
+            len = buf[pos + 4];
+            if (pos + REPLAY_RECORD_HEADER + len > size)
+                break;
+            if (decode(buf + pos + REPLAY_RECORD_HEADER, len, mode, source, key, report) != SENSOR_OK)
+                continue;
+            if (sources.add(report) == SENSOR_NEW)
+            {
+                check_taken++;
+                if (verbose)
+                {
+                    printf("replay taken: ");
+                    print_report(report);
+                }
+            }
+            else
+                check_turned++;
+        }
+    }
+
+    sources.each([](const SensorSource &s) {
+        printf("source %-10u device %3u reports %8u records %8u duplicates %8u",
+               s.source, s.device, s.reports, s.records, s.duplicates);
+        if (s.has_seq)
+            printf(" last seq %5u", s.last_seq);
+        printf("\n");
+        if (s.frames)
+            printf("  frames %8u lost %8u (%.2f %%) late %8u restarts %8u\n",
+                   s.frames, s.lost, sensor_loss_rate(s) * 100, s.late, s.restarts);
+        if (s.has_counter)
+            printf("  session %08X counter %8u replays %8u\n", s.session, s.last_counter, s.replays);
+    });
+
+    printf("Frames              %12lu\n", frames);
+    for (i = 0; i < REPLAY_STATUS_COUNT; i++)
+        if (statuses[i])
+            printf("  %-17s %12lu\n", sensor_status_name((SensorStatus)i), statuses[i]);
+    printf("Duplicates          %12lu\n", duplicates);
+    if (acks)
+        printf("ACKs to send        %12lu\n", acks);
+    if (replays)
+        printf("Replays             %12lu\n", replays);
+    if (dropped)
+        printf("Source table full   %12lu\n", dropped);
+    if (truncated)
+        printf("Truncated capture   %12lu\n", truncated / repeat);
+    if (t > 0)
+        printf("Decode rate         %12.0f frames/s\n", frames / t);
+    if (check)
+        printf("Replay check        %12lu turned away, %lu taken: %s\n",
+               check_turned, check_taken, check_taken || !check_turned ? "FAILED" : "passed");
+
+    return check && (check_taken || !check_turned) ? 1 : 0;
+}
+
+/*==== END OF FILE ==========================================================*/